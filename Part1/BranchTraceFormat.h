@@ -0,0 +1,113 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef BRANCH_TRACE_FORMAT_H
+#define BRANCH_TRACE_FORMAT_H
+
+#include <stdint.h>
+
+/**
+ * layout of the chunked trace file the runtime writes when BT_TRACE_FILE is set,
+ * shared by the runtime (C) and the trace tools (C++); all integers are little-endian
+ *
+ *      file header                     struct bt_file_header
+ *      chunk 0, chunk 1, ...           BT_CHUNK_SIZE bytes each, the last one may be shorter
+ *      index                           "BTIX", uint32 number of chunks, then per chunk:
+ *                                          uint64 offset, uint64 first event, uint64 events,
+ *                                          uint32 records, uint32 number of branch counts,
+ *                                          per branch count: uint32 branch id, uint64 events
+ *      trailer                         uint64 offset of the index, "BTND"
+ *
+ * a chunk starts with a struct bt_chunk_header and holds whole records, so any chunk
+ * can be decoded on its own; the index is written when the program exits, without it
+ * (the program crashed) the chunks are found from their fixed offsets
+ *
+ * a record is a ULEB128 number "id << 2 | kind":
+ *      BT_RECORD_BRANCH        branch edge "id" was taken                      "br_<id>"
+ *      BT_RECORD_LOOP          followed by ULEB128 count, "id" taken count times "br_<id> x<count>"
+ *      BT_RECORD_CALL          id 0, followed by ULEB128 value of the function pointer an indirect call called
+ */
+
+#define BT_TRACE_MAGIC      "BTRC"
+#define BT_INDEX_MAGIC      "BTIX"
+#define BT_TRAILER_MAGIC    "BTND"
+#define BT_TRACE_VERSION    1
+#define BT_CHUNK_SIZE       65536
+#define BT_MAX_RECORD_SIZE  20          /* two ULEB128 numbers of at most 10 bytes */
+
+enum bt_record_kind {
+    BT_RECORD_BRANCH = 0,
+    BT_RECORD_LOOP = 1,
+    BT_RECORD_CALL = 2
+};
+
+struct bt_file_header {
+    char magic[4];                      /* BT_TRACE_MAGIC */
+    uint32_t version;                   /* BT_TRACE_VERSION */
+    uint32_t chunk_size;                /* BT_CHUNK_SIZE of the runtime that wrote the file */
+    uint32_t reserved;
+};
+
+struct bt_chunk_header {
+    uint32_t used;                      /* bytes of the chunk in use, header included */
+    uint32_t records;
+    uint64_t first_event;               /* number of the first event of the chunk */
+    uint64_t events;                    /* events of the chunk, a loop record counts as many */
+};
+
+/**
+ * layout of the shared memory object the runtime publishes records to when BT_SHM is set,
+ * for a consumer running at the same time (Part1/tools/trace_live)
+ *
+ *      struct bt_shm_header
+ *      BT_SHM_THREADS rings            struct bt_shm_ring, one per traced thread
+ *
+ * every ring has a single producer (its thread) and a single consumer: the producer
+ * writes a record and then publishes it by advancing head, the consumer reads the
+ * records up to head and then frees them by advancing tail; a record is the number
+ * "id << 2 | kind" of the chunked trace and its second ULEB128 number, unencoded
+ *
+ * producer is the pid of the program tracing to the object, so the consumer also stops
+ * when it died without exiting; an object whose producer finished or died is reset in
+ * place (num_rings, finished and the rings) by the next program or consumer, so a
+ * consumer waiting on the name never holds an object nobody writes
+ */
+
+#define BT_SHM_MAGIC        "BTSM"
+#define BT_SHM_VERSION      2
+#define BT_SHM_THREADS      64
+#define BT_SHM_RECORDS      65536       /* records of a ring, a power of two */
+
+struct bt_shm_header {
+    char magic[4];                      /* BT_SHM_MAGIC */
+    uint32_t version;                   /* BT_SHM_VERSION */
+    uint32_t threads;                   /* BT_SHM_THREADS */
+    uint32_t records;                   /* BT_SHM_RECORDS */
+    uint32_t num_rings;                 /* rings taken by threads so far */
+    uint32_t finished;                  /* the program exited */
+    uint32_t producer;                  /* pid of the program, 0 before one started */
+    uint32_t reserved_padding;
+    uint64_t reserved[4];
+};
+
+struct bt_shm_record {
+    uint64_t tag;                       /* id << 2 | kind */
+    uint64_t operand;                   /* loop count, or function pointer called */
+};
+
+struct bt_shm_ring {
+    uint64_t head;                      /* records published, written by the producer */
+    uint64_t dropped;                   /* records the producer dropped because the ring was full */
+    uint64_t producer_padding[6];
+    uint64_t tail;                      /* records consumed, written by the consumer */
+    uint64_t consumer_padding[7];
+    struct bt_shm_record records[BT_SHM_RECORDS];
+};
+
+#endif /* BRANCH_TRACE_FORMAT_H */
@@ -20,6 +20,19 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/GlobPattern.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <algorithm>
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Analysis/ValueTracking.h"
 
 using namespace llvm;
 
@@ -32,6 +45,116 @@ char BranchTracer::ID = 0;
 int id = 0;
 int functionIndex = 0;
 
+#define DEBUG_TYPE "branch-pointer-tracer"
+
+// shown by -stats
+STATISTIC(NumBranchEdges, "Number of conditional branch edges instrumented");
+STATISTIC(NumSwitchEdges, "Number of switch edges instrumented");
+STATISTIC(NumIndirectBrEdges, "Number of indirectbr destinations instrumented");
+STATISTIC(NumSelects, "Number of selects instrumented");
+STATISTIC(NumIndirectCalls, "Number of indirect calls instrumented");
+STATISTIC(NumCoalescedLoops, "Number of loops traced once per loop");
+STATISTIC(NumGuardedCalls, "Number of runtime calls guarded by the tracing flag");
+STATISTIC(NumCountedFunctions, "Number of cold functions with counters instead of trace events");
+STATISTIC(NumUntracedFunctions, "Number of functions left without instrumentation");
+STATISTIC(NumContextFunctions, "Number of functions entering the calling-context tree");
+STATISTIC(NumSkeletonRemoved, "Number of instructions removed from the control-flow skeleton");
+
+namespace
+{
+    /**
+     * a phase of runOnModule, timed by -time-passes and recorded by -time-trace
+     */
+    struct PhaseTimer
+    {
+        NamedRegionTimer Timer;
+        TimeTraceScope Trace;
+
+        PhaseTimer(StringRef Name, StringRef Description)
+            : Timer(Name, Description, DEBUG_TYPE, "Branch tracer phases", TimePassesIsEnabled),
+              Trace(Description) {}
+    };
+}
+
+// select instructions are conditional branches without control flow, tracing them is optional
+static cl::opt<bool> TraceSelects("trace-selects",
+    cl::desc("Also trace the condition of select instructions"),
+    cl::init(false));
+
+// loops whose only traced event is their exit test print that test once, with the trip count, on exit
+static cl::opt<bool> CoalesceLoops("coalesce-loops",
+    cl::desc("Trace the exit test of simple loops once per loop instead of once per iteration"),
+    cl::init(false));
+
+// instrumented programs that may run with tracing off only pay for a load and a branch per event
+static cl::opt<bool> TraceToggle("trace-toggle",
+    cl::desc("Check the runtime's tracing flag before every call to the runtime"),
+    cl::init(false));
+
+// traced functions also report their entries and returns, the runtime builds a calling-context tree
+static cl::opt<bool> CallingContext("calling-context",
+    cl::desc("Build a calling-context tree with branch counts and instruction estimates per context"),
+    cl::init(false));
+
+// selective instrumentation: functions that are hot in a profile, or on the allowlist, are traced,
+// the others only count their branch edges (or get nothing)
+static cl::opt<std::string> TraceProfile("trace-profile",
+    cl::desc("Profile choosing the functions to trace: callgrind output, or a trace or branch counts of an earlier run"),
+    cl::value_desc("file"), cl::init(""));
+
+static cl::opt<double> HotFraction("hot-fraction",
+    cl::desc("Trace the costliest functions of the profile that make up this fraction of its total cost"),
+    cl::init(0.9));
+
+enum class ColdMode { Count, None };
+
+static cl::opt<ColdMode> ColdFunctions("cold-functions",
+    cl::desc("Instrumentation of the functions that are not traced"),
+    cl::values(clEnumValN(ColdMode::Count, "count", "count every branch edge, written at exit (default)"),
+               clEnumValN(ColdMode::None, "none", "no instrumentation")),
+    cl::init(ColdMode::Count));
+
+static cl::list<std::string> TraceFunctions("trace-functions",
+    cl::desc("Functions to trace (globs), the others are cold"),
+    cl::CommaSeparated);
+
+static cl::list<std::string> SkipFunctions("skip-functions",
+    cl::desc("Functions to leave without instrumentation (globs)"),
+    cl::CommaSeparated);
+
+static cl::list<std::string> TraceFiles("trace-files",
+    cl::desc("Source files whose functions are traced (globs), the others are cold"),
+    cl::CommaSeparated);
+
+// the instrumented program keeps only what its branches and indirect calls depend on, see sliceSkeleton
+static cl::opt<bool> Skeleton("skeleton",
+    cl::desc("Remove output and the computations no branch or indirect call depends on"),
+    cl::init(false));
+
+static cl::list<std::string> SkipFiles("skip-files",
+    cl::desc("Source files whose functions are left without instrumentation (globs)"),
+    cl::CommaSeparated);
+
+/**
+ * returns true if the name matches one of the glob patterns
+ */
+static bool matchesAny(StringRef name, const cl::list<std::string> &patterns)
+{
+    for (const std::string &pattern : patterns)
+    {
+        Expected<GlobPattern> glob = GlobPattern::create(pattern);
+        if (!glob)
+        {
+            consumeError(glob.takeError());
+            if (name == pattern)
+                return true;
+        }
+        else if (glob -> match(name))
+            return true;
+    }
+    return false;
+}
+
 /**
  * runOnModule
  * overrides the ModulePass class' function
@@ -47,6 +170,19 @@ bool BranchTracer::runOnModule(Module &M)
 
     for (Function &F : M)               // iterate over all functions in the module
     {
+        // collect the key points first, instrumenting a switch adds blocks to F
+        std::vector<Instruction *> keyPoints;
+
+        // loops traced once per loop, found before any block of F changes
+        std::map<BranchInst *, CoalescedLoop> coalescedLoops;
+        if (CoalesceLoops && !F.isDeclaration())
+        {
+            PhaseTimer timer("coalesce", "Loop coalescing analysis");
+            findCoalescedLoops(F, coalescedLoops);
+        }
+
+        Optional<PhaseTimer> collectTimer;
+        collectTimer.emplace("collect", "Key point collection");
         for (BasicBlock &BB : F)        // iterate over all basic blocks in the function
         {
             for (Instruction &I : BB)   // iterate over all instructions in the basic block
@@ -59,18 +195,85 @@ bool BranchTracer::runOnModule(Module &M)
 
                 if (BranchInst *BI = dyn_cast<BranchInst>(&I))          // if the instruction is a branch instruction
                     if ( BI -> isConditional() )                        // and a conditional branch
-                        printExecutedBranchInfo(Context, BI, M);
+                        keyPoints.push_back(BI);
+
+                if (isa<SwitchInst>(&I) || isa<IndirectBrInst>(&I))     // switch statements and computed gotos
+                    keyPoints.push_back(&I);
+
+                if (TraceSelects && isa<SelectInst>(&I))                // branch-free conditionals, when requested
+                    keyPoints.push_back(&I);
 
-                if (CallInst *CI = dyn_cast<CallInst>(&I))              // if the instruction is a call instruction
-                    printFunctionPtr(Context, CI, F, M);
+                if (isa<CallInst>(&I))                                  // if the instruction is a call instruction
+                    keyPoints.push_back(&I);
+            }
+        }
+
+        collectTimer.reset();
+        unsigned firstId = branchDict.size();
+
+        PhaseTimer instrumentTimer("instrument", "Instrumentation");
+        for (Instruction *I : keyPoints)
+        {
+            BranchInst *BI = dyn_cast<BranchInst>(I);
+            if (BI && coalescedLoops.count(BI))
+                printCoalescedLoopInfo(Context, BI, coalescedLoops[BI], M);
+            else if (BI)
+                printExecutedBranchInfo(Context, BI, M);
+            else if (SwitchInst *SI = dyn_cast<SwitchInst>(I))
+                printExecutedSwitchInfo(Context, SI, M);
+            else if (IndirectBrInst *IBI = dyn_cast<IndirectBrInst>(I))
+                printExecutedIndirectBrInfo(Context, IBI, M);
+            else if (SelectInst *SI = dyn_cast<SelectInst>(I))
+                printExecutedSelectInfo(Context, SI, M);
+            else if (CallInst *CI = dyn_cast<CallInst>(I))
+                printFunctionPtr(Context, CI, M);
+        }
+
+        if (!F.isDeclaration())
+            functionIds.push_back({&F, {firstId, (unsigned) branchDict.size()}});
+    }
+
+    {
+        PhaseTimer timer("select", "Selective instrumentation");
+        std::set<Function *> traced = selectTracedFunctions();
+        for (auto &entry : functionIds)
+        {
+            Function *F = entry.first;
+            if (traced.count(F))
+            {
+                if (CallingContext)
+                    instrumentCallingContext(*F, M, entry.second.first, entry.second.second);
+                if (TraceToggle)
+                    guardRuntimeCalls(*F, M);
             }
+            else if (ColdFunctions == ColdMode::Count && !matchesSkipLists(*F))
+                countRuntimeCalls(*F, M);
+            else
+                removeRuntimeCalls(*F);
         }
     }
 
+    if (Skeleton)
+    {
+        PhaseTimer timer("skeleton", "Skeleton slicing");
+        for (auto &entry : functionIds)
+            sliceSkeleton(*entry.first);
+    }
+
+    PhaseTimer dictionaryTimer("dictionary", "Branch dictionary writing");
     writeToOutfile(llvm::sys::path::filename(filename).str());
     return true; // module was modified
 }
 
+/**
+ * the loop analyses are only used with -coalesce-loops
+ */
+void BranchTracer::getAnalysisUsage(AnalysisUsage &AU) const
+{
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
+}
+
 /**
  * writes to the ouptut file
  * output file name is "../output/filename_BranchDictionary.txt"
@@ -94,58 +297,48 @@ void BranchTracer::writeToOutfile(std::string filename)
 
     errs() << "writing to " + file + "\n";
        // output branchDict information
-    for (const auto &entry : branchDict) {
-        OutFile << entry.first << ": " << entry.second << "\n";
+    for (size_t i = 0; i < branchDict.size(); i++) {
+        OutFile << "br_" << i << ": " << branchDict[i] << "\n";
     }
+    // the ids of a function are consecutive, "fn_<first id>: name, number of ids"
+    for (auto &entry : functionIds)
+        if (entry.second.second > entry.second.first)
+            OutFile << "fn_" << entry.second.first << ": " << entry.first -> getName().str() << ", "
+                    << entry.second.second - entry.second.first << "\n";
     OutFile.close();
 }
 
 /**
  * adds a print statement for function pointers
- * in the format "*func_value"
+ * in the format "*func_value", the value of the pointer called
  * only for indirect function calls (functions invoked via a function pointer)
  *
  * parameters:
  *      Context
  *      Calling instruction
- *      Function
  *      Module
  */
-void BranchTracer::printFunctionPtr(LLVMContext &Context, CallInst *CI, Function &F, Module &M)
+void BranchTracer::printFunctionPtr(LLVMContext &Context, CallInst *CI, Module &M)
 {
-    Function* printfFunc = M.getFunction("printf");
-    if (!printfFunc) {
-        // If 'printf' function is not found, declare it.
-        FunctionType* printfFuncType = FunctionType::get(Type::getInt32Ty(Context), true);
-        printfFunc = Function::Create(printfFuncType, Function::ExternalLinkage, "printf", M);
-        printfFunc -> setCallingConv(CallingConv::C);
-    }
+    if (CI -> getCalledFunction() || CI -> isInlineAsm())
+        return;     // direct function call
 
-    if (Function *calledFunc = CI -> getCalledFunction())
-    {}      // direct function call
-    else    // indirect function call (via function pointer)
-    {
-        IRBuilder<> builder(CI);
-        if (++CI -> getIterator() != CI->getParent()->end()) {
-            builder.SetInsertPoint(CI->getParent(), ++CI->getIterator());
-        }
-        Value *formatStr = builder.CreateGlobalStringPtr("*func_%p\n");
-        Constant *functionPointer = ConstantExpr::getBitCast(&F, builder.getInt8PtrTy());
-        Value *funcPtrValue = builder.CreatePtrToInt(functionPointer, builder.getInt64Ty());
-
-        std::vector<Value *> args;
-        args.push_back(formatStr);
-        args.push_back(funcPtrValue);
-        builder.CreateCall(printfFunc, args);
+    FunctionCallee recordCall = getRuntimeFunction(M, "__bt_record_call", {Type::getInt8PtrTy(Context)});
+    IRBuilder<> builder(CI);
+    if (++CI -> getIterator() != CI->getParent()->end()) {
+        builder.SetInsertPoint(CI->getParent(), ++CI->getIterator());
     }
+    Value *functionPointer = builder.CreatePointerCast(CI -> getCalledOperand(), builder.getInt8PtrTy());
+    builder.CreateCall(recordCall, {functionPointer});
+    ++NumIndirectCalls;
 }
 
 
 /**
- * adds print statements to branches
- * these branches print their id when executed
+ * adds record calls to branches
+ * these branches record their id when executed
  * adds each branch to the branchDict dictionary
- * key: branch id number, value: filename, branch line number, target line number
+ * entry i (branch id i): filename, branch line number, target line number
  * 
  * parameters:
  *      Context
@@ -154,13 +347,7 @@ void BranchTracer::printFunctionPtr(LLVMContext &Context, CallInst *CI, Function
  */
 void BranchTracer::printExecutedBranchInfo(LLVMContext &Context, BranchInst *BI, Module &M)
 {
-    Function* printfFunc = M.getFunction("printf");
-    if (!printfFunc) {
-        // If 'printf' function is not found, declare it.
-        FunctionType* printfFuncType = FunctionType::get(Type::getInt32Ty(Context), true);
-        printfFunc = Function::Create(printfFuncType, Function::ExternalLinkage, "printf", M);
-        printfFunc -> setCallingConv(CallingConv::C);
-    }
+    FunctionCallee recordFunc = getRuntimeFunction(M, "__bt_record", {Type::getInt32Ty(Context)});
 
 
     // Get the DebugLoc information from the branch instruction
@@ -182,7 +369,6 @@ void BranchTracer::printExecutedBranchInfo(LLVMContext &Context, BranchInst *BI,
             if (branchDebugInfo)
             {
                 IRBuilder<> builder(&targetI);                              // create an IR builder for the target instruction
-                Value *formatStr = builder.CreateGlobalStringPtr("br_%d: %s, %s\n");    // setup the string formatter
 
                 if (++targetI.getIterator() != targetI.getParent()->end()) {
                     builder.SetInsertPoint(targetI.getParent(), ++targetI.getIterator());
@@ -191,23 +377,891 @@ void BranchTracer::printExecutedBranchInfo(LLVMContext &Context, BranchInst *BI,
                 std::string branchLine = std::to_string(branchDebugInfo -> getLine());  // get the line number of the target
                 int thisId = branchDict.size();
 
-                branchDict[ "br_" + std::to_string(thisId) ] = filename + ", " + line + ", " + branchLine;
+                branchDict.push_back(filename + ", " + line + ", " + branchLine);
                 errs() << "br_" + std::to_string(thisId) << " " << filename << ", " << line << ", " << branchLine << "\n";
 
-                Value *branchIdNum = builder.getInt32( thisId );
-                Value *branchLineStr = builder.CreateGlobalStringPtr( line );
-                Value *targetLineStr = builder.CreateGlobalStringPtr( branchLine );
+                Value *branchIdNum = builder.getInt32( thisId );            // the text of the id is in the dictionary
+                builder.CreateCall(recordFunc, {branchIdNum});
+                ++NumBranchEdges;
+            }
+        }
+    }
+}
+
+/**
+ * returns a function of the tracer runtime (BranchTracerRuntime.c), declaring it if needed
+ * runtime functions return void and take the given parameters
+ *
+ * parameters:
+ *      Module
+ *      name of the runtime function
+ *      parameter types
+ */
+FunctionCallee BranchTracer::getRuntimeFunction(Module &M, StringRef name, ArrayRef<Type *> params)
+{
+    FunctionType *type = FunctionType::get(Type::getVoidTy(M.getContext()), params, false);
+    return M.getOrInsertFunction(name, type);
+}
+
+/**
+ * returns the source file of a function, empty without debug info
+ */
+static std::string sourceFile(Function &F)
+{
+    if (DISubprogram *SP = F.getSubprogram())
+        return llvm::sys::path::filename(SP -> getFilename()).str();
+    return "";
+}
+
+bool BranchTracer::matchesSkipLists(Function &F)
+{
+    return matchesAny(F.getName(), SkipFunctions) || matchesAny(sourceFile(F), SkipFiles);
+}
+
+/**
+ * reads a profile for -trace-profile, either
+ *      callgrind output: the self cost of every function (first event, usually Ir)
+ *      a trace or the branch counts of an earlier run ("br_4", "br_4 x1000"): the
+ *      events of every branch id, a function costs the events of its ids
+ * branch ids only match if the program and the tracer options did not change
+ *
+ * parameters:
+ *      function costs, by name
+ *      branch events, by id
+ * returns: false if the file cannot be read
+ */
+bool BranchTracer::readProfile(StringMap<uint64_t> &functionCosts, std::map<unsigned, uint64_t> &branchCounts)
+{
+    ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(TraceProfile);
+    if (!file)
+        return false;
+
+    StringMap<std::string> compressedNames;         // callgrind "fn=(12) main", later only "fn=(12)"
+    std::string function;
+    bool callCost = false;                          // the cost line after "calls=" is the inclusive cost of a call
+    SmallVector<StringRef, 8> lines;
+    (*file) -> getBuffer().split(lines, '\n', -1, false);
+    for (StringRef line : lines)
+    {
+        line = line.trim();
+        unsigned id;
+        uint64_t count = 1;
+        if (line.consume_front("br_"))
+        {
+            StringRef idText, countText;
+            std::tie(idText, countText) = line.split(' ');
+            if (!idText.getAsInteger(10, id) && (countText.empty() || (countText.consume_front("x") && !countText.getAsInteger(10, count))))
+                branchCounts[id] += count;
+        }
+        else if (line.consume_front("fn="))
+        {
+            if (line.startswith("("))
+            {
+                StringRef key, name;
+                std::tie(key, name) = line.split(' ');
+                if (!name.empty())
+                    compressedNames[key] = name.str();
+                function = compressedNames.lookup(key);
+            }
+            else
+                function = line.str();
+
+            // recursion levels are separate functions in callgrind, "readLine'2"
+            size_t quote = function.rfind('\'');
+            if (quote != std::string::npos && quote + 1 < function.size() &&
+                std::all_of(function.begin() + quote + 1, function.end(), isDigit))
+                function.erase(quote);
+        }
+        else if (line.consume_front("cfn=") && line.startswith("("))
+        {
+            // a called function can be named first, its later "fn=(12)" has only the id
+            StringRef key, name;
+            std::tie(key, name) = line.split(' ');
+            if (!name.empty())
+                compressedNames[key] = name.str();
+        }
+        else if (line.startswith("calls="))
+            callCost = true;
+        else if (!line.empty() && (isDigit(line[0]) || line[0] == '+' || line[0] == '-' || line[0] == '*'))
+        {
+            SmallVector<StringRef, 4> fields;
+            line.split(fields, ' ', -1, false);
+            if (!callCost && !function.empty() && fields.size() > 1 && !fields[1].getAsInteger(10, count))
+                functionCosts[function] += count;
+            callCost = false;
+        }
+    }
+    return true;
+}
+
+/**
+ * chooses the functions traced with full events:
+ *      functions or files on a skip list are not
+ *      with -trace-functions or -trace-files, the functions on those lists are
+ *      with -trace-profile, the costliest functions making up -hot-fraction of the total cost are
+ *      otherwise all functions are
+ */
+std::set<Function *> BranchTracer::selectTracedFunctions()
+{
+    std::set<Function *> traced;
+    bool allowlist = !TraceFunctions.empty() || !TraceFiles.empty();
+
+    std::vector<std::pair<uint64_t, Function *>> costs;
+    uint64_t totalCost = 0;
+    if (!allowlist && !TraceProfile.empty())
+    {
+        StringMap<uint64_t> functionCosts;
+        std::map<unsigned, uint64_t> branchCounts;
+        if (!readProfile(functionCosts, branchCounts))
+            errs() << "Error: Could not read profile " << TraceProfile << ", tracing every function\n";
+        for (auto &entry : functionIds)
+        {
+            uint64_t cost = functionCosts.lookup(entry.first -> getName());
+            for (auto count = branchCounts.lower_bound(entry.second.first);
+                 count != branchCounts.end() && count -> first < entry.second.second; ++count)
+                cost += count -> second;
+            costs.push_back({cost, entry.first});
+            totalCost += cost;
+        }
+        std::stable_sort(costs.begin(), costs.end(),
+            [](const std::pair<uint64_t, Function *> &a, const std::pair<uint64_t, Function *> &b) { return a.first > b.first; });
+    }
+
+    uint64_t hotCost = 0;
+    for (auto &entry : costs)                                               // costliest first
+    {
+        if (totalCost == 0 || entry.first == 0 || hotCost >= HotFraction * totalCost)
+            break;
+        traced.insert(entry.second);
+        hotCost += entry.first;
+    }
+
+    for (auto &entry : functionIds)
+    {
+        Function *F = entry.first;
+        if (matchesSkipLists(*F))
+            traced.erase(F);
+        else if (allowlist)
+        {
+            if (matchesAny(F -> getName(), TraceFunctions) || matchesAny(sourceFile(*F), TraceFiles))
+                traced.insert(F);
+        }
+        else if (TraceProfile.empty() || totalCost == 0)
+            traced.insert(F);
+    }
+
+    if (allowlist || !TraceProfile.empty() || !SkipFunctions.empty() || !SkipFiles.empty())
+        errs() << "tracing " << traced.size() << " of " << functionIds.size() << " functions\n";
+    return traced;
+}
+
+/**
+ * returns the calls to the tracer runtime in a function
+ */
+static std::vector<CallInst *> runtimeCalls(Function &F)
+{
+    std::vector<CallInst *> calls;
+    for (Instruction &I : instructions(F))
+        if (CallInst *CI = dyn_cast<CallInst>(&I))
+            if (Function *callee = CI -> getCalledFunction())
+                if (callee -> getName().startswith("__bt_record"))
+                    calls.push_back(CI);
+    return calls;
+}
+
+/**
+ * replaces the runtime calls of a cold function by increments of the module's branch
+ * counters, __bt_counters[id] += 1 (or the trip count of a coalesced loop); indirect
+ * calls are not counted
+ * the runtime writes the counters at exit as "br_<id> x<count>" lines, see
+ * __bt_register_counters
+ *
+ * parameters:
+ *      Function
+ *      Module
+ */
+void BranchTracer::countRuntimeCalls(Function &F, Module &M)
+{
+    LLVMContext &Context = M.getContext();
+    ArrayType *countersType = ArrayType::get(Type::getInt64Ty(Context), branchDict.size());
+    if (!counters)
+    {
+        counters = new GlobalVariable(M, countersType, false, GlobalValue::InternalLinkage,
+                                      ConstantAggregateZero::get(countersType), "__bt_counters");
+
+        // a constructor hands the counters to the runtime
+        FunctionCallee registerFunc = getRuntimeFunction(M, "__bt_register_counters",
+                                                         {Type::getInt64PtrTy(Context), Type::getInt32Ty(Context)});
+        Function *constructor = Function::Create(FunctionType::get(Type::getVoidTy(Context), false),
+                                                 GlobalValue::InternalLinkage, "bt.register_counters", M);
+        IRBuilder<> builder(BasicBlock::Create(Context, "entry", constructor));
+        builder.CreateCall(registerFunc, {builder.CreateConstInBoundsGEP2_32(countersType, counters, 0, 0),
+                                          builder.getInt32(branchDict.size())});
+        builder.CreateRetVoid();
+        appendToGlobalCtors(M, constructor, 0);
+    }
+
+    for (CallInst *CI : runtimeCalls(F))
+    {
+        StringRef name = CI -> getCalledFunction() -> getName();
+        if (name == "__bt_record" || name == "__bt_record_loop")
+        {
+            IRBuilder<> builder(CI);
+            Value *id = builder.CreateZExt(CI -> getArgOperand(0), builder.getInt64Ty());
+            Value *counter = builder.CreateInBoundsGEP(countersType, counters, {builder.getInt64(0), id}, "bt.counter");
+            Value *events = name == "__bt_record" ? builder.getInt64(1) : CI -> getArgOperand(1);
+            builder.CreateStore(builder.CreateAdd(builder.CreateLoad(builder.getInt64Ty(), counter), events), counter);
+        }
+        CI -> eraseFromParent();
+    }
+    ++NumCountedFunctions;
+}
+
+/**
+ * removes the runtime calls of a function that is not instrumented at all, its branch
+ * ids stay in the dictionary so that the ids of other functions do not change
+ */
+void BranchTracer::removeRuntimeCalls(Function &F)
+{
+    for (CallInst *CI : runtimeCalls(F))
+        CI -> eraseFromParent();
+    ++NumUntracedFunctions;
+}
+
+/**
+ * puts every call to the tracer runtime in F behind a check of the runtime's flag __bt_enabled
+ *      if (__bt_enabled) __bt_record(id);
+ * the flag is read with a volatile load, so a loop sees it change (signal, __bt_stop)
+ *
+ * parameters:
+ *      Function
+ *      Module
+ */
+void BranchTracer::guardRuntimeCalls(Function &F, Module &M)
+{
+    Type *flagType = Type::getInt32Ty(M.getContext());
+    Constant *flag = M.getOrInsertGlobal("__bt_enabled", flagType);
+    for (CallInst *CI : runtimeCalls(F))
+    {
+        IRBuilder<> builder(CI);
+        LoadInst *enabled = builder.CreateLoad(flagType, flag, /*isVolatile=*/true, "bt.enabled");
+        Instruction *guarded = SplitBlockAndInsertIfThen(builder.CreateIsNotNull(enabled), CI, /*Unreachable=*/false);
+        CI -> moveBefore(guarded);
+        ++NumGuardedCalls;
+    }
+}
+
+/**
+ * returns the line of the first instruction with debug info in a block
+ * the line a branch edge jumps to, "0" if the block has no debug info
+ *
+ * parameters:
+ *      target block
+ */
+std::string BranchTracer::targetLine(BasicBlock *BB)
+{
+    for (Instruction &I : *BB)
+        if (const DebugLoc &debugInfo = I.getDebugLoc())
+            return std::to_string(debugInfo -> getLine());
+    return "0";
+}
+
+/**
+ * adds one record call per switch statement
+ * every edge of the switch (the default and each case) gets its own branch id,
+ * the edges lead through small blocks that only name their id, and a single
+ * record block records the id of the taken edge and dispatches on the condition again
+ * the ids are phi nodes of constants, which later passes turn into a lookup table
+ *
+ *      switch c [default: D, 1: A, 2: B]
+ * becomes
+ *      switch c [default: e0, 1: e1, 2: e2]
+ *      e0/e1/e2: br record
+ *      record:   id = phi [br_k, e0], [br_k+1, e1], [br_k+2, e2]
+ *                __bt_record(id)
+ *                switch c [default: D, 1: A, 2: B]
+ *
+ * parameters:
+ *      Context
+ *      Switch Instruction
+ *      Module
+ */
+void BranchTracer::printExecutedSwitchInfo(LLVMContext &Context, SwitchInst *SI, Module &M)
+{
+    const DebugLoc &debugInfo = SI -> getDebugLoc();
+    if ( !debugInfo )
+        return;
+
+    FunctionCallee recordFunc = getRuntimeFunction(M, "__bt_record", {Type::getInt32Ty(Context)});
+    std::string filename = llvm::sys::path::filename(debugInfo -> getFilename()).str();
+    std::string line = std::to_string(debugInfo -> getLine());
+    BasicBlock *switchBB = SI -> getParent();
+    Function *F = switchBB -> getParent();
+    unsigned numEdges = SI -> getNumSuccessors();
+
+    // the record block: record the id of the taken edge, then take it
+    BasicBlock *recordBB = BasicBlock::Create(Context, "switch.record", F);
+    IRBuilder<> builder(recordBB);
+    PHINode *idPhi = builder.CreatePHI(builder.getInt32Ty(), numEdges, "switch.id");
+    builder.CreateCall(recordFunc, {idPhi});
+    SwitchInst *dispatch = cast<SwitchInst>(SI -> clone());
+    builder.Insert(dispatch);
+
+    // the original successors are now entered from the record block
+    for ( unsigned i = 0; i < numEdges; i++ )
+        SI -> getSuccessor(i) -> replacePhiUsesWith(switchBB, recordBB);
+
+    for ( unsigned i = 0; i < numEdges; i++ )                              // the default and each case
+    {
+        BasicBlock *successor = SI -> getSuccessor(i);
+        std::string branchLine = targetLine(successor);
+        int thisId = branchDict.size();
+
+        branchDict.push_back(filename + ", " + line + ", " + branchLine);
+        errs() << "br_" + std::to_string(thisId) << " " << filename << ", " << line << ", " << branchLine << "\n";
 
+        BasicBlock *edgeBB = BasicBlock::Create(Context, "switch.edge", F, recordBB);
+        BranchInst::Create(recordBB, edgeBB);
+        idPhi -> addIncoming(builder.getInt32(thisId), edgeBB);
+        SI -> setSuccessor(i, edgeBB);
+        ++NumSwitchEdges;
+    }
+}
+
+/**
+ * adds a record call to an indirect branch (goto *address)
+ * every possible destination gets a branch id, the id of the taken one is
+ * selected by comparing the address against each destination
+ *
+ * parameters:
+ *      Context
+ *      IndirectBr Instruction
+ *      Module
+ */
+void BranchTracer::printExecutedIndirectBrInfo(LLVMContext &Context, IndirectBrInst *IBI, Module &M)
+{
+    const DebugLoc &debugInfo = IBI -> getDebugLoc();
+    if ( !debugInfo || IBI -> getNumDestinations() == 0 )
+        return;
+
+    FunctionCallee recordFunc = getRuntimeFunction(M, "__bt_record", {Type::getInt32Ty(Context)});
+    std::string filename = llvm::sys::path::filename(debugInfo -> getFilename()).str();
+    std::string line = std::to_string(debugInfo -> getLine());
+    Function *F = IBI -> getFunction();
+
+    IRBuilder<> builder(IBI);
+    Value *address = IBI -> getAddress();
+    Value *idValue = nullptr;
+
+    for ( unsigned i = 0; i < IBI -> getNumDestinations(); i++ )
+    {
+        BasicBlock *destination = IBI -> getDestination(i);
+        std::string branchLine = targetLine(destination);
+        int thisId = branchDict.size();
+
+        branchDict.push_back(filename + ", " + line + ", " + branchLine);
+        errs() << "br_" + std::to_string(thisId) << " " << filename << ", " << line << ", " << branchLine << "\n";
+
+        Value *thisIdNum = builder.getInt32(thisId);
+        if ( !idValue )                                                     // first destination is the fallback
+        {
+            idValue = thisIdNum;
+            continue;
+        }
+
+        Value *blockAddress = builder.CreateBitCast(BlockAddress::get(F, destination), address -> getType());
+        Value *isTaken = builder.CreateICmpEQ(address, blockAddress);
+        idValue = builder.CreateSelect(isTaken, thisIdNum, idValue);
+    }
+
+    builder.CreateCall(recordFunc, {idValue});
+    NumIndirectBrEdges += IBI -> getNumDestinations();
+}
+
+/**
+ * adds a record call to a select instruction (c ? a : b without a branch)
+ * the true and false outcomes get consecutive branch ids, both "target" the select's own line
+ *
+ * parameters:
+ *      Context
+ *      Select Instruction
+ *      Module
+ */
+void BranchTracer::printExecutedSelectInfo(LLVMContext &Context, SelectInst *SI, Module &M)
+{
+    const DebugLoc &debugInfo = SI -> getDebugLoc();
+    if ( !debugInfo || SI -> getCondition() -> getType() -> isVectorTy() )
+        return;
+
+    FunctionCallee recordFunc = getRuntimeFunction(M, "__bt_record", {Type::getInt32Ty(Context)});
+    std::string filename = llvm::sys::path::filename(debugInfo -> getFilename()).str();
+    std::string line = std::to_string(debugInfo -> getLine());
+
+    int trueId = branchDict.size();
+    for ( int i = 0; i < 2; i++ )                                           // true, then false
+    {
+        branchDict.push_back(filename + ", " + line + ", " + line);
+        errs() << "br_" + std::to_string(trueId + i) << " " << filename << ", " << line << ", " << line << "\n";
+    }
+
+    IRBuilder<> builder(SI);
+    Value *idValue = builder.CreateSelect(SI -> getCondition(), builder.getInt32(trueId), builder.getInt32(trueId + 1));
+    builder.CreateCall(recordFunc, {idValue});
+    ++NumSelects;
+}
+
+/**
+ * finds the loops of a function whose exit test can be traced once per loop
+ * and prepares their trip count: counted loops (ScalarEvolution knows the
+ * backedge-taken count) compute it in the preheader and cost nothing per
+ * iteration, other loops count their iterations in a phi of the header
+ *
+ * parameters:
+ *      Function
+ *      loops - filled with the exit test and trip count of each such loop
+ */
+void BranchTracer::findCoalescedLoops(Function &F, std::map<BranchInst *, CoalescedLoop> &loops)
+{
+    LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+    ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>(F).getSE();
+    Type *countTy = Type::getInt64Ty(F.getContext());
+
+    for (Loop *L : LI.getLoopsInPreorder())
+    {
+        BranchInst *BI = coalescibleExitTest(L);
+        if (!BI)
+            continue;
+
+        CoalescedLoop loop;
+        loop.continueSuccessor = L -> contains(BI -> getSuccessor(0)) ? 0 : 1;
+
+        BasicBlock *preheader = L -> getLoopPreheader();
+        const SCEV *backedges = SE.getBackedgeTakenCount(L);
+        if (!isa<SCEVCouldNotCompute>(backedges) && backedges -> getType() -> isIntegerTy() &&
+            isSafeToExpandAt(backedges, preheader -> getTerminator(), SE))
+        {
+            SCEVExpander expander(SE, F.getParent() -> getDataLayout(), "bt.tripcount");
+            loop.tripCount = expander.expandCodeFor(SE.getTruncateOrZeroExtend(backedges, countTy),
+                                                    countTy, preheader -> getTerminator());
+        }
+        else
+        {
+            BasicBlock *latch = L -> getLoopLatch();
+            IRBuilder<> builder(&L -> getHeader() -> front());
+            PHINode *counter = builder.CreatePHI(countTy, 2, "bt.iterations");
+            builder.SetInsertPoint(latch -> getTerminator());
+            Value *next = builder.CreateAdd(counter, builder.getInt64(1), "bt.iterations.next");
+            counter -> addIncoming(builder.getInt64(0), preheader);
+            counter -> addIncoming(next, latch);
+            loop.tripCount = counter;
+        }
+        loops[BI] = loop;
+    }
+}
+
+/**
+ * returns the exit test of a loop if it is the only event the loop traces, nullptr otherwise
+ * the test must be in the header and be the only way out of the loop, and the
+ * block it continues to must be entered from nowhere else, so that the number of
+ * times that block is entered is the number of backedges taken
+ *
+ * parameters:
+ *      Loop
+ */
+BranchInst *BranchTracer::coalescibleExitTest(Loop *L)
+{
+    BasicBlock *header = L -> getHeader();
+    if (!L -> getLoopPreheader() || !L -> getLoopLatch() || L -> getExitingBlock() != header || !L -> getExitBlock())
+        return nullptr;
+
+    BranchInst *BI = dyn_cast<BranchInst>(header -> getTerminator());
+    if (!BI || !BI -> isConditional() || !BI -> getDebugLoc())
+        return nullptr;
+
+    BasicBlock *body = BI -> getSuccessor(L -> contains(BI -> getSuccessor(0)) ? 0 : 1);
+    if (body -> getSinglePredecessor() != header || !body -> front().getDebugLoc())
+        return nullptr;
+
+    for (BasicBlock *BB : L -> blocks())
+    {
+        for (Instruction &I : *BB)
+        {
+            if (&I == BI)
+                continue;
+            if (BranchInst *other = dyn_cast<BranchInst>(&I))
+            {
+                if (other -> isConditional())
+                    return nullptr;
+            }
+            else if (isa<SwitchInst>(&I) || isa<IndirectBrInst>(&I) || (TraceSelects && isa<SelectInst>(&I)))
+                return nullptr;
+            else if (CallInst *CI = dyn_cast<CallInst>(&I))
+            {
+                Function *callee = CI -> getCalledFunction();
+                if (!callee || !isTraceFree(callee))
+                    return nullptr;
+            }
+        }
+    }
+    return BI;
+}
+
+/**
+ * returns true if calling a function can neither add events to the trace nor
+ * print anything else in between them: intrinsics, and defined functions that
+ * only call such functions and have no key points of their own
+ * external functions (printf, getc, ...) may write to the same stream as the trace
+ *
+ * parameters:
+ *      Function
+ */
+bool BranchTracer::isTraceFree(Function *F)
+{
+    if (F -> isDeclaration())
+        return F -> isIntrinsic();
+
+    auto known = traceFree.find(F);
+    if (known != traceFree.end())
+        return known -> second;
+
+    traceFree[F] = false;                                                   // recursion is not trace free
+    for (BasicBlock &BB : *F)
+    {
+        for (Instruction &I : BB)
+        {
+            BranchInst *BI = dyn_cast<BranchInst>(&I);
+            if ((BI && BI -> isConditional()) || isa<SwitchInst>(&I) || isa<IndirectBrInst>(&I) ||
+                (TraceSelects && isa<SelectInst>(&I)))
+                return false;
+            if (CallInst *CI = dyn_cast<CallInst>(&I))
+            {
+                Function *callee = CI -> getCalledFunction();
+                if (!callee || !isTraceFree(callee))
+                    return false;
+            }
+        }
+    }
+    return traceFree[F] = true;
+}
+
+/**
+ * adds record calls to the exit test of a coalesced loop
+ * the edge leaving the loop records its id as usual, the edge staying in the loop
+ * records nothing per iteration, instead a block on the exit edge records its id
+ * once with the number of times it was taken:
+ *      br_4 x1000
+ * decode_trace.sh expands such a line back into 1000 "br_4" lines
+ *
+ * parameters:
+ *      Context
+ *      Branch Instruction (the loop's exit test)
+ *      CoalescedLoop (which successor stays in the loop, and the trip count)
+ *      Module
+ */
+void BranchTracer::printCoalescedLoopInfo(LLVMContext &Context, BranchInst *BI, const CoalescedLoop &loop, Module &M)
+{
+    FunctionCallee recordFunc = getRuntimeFunction(M, "__bt_record", {Type::getInt32Ty(Context)});
+    FunctionCallee recordLoopFunc = getRuntimeFunction(M, "__bt_record_loop", {Type::getInt32Ty(Context), Type::getInt64Ty(Context)});
+    const DebugLoc &debugInfo = BI -> getDebugLoc();
+    std::string filename = llvm::sys::path::filename(debugInfo -> getFilename()).str();
+    std::string line = std::to_string(debugInfo -> getLine());
+    BasicBlock *successors[2] = { BI -> getSuccessor(0), BI -> getSuccessor(1) };
+    unsigned exitSuccessor = 1 - loop.continueSuccessor;
+    ++NumCoalescedLoops;
+
+    for ( unsigned i = 0; i < 2; i++ )                                      // ids in successor order, as in printExecutedBranchInfo
+    {
+        Instruction &targetI = successors[i] -> front();
+        const DebugLoc &branchDebugInfo = targetI.getDebugLoc();
+        if (!branchDebugInfo)
+            continue;
+
+        std::string branchLine = std::to_string(branchDebugInfo -> getLine());
+        int thisId = branchDict.size();
+
+        branchDict.push_back(filename + ", " + line + ", " + branchLine);
+        errs() << "br_" + std::to_string(thisId) << " " << filename << ", " << line << ", " << branchLine << "\n";
+
+        IRBuilder<> builder(&targetI);
+        if (i == loop.continueSuccessor)
+        {
+            // the exit edge gets its own block, recording before the exit target does
+            BasicBlock *header = BI -> getParent();
+            BasicBlock *countBB = BasicBlock::Create(Context, "loop.trace", header -> getParent(), successors[exitSuccessor]);
+            BI -> setSuccessor(exitSuccessor, countBB);
+            successors[exitSuccessor] -> replacePhiUsesWith(header, countBB);
+
+            builder.SetInsertPoint(countBB);
+            builder.CreateCall(recordLoopFunc, {builder.getInt32(thisId), loop.tripCount});
+            builder.CreateBr(successors[exitSuccessor]);
+        }
+        else
+        {
+            if (++targetI.getIterator() != targetI.getParent()->end()) {
+                builder.SetInsertPoint(targetI.getParent(), ++targetI.getIterator());
+            }
+            builder.CreateCall(recordFunc, {builder.getInt32(thisId)});
+        }
+        ++NumBranchEdges;
+    }
+}
+
+/**
+ * returns an estimate of the instructions run from the start of a block to the next
+ * branch: the instructions of the block and of the blocks it falls through to with
+ * unconditional branches, without debug intrinsics and calls to the tracer runtime
+ *
+ * parameters:
+ *      BasicBlock
+ */
+static unsigned straightLineCost(BasicBlock *BB)
+{
+    std::set<BasicBlock *> visited;
+    unsigned cost = 0;
+    while (BB && visited.insert(BB).second)
+    {
+        for (Instruction &I : *BB)
+        {
+            if (isa<DbgInfoIntrinsic>(&I))
+                continue;
+            if (CallInst *CI = dyn_cast<CallInst>(&I))
+                if (Function *callee = CI -> getCalledFunction())
+                    if (callee -> getName().startswith("__bt_"))
+                        continue;
+            cost++;
+        }
+        BranchInst *BI = dyn_cast<BranchInst>(BB -> getTerminator());
+        BB = BI && BI -> isUnconditional() ? BI -> getSuccessor(0) : nullptr;
+    }
+    return cost;
+}
+
+/**
+ * adds the calls building the calling-context tree to a traced function
+ *      __bt_enter(&bt.function.<name>)     on entry
+ *      __bt_exit()                         before every return
+ * bt.function.<name> is the function's struct bt_function (BranchTracerRuntime.c): its
+ * name, its branch ids and the estimated instructions run on entry and per event of each
+ * branch id, which the runtime adds to the context the events happen in
+ * a coalesced loop costs its body per iteration; select and indirectbr edges cost nothing
+ * of their own, the instructions around them belong to the edge that reached them
+ *
+ * parameters:
+ *      Function
+ *      Module
+ *      firstId, lastId - the function's branch ids [firstId, lastId)
+ */
+void BranchTracer::instrumentCallingContext(Function &F, Module &M, unsigned firstId, unsigned lastId)
+{
+    LLVMContext &Context = M.getContext();
+    Type *int32Ty = Type::getInt32Ty(Context);
+
+    // the estimated instructions of every branch id, from the blocks its record call is in
+    std::vector<Constant *> edgeCosts(lastId - firstId, ConstantInt::get(int32Ty, 0));
+    std::set<BasicBlock *> costed;
+    for (CallInst *CI : runtimeCalls(F))
+    {
+        BasicBlock *BB = CI -> getParent();
+        Value *idValue = CI -> getArgOperand(0);
+        StringRef name = CI -> getCalledFunction() -> getName();
+        if (name == "__bt_record_loop")
+        {
+            // loop.trace block: the exit test it is entered from continues to the body
+            BranchInst *exitTest = cast<BranchInst>(BB -> getSinglePredecessor() -> getTerminator());
+            BasicBlock *body = exitTest -> getSuccessor(exitTest -> getSuccessor(0) == BB ? 1 : 0);
+            unsigned id = cast<ConstantInt>(idValue) -> getZExtValue();
+            edgeCosts[id - firstId] = ConstantInt::get(int32Ty, straightLineCost(body));
+        }
+        else if (name == "__bt_record" && isa<ConstantInt>(idValue) && costed.insert(BB).second)
+        {
+            unsigned id = cast<ConstantInt>(idValue) -> getZExtValue();
+            edgeCosts[id - firstId] = ConstantInt::get(int32Ty, straightLineCost(BB));
+        }
+        else if (PHINode *idPhi = dyn_cast<PHINode>(idValue))
+        {
+            // switch.record: the edge block of each id is a successor of the original switch,
+            // at the index of the case's target in the dispatching switch
+            SwitchInst *dispatch = cast<SwitchInst>(BB -> getTerminator());
+            for (unsigned i = 0; i < idPhi -> getNumIncomingValues(); i++)
+            {
+                BasicBlock *edgeBB = idPhi -> getIncomingBlock(i);
+                SwitchInst *original = cast<SwitchInst>(edgeBB -> getSinglePredecessor() -> getTerminator());
+                for (unsigned j = 0; j < original -> getNumSuccessors(); j++)
+                {
+                    if (original -> getSuccessor(j) != edgeBB)
+                        continue;
+                    unsigned id = cast<ConstantInt>(idPhi -> getIncomingValue(i)) -> getZExtValue();
+                    edgeCosts[id - firstId] = ConstantInt::get(int32Ty, straightLineCost(dispatch -> getSuccessor(j)));
+                }
+            }
+        }
+    }
+
+    // struct bt_function { const char *name; uint32_t first_id, num_ids, entry_cost; const uint32_t *edge_costs; }
+    Type *int8PtrTy = Type::getInt8PtrTy(Context);
+    Type *int32PtrTy = Type::getInt32PtrTy(Context);
+    StructType *functionType = StructType::getTypeByName(Context, "bt.function");
+    if (!functionType)
+        functionType = StructType::create(Context, {int8PtrTy, int32Ty, int32Ty, int32Ty, int32PtrTy}, "bt.function");
 
-                std::vector<Value *> args;
-                args.push_back(formatStr);
-                args.push_back(branchIdNum);      
-                args.push_back(branchLineStr);
-                args.push_back(targetLineStr);
-                builder.CreateCall(printfFunc, args);
+    Constant *costs = ConstantPointerNull::get(cast<PointerType>(int32PtrTy));
+    if (!edgeCosts.empty())
+    {
+        ArrayType *costsType = ArrayType::get(int32Ty, edgeCosts.size());
+        GlobalVariable *costsArray = new GlobalVariable(M, costsType, true, GlobalValue::PrivateLinkage,
+                                                        ConstantArray::get(costsType, edgeCosts), "bt.costs." + F.getName());
+        costs = ConstantExpr::getInBoundsGetElementPtr(costsType, costsArray,
+                                                       ArrayRef<Constant *>({ConstantInt::get(int32Ty, 0), ConstantInt::get(int32Ty, 0)}));
+    }
+    IRBuilder<> builder(&*F.getEntryBlock().getFirstInsertionPt());
+    Constant *description = ConstantStruct::get(functionType, {
+        builder.CreateGlobalStringPtr(F.getName(), "bt.name." + F.getName()),
+        builder.getInt32(firstId),
+        builder.getInt32(lastId - firstId),
+        builder.getInt32(straightLineCost(&F.getEntryBlock())),
+        costs});
+    GlobalVariable *function = new GlobalVariable(M, functionType, true, GlobalValue::PrivateLinkage,
+                                                  description, "bt.function." + F.getName());
+
+    FunctionCallee enterFunc = getRuntimeFunction(M, "__bt_enter", {int8PtrTy});
+    FunctionCallee exitFunc = getRuntimeFunction(M, "__bt_exit", {});
+    builder.CreateCall(enterFunc, {builder.CreateBitCast(function, int8PtrTy)});
+    for (BasicBlock &BB : F)
+    {
+        Instruction *exit = BB.getTerminator();
+        if (!isa<ReturnInst>(exit) && !isa<ResumeInst>(exit))
+            continue;
+        // a musttail call must stay right before its return
+        if (CallInst *tailCall = dyn_cast_or_null<CallInst>(exit -> getPrevNode()))
+            if (tailCall -> isMustTailCall())
+                exit = tailCall;
+        builder.SetInsertPoint(exit);
+        builder.CreateCall(exitFunc, {});
+    }
+    ++NumContextFunctions;
+}
+
+/**
+ * returns true for a call to a libc output function, the skeleton drops these
+ */
+static bool isOutputCall(CallInst *CI)
+{
+    static const std::set<std::string> outputFunctions = {
+        "printf", "fprintf", "vprintf", "vfprintf", "puts", "fputs", "putchar", "putc", "fputc", "fwrite", "fflush", "perror"
+    };
+    Function *callee = CI -> getCalledFunction();
+    return callee && callee -> isDeclaration() && outputFunctions.count(callee -> getName().str());
+}
+
+/**
+ * returns true if the address of a local variable is only loaded from, stored to or
+ * printed, so its stores only matter to the loads of F that read it
+ */
+static bool isPrivateAlloca(AllocaInst *AI)
+{
+    std::vector<Value *> pointers = {AI};
+    while (!pointers.empty())
+    {
+        Value *pointer = pointers.back();
+        pointers.pop_back();
+        for (User *U : pointer -> users())
+        {
+            if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U))
+                pointers.push_back(U);
+            else if (StoreInst *SI = dyn_cast<StoreInst>(U))
+            {
+                if (SI -> getValueOperand() == pointer || SI -> isVolatile())
+                    return false;
+            }
+            else if (LoadInst *LI = dyn_cast<LoadInst>(U))
+            {
+                if (LI -> isVolatile())
+                    return false;
             }
+            else if (!isa<DbgInfoIntrinsic>(U) && !(isa<CallInst>(U) && isOutputCall(cast<CallInst>(U))))
+                return false;
         }
     }
+    return true;
+}
+
+/**
+ * cuts an instrumented function down to its control-flow skeleton, a backward slice from
+ *      every terminator (conditional branches, switches, returns, ...)
+ *      every instruction with side effects: calls, including the tracer runtime and
+ *      indirect calls, and stores to memory other code may read
+ * following operands, and the stores to a private local variable (isPrivateAlloca) that
+ * a kept load or call may read
+ * output calls are dropped unless their result is used; every block and branch stays, so
+ * the skeleton produces the trace of the full program. it runs after the instrumentation,
+ * which is why the dictionary and the calling-context costs still describe the full program
+ *
+ * parameters:
+ *      Function
+ */
+void BranchTracer::sliceSkeleton(Function &F)
+{
+    std::set<AllocaInst *> privateAllocas;
+    for (Instruction &I : instructions(F))
+        if (AllocaInst *AI = dyn_cast<AllocaInst>(&I))
+            if (isPrivateAlloca(AI))
+                privateAllocas.insert(AI);
+
+    auto privateObject = [&](Value *pointer) -> AllocaInst * {
+        AllocaInst *AI = dyn_cast<AllocaInst>(getUnderlyingObject(pointer));
+        return AI && privateAllocas.count(AI) ? AI : nullptr;
+    };
+
+    std::set<Instruction *> kept;
+    std::vector<Instruction *> worklist;
+    auto keep = [&](Value *V) {
+        if (Instruction *I = dyn_cast<Instruction>(V))
+            if (kept.insert(I).second)
+                worklist.push_back(I);
+    };
+
+    std::map<AllocaInst *, std::vector<StoreInst *>> privateStores;
+    for (Instruction &I : instructions(F))
+    {
+        StoreInst *SI = dyn_cast<StoreInst>(&I);
+        CallInst *CI = dyn_cast<CallInst>(&I);
+        if (SI && privateObject(SI -> getPointerOperand()))
+            privateStores[privateObject(SI -> getPointerOperand())].push_back(SI);
+        else if (CI && (isOutputCall(CI) || isa<DbgInfoIntrinsic>(CI)))
+            continue;
+        else if (I.isTerminator() || I.mayHaveSideEffects() || isa<AllocaInst>(&I))
+            keep(&I);
+    }
+
+    std::set<AllocaInst *> readAllocas;
+    while (!worklist.empty())
+    {
+        Instruction *I = worklist.back();
+        worklist.pop_back();
+        for (Value *operand : I -> operands())
+            keep(operand);
+
+        // a load, or a call given a pointer, reads the stores to a private variable
+        for (Value *operand : I -> operands())
+        {
+            if (!operand -> getType() -> isPointerTy() || (!isa<LoadInst>(I) && !isa<CallInst>(I)))
+                continue;
+            AllocaInst *AI = privateObject(operand);
+            if (AI && readAllocas.insert(AI).second)
+                for (StoreInst *SI : privateStores[AI])
+                    keep(SI);
+        }
+    }
+
+    std::vector<Instruction *> removed;
+    for (Instruction &I : instructions(F))
+        if (!kept.count(&I))
+            removed.push_back(&I);
+    for (Instruction *I : removed)
+        I -> replaceAllUsesWith(UndefValue::get(I -> getType()));
+    for (Instruction *I : removed)
+        I -> eraseFromParent();
+    NumSkeletonRemoved += removed.size();
 }
 
 // this registers the branch-pointer-tracer pass with the LLVM
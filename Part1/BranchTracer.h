@@ -24,7 +24,13 @@
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/ADT/StringMap.h"
 #include <map>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace llvm 
 {
@@ -34,12 +40,50 @@ namespace llvm
             static char ID;
             BranchTracer() : ModulePass(ID) {}
             bool runOnModule(Module &M) override;
+            void getAnalysisUsage(AnalysisUsage &AU) const override;
 
         private:
-            std::map<std::string, std::string> branchDict;
+            // a loop whose exit test is traced once, with its trip count, when the loop exits
+            struct CoalescedLoop
+            {
+                unsigned continueSuccessor;     // successor of the exit test that stays in the loop
+                Value *tripCount;               // i64 number of times that successor was entered
+            };
 
-            void printFunctionPtr(LLVMContext &Context, CallInst *CI, Function &F, Module &M);
+            // branch dictionary indexed by branch id, entry i is "filename, line, target line" of br_i
+            std::vector<std::string> branchDict;
+
+            // whether calling a function can print anything to the trace, memoized per function
+            std::map<Function *, bool> traceFree;
+
+            // the branch ids [first, last) of every instrumented function, for selective instrumentation
+            std::vector<std::pair<Function *, std::pair<unsigned, unsigned>>> functionIds;
+
+            // branch counters of the cold functions, created for the first one
+            GlobalVariable *counters = nullptr;
+
+            void printFunctionPtr(LLVMContext &Context, CallInst *CI, Module &M);
             void printExecutedBranchInfo(LLVMContext &Context, BranchInst *BI, Module &M);
+            void printExecutedSwitchInfo(LLVMContext &Context, SwitchInst *SI, Module &M);
+            void printExecutedIndirectBrInfo(LLVMContext &Context, IndirectBrInst *IBI, Module &M);
+            void printExecutedSelectInfo(LLVMContext &Context, SelectInst *SI, Module &M);
+            void printCoalescedLoopInfo(LLVMContext &Context, BranchInst *BI, const CoalescedLoop &loop, Module &M);
+
+            void findCoalescedLoops(Function &F, std::map<BranchInst *, CoalescedLoop> &loops);
+            BranchInst *coalescibleExitTest(Loop *L);
+            bool isTraceFree(Function *F);
+            void guardRuntimeCalls(Function &F, Module &M);
+
+            bool readProfile(StringMap<uint64_t> &functionCosts, std::map<unsigned, uint64_t> &branchCounts);
+            std::set<Function *> selectTracedFunctions();
+            bool matchesSkipLists(Function &F);
+            void countRuntimeCalls(Function &F, Module &M);
+            void removeRuntimeCalls(Function &F);
+            void instrumentCallingContext(Function &F, Module &M, unsigned firstId, unsigned lastId);
+            void sliceSkeleton(Function &F);
+
+            FunctionCallee getRuntimeFunction(Module &M, StringRef name, ArrayRef<Type *> params);
+            std::string targetLine(BasicBlock *BB);
 
             void addBranchInfo(Instruction *I, BranchInst *BI, std::vector<std::pair<std::string, std::string>> *branchDict);
             void writeToOutfile(std::string filename);
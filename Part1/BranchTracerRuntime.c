@@ -0,0 +1,1259 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#define _GNU_SOURCE                             /* mremap */
+#include "BranchTraceFormat.h"
+#include "BranchTracerRuntime.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * runtime of the branch-pointer tracer
+ * link it with the transformed program:
+ *      clang transformed_example.ll Part1/BranchTracerRuntime.c -pthread -o traced_example
+ *
+ * the instrumentation only passes branch ids, the text of an id (file, branch line,
+ * target line) is in the branch dictionary and looked up when the trace is decoded:
+ *      ./decode_trace.sh -d output/example.c_BranchDictionary.txt trace.txt
+ * the trace goes to stdout, in order with the program's own output
+ *
+ * with BT_TRACE_FILE=<path> in the environment the trace is written to that file
+ * instead, in the chunked format of BranchTraceFormat.h: fixed-size chunks with an
+ * index of their event ranges and branch counts at the end, so the tools in
+ * Part1/tools can seek to an event or decode the chunks in parallel
+ * records of all threads go to the same chunks, one thread at a time, in the order
+ * they were made
+ *
+ * the trace file is mapped into memory and the chunks are filled right in the
+ * mapping, which grows BT_MAP_GROWTH bytes at a time; every record updates the
+ * header of its chunk, so whatever was recorded is in the file even when the
+ * program aborts, crashes or leaves through _exit (the index is missing then,
+ * and the tools find the chunks at their fixed offsets)
+ *
+ * files that cannot be mapped (pipes) are written by a writer thread instead: the
+ * program fills one of BT_BUFFERS chunk buffers and hands it over, and only waits
+ * when all of them are still waiting to be written, so a slow disk does not stall
+ * every chunk boundary
+ *
+ * with BT_FLIGHT_RECORDER=<records> the runtime keeps only the last <records> records
+ * of every thread, in a ring buffer per thread that needs no locks, and writes them
+ * as text when __bt_dump is called, when the program gets SIGUSR2 (or the signal
+ * number in BT_FLIGHT_SIGNAL, 0 for none) and at exit; dump n goes to
+ * "<BT_TRACE_FILE>.<n>", "flight_recorder.<pid>.<n>" without BT_TRACE_FILE
+ *
+ * with BT_SHM=<name> the records are published to the shared memory object <name>
+ * (BranchTraceFormat.h), a ring per thread read by a consumer running at the same
+ * time, e.g. Part1/tools/trace_live; when a ring is full its records are dropped and
+ * counted, or, with BT_SHM_BLOCK=1, the thread waits for the consumer
+ *
+ * tracing can be switched off and on while the program runs: with __bt_stop and
+ * __bt_start, with SIGUSR1 (or the signal number in BT_TOGGLE_SIGNAL, 0 for none),
+ * which switches it over, and with BT_TRACING=off the program starts with tracing
+ * off; the flag is __bt_enabled, checked here and, for programs instrumented with
+ * -trace-toggle, before every call to the runtime
+ *
+ * programs instrumented with -calling-context call __bt_enter and __bt_exit in every
+ * traced function, and the runtime builds a calling-context tree per thread instead
+ * of the trace: a node per distinct chain of calls, with its calls, the events of
+ * each of its function's branch ids and an estimate of the instructions it ran; a
+ * recursive call goes back to the node of the earlier call of the same function, so
+ * the tree stays as small as the program's call structure; the trees are written at
+ * exit to BT_CCT_FILE, "calling_context.<pid>" without it, and with BT_CCT_TRACE=1
+ * the trace is recorded as well
+ *
+ * functions the tracer left cold (-trace-profile, -trace-functions, ...) only count
+ * their branch edges in an array of the module, which is registered here and written
+ * at exit to BT_COUNTS_FILE, "branch_counts.<pid>" without it, as "br_<id> x<count>"
+ * lines, so the trace tools read it like a trace
+ */
+
+#define BT_BUFFERS 4
+#define BT_MAP_GROWTH (64 * BT_CHUNK_SIZE)
+
+volatile int __bt_enabled = 1;
+
+static int started;                             /* start_trace has run */
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+static uint64_t flight_capacity;                /* records per thread, 0 without the flight recorder */
+static struct bt_shm_header *shm;               /* shared memory of the consumer, NULL without BT_SHM */
+static int trace_fd = -1;                       /* chunked trace, -1 for text on stdout */
+
+static unsigned char buffers[BT_BUFFERS][BT_CHUNK_SIZE];
+static unsigned current_buffer;
+static unsigned char *chunk = buffers[0];       /* the chunk being filled */
+static struct bt_chunk_header *chunk_header = (struct bt_chunk_header *) buffers[0];
+static uint32_t chunk_used;
+static uint64_t chunks_written;
+static uint64_t trace_end;                      /* end of the chunks handed over */
+
+/* the mapped trace file, NULL when chunks are written from the buffers */
+static unsigned char *map;
+static size_t map_size;
+static uint64_t events_written;
+
+/* events of every branch id in the current chunk, and the ids counted so far */
+static uint64_t *branch_counts;
+static uint32_t *counted_ids;
+static uint32_t num_counted_ids;
+static uint32_t branch_counts_size;
+
+/* the chunk, its branch counts and the index are filled by one thread at a time */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* bytes of every buffer waiting for the writer thread, 0 for buffers that can be filled */
+static uint32_t buffer_sizes[BT_BUFFERS];
+static pthread_t writer;
+static int writer_running;
+static int writer_stopping;
+static pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t buffer_filled = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t buffer_freed = PTHREAD_COND_INITIALIZER;
+
+/* index entries of the chunks written so far */
+static unsigned char *index_data;
+static size_t index_size;
+static size_t index_capacity;
+
+static void out_of_memory(void)
+{
+    fprintf(stderr, "branch tracer: out of memory\n");
+    abort();
+}
+
+static void index_put(const void *data, size_t size)
+{
+    if (index_size + size > index_capacity) {
+        index_capacity = index_capacity ? 2 * index_capacity : 4096;
+        while (index_size + size > index_capacity)
+            index_capacity *= 2;
+        index_data = realloc(index_data, index_capacity);
+        if (!index_data)
+            out_of_memory();
+    }
+    memcpy(index_data + index_size, data, size);
+    index_size += size;
+}
+
+static void write_fd(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            fprintf(stderr, "branch tracer: cannot write the trace: %s\n", strerror(errno));
+            return;
+        }
+        p += written;
+        size -= written;
+    }
+}
+
+static void write_all(const void *data, size_t size)
+{
+    write_fd(trace_fd, data, size);
+}
+
+/**
+ * the writer thread, writes the buffers in the order they were filled until it is stopped
+ */
+static void *write_buffers(void *unused)
+{
+    unsigned next = 0;
+    uint32_t size;
+
+    (void) unused;
+    pthread_mutex_lock(&buffer_lock);
+    for (;;) {
+        while (!(size = buffer_sizes[next]) && !writer_stopping)
+            pthread_cond_wait(&buffer_filled, &buffer_lock);
+        if (!size)
+            break;
+        pthread_mutex_unlock(&buffer_lock);
+        write_all(buffers[next], size);
+        pthread_mutex_lock(&buffer_lock);
+        buffer_sizes[next] = 0;
+        pthread_cond_signal(&buffer_freed);
+        next = (next + 1) % BT_BUFFERS;
+    }
+    pthread_mutex_unlock(&buffer_lock);
+    return NULL;
+}
+
+/**
+ * makes the mapped trace file at least "size" bytes long, the file gets its blocks
+ * now so that a full disk is reported here and not by a SIGBUS in the program
+ */
+static int grow_map(size_t size)
+{
+    void *grown;
+
+    size = (size + BT_MAP_GROWTH - 1) / BT_MAP_GROWTH * BT_MAP_GROWTH;
+    if (posix_fallocate(trace_fd, 0, size) != 0)
+        return 0;
+#ifdef MREMAP_MAYMOVE
+    grown = map ? mremap(map, map_size, size, MREMAP_MAYMOVE) : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, trace_fd, 0);
+#else
+    if (map)
+        munmap(map, map_size);
+    grown = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, trace_fd, 0);
+#endif
+    if (grown == MAP_FAILED) {
+        map = NULL;
+        return 0;
+    }
+    map = grown;
+    map_size = size;
+    return 1;
+}
+
+/**
+ * stops filling the mapping, the file is cut at the end of the chunks handed over and
+ * further chunks go through the buffers
+ */
+static void unmap_trace(void)
+{
+    if (map) {
+        memcpy(buffers[0], chunk, chunk_used);
+        munmap(map, map_size);
+        map = NULL;
+    }
+    chunk = buffers[current_buffer = 0];
+    chunk_header = (struct bt_chunk_header *) chunk;
+    if (ftruncate(trace_fd, trace_end) != 0 || lseek(trace_fd, trace_end, SEEK_SET) < 0)
+        fprintf(stderr, "branch tracer: cannot cut the trace file: %s\n", strerror(errno));
+}
+
+/**
+ * moves on to the next chunk of the mapping, growing it if needed
+ */
+static void next_mapped_chunk(void)
+{
+    if (trace_end + BT_CHUNK_SIZE > map_size && !grow_map(trace_end + BT_CHUNK_SIZE)) {
+        fprintf(stderr, "branch tracer: cannot grow the trace file: %s\n", strerror(errno));
+        unmap_trace();
+        return;
+    }
+    chunk = map + trace_end;
+    chunk_header = (struct bt_chunk_header *) chunk;
+}
+
+/**
+ * hands the current buffer to the writer thread and switches to the next one,
+ * waiting only if the writer has not written that one yet
+ * without a writer thread the buffer is written right away
+ */
+static void submit_buffer(uint32_t size)
+{
+    trace_end += size;
+    if (map) {
+        next_mapped_chunk();
+        return;
+    }
+    if (!writer_running) {
+        write_all(chunk, size);
+        return;
+    }
+    pthread_mutex_lock(&buffer_lock);
+    buffer_sizes[current_buffer] = size;
+    pthread_cond_signal(&buffer_filled);
+    current_buffer = (current_buffer + 1) % BT_BUFFERS;
+    while (buffer_sizes[current_buffer])
+        pthread_cond_wait(&buffer_freed, &buffer_lock);
+    pthread_mutex_unlock(&buffer_lock);
+    chunk = buffers[current_buffer];
+    chunk_header = (struct bt_chunk_header *) chunk;
+}
+
+static void start_chunk(void)
+{
+    memset(chunk_header, 0, sizeof(*chunk_header));
+    chunk_header->first_event = events_written;
+    chunk_used = sizeof(*chunk_header);
+}
+
+/**
+ * adds the index entry of the current chunk and hands it to the writer
+ * parameters:
+ *      last: the program is exiting, write only the used part of the chunk
+ */
+static void write_chunk(int last)
+{
+    uint64_t offset = sizeof(struct bt_file_header) + chunks_written * BT_CHUNK_SIZE;
+    uint32_t i;
+
+    if (chunk_header->records == 0)
+        return;
+    chunk_header->used = chunk_used;
+    if (!last)
+        memset(chunk + chunk_used, 0, BT_CHUNK_SIZE - chunk_used);
+    chunks_written++;
+
+    index_put(&offset, sizeof(offset));
+    index_put(&chunk_header->first_event, sizeof(chunk_header->first_event));
+    index_put(&chunk_header->events, sizeof(chunk_header->events));
+    index_put(&chunk_header->records, sizeof(chunk_header->records));
+    index_put(&num_counted_ids, sizeof(num_counted_ids));
+    for (i = 0; i < num_counted_ids; i++) {
+        index_put(&counted_ids[i], sizeof(counted_ids[i]));
+        index_put(&branch_counts[counted_ids[i]], sizeof(branch_counts[counted_ids[i]]));
+        branch_counts[counted_ids[i]] = 0;
+    }
+    num_counted_ids = 0;
+    submit_buffer(last ? chunk_used : BT_CHUNK_SIZE);
+    start_chunk();
+}
+
+/**
+ * writes the last chunk, waits for the writer thread, then writes the index and
+ * the trailer, registered with atexit
+ */
+static void finish_trace(void)
+{
+    uint32_t num_chunks;
+    uint64_t index_offset;
+
+    pthread_mutex_lock(&trace_lock);
+    write_chunk(1);
+    if (map)
+        unmap_trace();
+    if (writer_running) {
+        pthread_mutex_lock(&buffer_lock);
+        writer_stopping = 1;
+        pthread_cond_signal(&buffer_filled);
+        pthread_mutex_unlock(&buffer_lock);
+        pthread_join(writer, NULL);
+        writer_running = 0;
+    }
+
+    index_offset = trace_end;
+    num_chunks = (uint32_t) chunks_written;
+    write_all(BT_INDEX_MAGIC, 4);
+    write_all(&num_chunks, sizeof(num_chunks));
+    write_all(index_data, index_size);
+    write_all(&index_offset, sizeof(index_offset));
+    write_all(BT_TRAILER_MAGIC, 4);
+    close(trace_fd);
+    trace_fd = -1;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static void start_flight_recorder(const char *capacity);
+static void start_shm(const char *name);
+
+/**
+ * opens the trace file named by BT_TRACE_FILE on the first record, text on stdout without it,
+ * or starts the flight recorder; runs once, through ensure_started
+ */
+static void start_trace(void)
+{
+    const char *path = getenv("BT_TRACE_FILE");
+    const char *flight_recorder = getenv("BT_FLIGHT_RECORDER");
+    const char *shm_name = getenv("BT_SHM");
+    struct bt_file_header header = { BT_TRACE_MAGIC, BT_TRACE_VERSION, BT_CHUNK_SIZE, 0 };
+
+    if (flight_recorder && *flight_recorder) {
+        start_flight_recorder(flight_recorder);
+        if (flight_capacity)
+            return;
+    }
+    if (shm_name && *shm_name) {
+        start_shm(shm_name);
+        if (shm)
+            return;
+    }
+    if (!path || !*path)
+        return;
+    trace_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd < 0)
+        trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);     /* e.g. a pipe */
+    if (trace_fd < 0) {
+        fprintf(stderr, "branch tracer: cannot write %s, tracing to stdout\n", path);
+        return;
+    }
+    trace_end = sizeof(header);
+    if (grow_map(trace_end + BT_CHUNK_SIZE)) {
+        memcpy(map, &header, sizeof(header));
+        chunk = map + trace_end;
+        chunk_header = (struct bt_chunk_header *) chunk;
+    } else {
+        write_all(&header, sizeof(header));
+        writer_running = pthread_create(&writer, NULL, write_buffers, NULL) == 0;
+    }
+    start_chunk();
+    atexit(finish_trace);
+}
+
+static void start_trace_once(void)
+{
+    start_trace();
+    __atomic_store_n(&started, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * starts the trace on the first record of any thread, the others wait until it is set up
+ */
+static inline void ensure_started(void)
+{
+    if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE))
+        pthread_once(&start_once, start_trace_once);
+}
+
+/**
+ * returns where the next record goes, starting a new chunk if it might not fit
+ * the caller holds trace_lock until commit_record
+ */
+static unsigned char *reserve_record(void)
+{
+    if (BT_CHUNK_SIZE - chunk_used < BT_MAX_RECORD_SIZE)
+        write_chunk(0);
+    return chunk + chunk_used;
+}
+
+static unsigned char *put_uleb128(unsigned char *p, uint64_t value)
+{
+    do {
+        unsigned char byte = value & 0x7f;
+        value >>= 7;
+        *p++ = value ? byte | 0x80 : byte;
+    } while (value);
+    return p;
+}
+
+/**
+ * completes the record that ends at "end" and stands for "events" events
+ */
+static void commit_record(unsigned char *end, uint64_t events)
+{
+    chunk_used = (uint32_t) (end - chunk);
+    chunk_header->used = chunk_used;
+    chunk_header->records++;
+    chunk_header->events += events;
+    events_written += events;
+}
+
+/**
+ * adds "events" events of branch "id" to the branch counts of the current chunk
+ */
+static void count_branch(uint32_t id, uint64_t events)
+{
+    if (events == 0)
+        return;
+    if (id >= branch_counts_size) {
+        uint32_t size = branch_counts_size ? branch_counts_size : 256;
+        while (size <= id)
+            size *= 2;
+        branch_counts = realloc(branch_counts, size * sizeof(*branch_counts));
+        counted_ids = realloc(counted_ids, size * sizeof(*counted_ids));
+        if (!branch_counts || !counted_ids)
+            out_of_memory();
+        memset(branch_counts + branch_counts_size, 0, (size - branch_counts_size) * sizeof(*branch_counts));
+        branch_counts_size = size;
+    }
+    if (branch_counts[id] == 0)
+        counted_ids[num_counted_ids++] = id;
+    branch_counts[id] += events;
+}
+
+/* the ring buffer of one thread, its records are (id << 2 | kind, count or address) */
+struct bt_ring {
+    struct bt_ring *next;                       /* list of the rings of all threads */
+    uint32_t thread;
+    uint64_t head;                              /* records written so far */
+    uint64_t records[][2];
+};
+
+static __thread struct bt_ring *thread_ring;
+static struct bt_ring *rings;
+static uint32_t num_rings;
+static uint32_t num_dumps;
+static char flight_path[4096];
+
+/**
+ * returns the ring buffer of the calling thread, creating it on its first record
+ */
+static struct bt_ring *flight_ring(void)
+{
+    struct bt_ring *ring = thread_ring;
+
+    if (ring)
+        return ring;
+    ring = calloc(1, sizeof(*ring) + flight_capacity * sizeof(ring->records[0]));
+    if (!ring)
+        out_of_memory();
+    ring->thread = __atomic_fetch_add(&num_rings, 1, __ATOMIC_RELAXED);
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    thread_ring = ring;
+    return ring;
+}
+
+static void flight_record(uint64_t tag, uint64_t operand)
+{
+    struct bt_ring *ring = flight_ring();
+    uint64_t *record = ring->records[ring->head % flight_capacity];
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);    /* the last head before the slot is rewritten, for __bt_dump */
+    record[0] = tag;
+    record[1] = operand;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/* text output for __bt_dump, which may run in a signal handler and cannot use stdio */
+struct bt_text {
+    int fd;
+    size_t size;
+    char data[4096];
+};
+
+static void text_flush(struct bt_text *text)
+{
+    write_fd(text->fd, text->data, text->size);
+    text->size = 0;
+}
+
+static void text_put(struct bt_text *text, const char *s)
+{
+    while (*s) {
+        if (text->size == sizeof(text->data))
+            text_flush(text);
+        text->data[text->size++] = *s++;
+    }
+}
+
+/**
+ * writes "value" in "base" so that its terminating 0 is the last byte before "end"
+ * returns its first digit
+ */
+static char *format_number(char *end, uint64_t value, unsigned base)
+{
+    *--end = 0;
+    do {
+        *--end = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value);
+    return end;
+}
+
+static void text_put_number(struct bt_text *text, uint64_t value, unsigned base)
+{
+    char digits[24];
+
+    text_put(text, format_number(digits + sizeof(digits), value, base));
+}
+
+/**
+ * writes a record the way the text trace prints it
+ */
+static void text_put_record(struct bt_text *text, uint64_t tag, uint64_t operand)
+{
+    if ((tag & 3) == BT_RECORD_CALL) {
+        text_put(text, "*func_");
+        if (operand) {
+            text_put(text, "0x");
+            text_put_number(text, operand, 16);
+        } else {
+            text_put(text, "(nil)");
+        }
+    } else {
+        text_put(text, "br_");
+        text_put_number(text, tag >> 2, 10);
+        if ((tag & 3) == BT_RECORD_LOOP) {
+            text_put(text, " x");
+            text_put_number(text, operand, 10);
+        }
+    }
+    text_put(text, "\n");
+}
+
+/**
+ * writes the records in the ring buffers of all threads to the next dump file,
+ * oldest first, every thread under a "# thread <n>: ..." line
+ * records a thread overwrites while they are copied are left out
+ */
+void __bt_dump(void)
+{
+    struct bt_text text;
+    struct bt_ring *ring;
+    char path[sizeof(flight_path) + 24];
+    char digits[24];
+
+    if (!flight_capacity)
+        return;
+    strcpy(path, flight_path);
+    strcat(path, ".");
+    strcat(path, format_number(digits + sizeof(digits), __atomic_fetch_add(&num_dumps, 1, __ATOMIC_RELAXED), 10));
+    text.size = 0;
+    text.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (text.fd < 0)
+        return;
+
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t first = head > flight_capacity ? head - flight_capacity : 0;
+        uint64_t i;
+
+        text_put(&text, "# thread ");
+        text_put_number(&text, ring->thread, 10);
+        text_put(&text, ": last ");
+        text_put_number(&text, head - first, 10);
+        text_put(&text, " of ");
+        text_put_number(&text, head, 10);
+        text_put(&text, " records\n");
+        for (i = first; i < head; i++) {
+            uint64_t tag = ring->records[i % flight_capacity][0];
+            uint64_t operand = ring->records[i % flight_capacity][1];
+            uint64_t now;
+
+            /* the copy must be read before head, and head already counts a slot being rewritten */
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            now = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+            if (now - i >= flight_capacity)    /* overwritten by the thread meanwhile */
+                continue;
+            text_put_record(&text, tag, operand);
+        }
+    }
+    text_flush(&text);
+    close(text.fd);
+}
+
+static void dump_on_signal(int signal_number)
+{
+    int saved_errno = errno;
+
+    (void) signal_number;
+    __bt_dump();
+    errno = saved_errno;
+}
+
+/**
+ * sets up the flight recorder, the dump signal handler is only installed if the
+ * program has none for that signal
+ */
+static void start_flight_recorder(const char *capacity)
+{
+    const char *path = getenv("BT_TRACE_FILE");
+    const char *signal_name = getenv("BT_FLIGHT_SIGNAL");
+    int signal_number = signal_name ? atoi(signal_name) : SIGUSR2;
+    struct sigaction action, previous;
+
+    flight_capacity = strtoull(capacity, NULL, 10);
+    if (!flight_capacity)
+        return;
+    if (path && *path)
+        snprintf(flight_path, sizeof(flight_path), "%s", path);
+    else
+        snprintf(flight_path, sizeof(flight_path), "flight_recorder.%d", (int) getpid());
+
+    if (signal_number > 0 && sigaction(signal_number, NULL, &previous) == 0 && previous.sa_handler == SIG_DFL) {
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = dump_on_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(signal_number, &action, NULL);
+    }
+    atexit(__bt_dump);
+}
+
+/* the branch counters of the modules with cold functions */
+struct bt_counters {
+    struct bt_counters *next;
+    uint64_t *counts;
+    uint32_t size;
+};
+
+static struct bt_counters *registered_counters;
+
+/**
+ * writes the branch counters of every module, registered with atexit
+ */
+static void write_counters(void)
+{
+    const char *path = getenv("BT_COUNTS_FILE");
+    char default_path[64];
+    struct bt_counters *module;
+    unsigned number = 0;
+    FILE *file;
+    uint32_t i;
+
+    if (!path || !*path) {
+        snprintf(default_path, sizeof(default_path), "branch_counts.%d", (int) getpid());
+        path = default_path;
+    }
+    file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "branch tracer: cannot write %s\n", path);
+        return;
+    }
+    for (module = registered_counters; module; module = module->next) {
+        fprintf(file, "# module %u: %u branch ids\n", number++, module->size);
+        for (i = 0; i < module->size; i++)
+            if (module->counts[i])
+                fprintf(file, "br_%u x%llu\n", i, (unsigned long long) module->counts[i]);
+    }
+    fclose(file);
+}
+
+/**
+ * called by a constructor of every module with cold functions
+ * parameters:
+ *      counts: the module's counter of every branch id
+ *      size: number of branch ids of the module
+ */
+void __bt_register_counters(uint64_t *counts, uint32_t size)
+{
+    struct bt_counters *module = malloc(sizeof(*module));
+
+    if (!module)
+        out_of_memory();
+    module->counts = counts;
+    module->size = size;
+    module->next = registered_counters;
+    if (!registered_counters)
+        atexit(write_counters);
+    registered_counters = module;
+}
+
+void __bt_start(void)
+{
+    __bt_enabled = 1;
+}
+
+void __bt_stop(void)
+{
+    __bt_enabled = 0;
+}
+
+static void toggle_on_signal(int signal_number)
+{
+    (void) signal_number;
+    __bt_enabled = !__bt_enabled;
+}
+
+/**
+ * reads BT_TRACING and installs the handler of the toggle signal, if the program has none
+ * for it, before main runs
+ */
+__attribute__((constructor)) static void start_toggle(void)
+{
+    const char *tracing = getenv("BT_TRACING");
+    const char *signal_name = getenv("BT_TOGGLE_SIGNAL");
+    int signal_number = signal_name ? atoi(signal_name) : SIGUSR1;
+    struct sigaction action, previous;
+
+    if (tracing && strcmp(tracing, "off") == 0)
+        __bt_enabled = 0;
+    if (signal_number > 0 && sigaction(signal_number, NULL, &previous) == 0 && previous.sa_handler == SIG_DFL) {
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = toggle_on_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(signal_number, &action, NULL);
+    }
+}
+
+static int shm_block;
+static __thread struct bt_shm_ring *shm_ring;
+static __thread uint64_t shm_tail;              /* tail of the thread's ring when last read */
+
+/**
+ * returns the ring of the calling thread, taking the next free ring on its first record
+ * returns NULL if all rings are taken
+ */
+static struct bt_shm_ring *shm_thread_ring(void)
+{
+    struct bt_shm_ring *rings = (struct bt_shm_ring *) (shm + 1);
+    uint32_t ring;
+
+    if (shm_ring)
+        return shm_ring;
+    ring = __atomic_fetch_add(&shm->num_rings, 1, __ATOMIC_ACQ_REL);
+    if (ring >= BT_SHM_THREADS) {
+        if (ring == BT_SHM_THREADS)
+            fprintf(stderr, "branch tracer: more than %d threads, the others are not traced\n", BT_SHM_THREADS);
+        return NULL;
+    }
+    shm_ring = &rings[ring];
+    shm_tail = __atomic_load_n(&shm_ring->tail, __ATOMIC_ACQUIRE);
+    return shm_ring;
+}
+
+static void shm_record(uint64_t tag, uint64_t operand)
+{
+    struct bt_shm_ring *ring = shm_thread_ring();
+    struct bt_shm_record *record;
+    uint64_t head;
+
+    if (!ring)
+        return;
+    head = ring->head;
+    if (head - shm_tail >= BT_SHM_RECORDS) {            /* full as far as we knew, ask the consumer */
+        shm_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        while (head - shm_tail >= BT_SHM_RECORDS) {
+            if (!shm_block) {
+                __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+                return;
+            }
+            sched_yield();
+            shm_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        }
+    }
+    record = &ring->records[head & (BT_SHM_RECORDS - 1)];
+    record->tag = tag;
+    record->operand = operand;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* only the producer finishes the object, not a forked child or a program sharing it */
+static void finish_shm(void)
+{
+    if (__atomic_load_n(&shm->producer, __ATOMIC_RELAXED) == (uint32_t) getpid())
+        __atomic_store_n(&shm->finished, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * whether the producer of a shared memory object finished or died, so its rings are
+ * left over and may be reset
+ */
+static int shm_producer_gone(struct bt_shm_header *header, pid_t producer)
+{
+    return __atomic_load_n(&header->finished, __ATOMIC_ACQUIRE) || (kill(producer, 0) != 0 && errno == ESRCH);
+}
+
+/**
+ * maps the shared memory object "name", creating it if the consumer has not; an object
+ * left by a program that finished or died is reset in place, so a consumer that has it
+ * mapped still sees the records; a program started while another traces to the object
+ * shares its rings
+ */
+static void start_shm(const char *name)
+{
+    size_t size = sizeof(struct bt_shm_header) + BT_SHM_THREADS * sizeof(struct bt_shm_ring);
+    const char *block = getenv("BT_SHM_BLOCK");
+    struct bt_shm_header *header;
+    struct stat status;
+    uint32_t producer;
+    int fd;
+
+    shm_block = block && strcmp(block, "1") == 0;
+    for (;;) {
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+            break;
+        fd = shm_open(name, O_RDWR, 0600);
+        if (fd >= 0 || errno != ENOENT)
+            break;
+    }
+    if (fd < 0 || fstat(fd, &status) != 0 || ((size_t) status.st_size < size && ftruncate(fd, size) != 0)) {
+        fprintf(stderr, "branch tracer: cannot open shared memory %s: %s\n", name, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        fprintf(stderr, "branch tracer: cannot map shared memory %s: %s\n", name, strerror(errno));
+        return;
+    }
+
+    if (memcmp(header->magic, BT_SHM_MAGIC, 4) != 0) {  /* new, nobody else writes it yet */
+        header->version = BT_SHM_VERSION;
+        header->threads = BT_SHM_THREADS;
+        header->records = BT_SHM_RECORDS;
+        __atomic_store_n((uint32_t *) header->magic, *(const uint32_t *) BT_SHM_MAGIC, __ATOMIC_RELEASE);
+    } else if (header->version != BT_SHM_VERSION || header->threads != BT_SHM_THREADS || header->records != BT_SHM_RECORDS) {
+        fprintf(stderr, "branch tracer: shared memory %s has another layout (version %u)\n", name, header->version);
+        munmap(header, size);
+        return;
+    }
+
+    producer = __atomic_load_n(&header->producer, __ATOMIC_ACQUIRE);
+    while (producer == 0 || shm_producer_gone(header, producer)) {
+        if (__atomic_compare_exchange_n(&header->producer, &producer, (uint32_t) getpid(), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            if (producer != 0) {                        /* left by an earlier program */
+                struct bt_shm_ring *rings = (struct bt_shm_ring *) (header + 1);
+                uint32_t i, used = header->num_rings < BT_SHM_THREADS ? header->num_rings : BT_SHM_THREADS;
+
+                for (i = 0; i < used; i++) {
+                    rings[i].head = 0;
+                    rings[i].dropped = 0;
+                    rings[i].tail = 0;
+                }
+                __atomic_store_n(&header->num_rings, 0, __ATOMIC_RELAXED);
+                __atomic_store_n(&header->finished, 0, __ATOMIC_RELEASE);
+            }
+            break;
+        }
+    }
+    shm = header;
+    atexit(finish_shm);
+}
+
+/**
+ * a traced function, described by the instrumentation for the calling-context tree:
+ * its branch ids are first_id .. first_id + num_ids - 1, and the instructions run on
+ * entry and after each of its branch edges (up to the next branch) are estimated
+ */
+struct bt_function {
+    const char *name;
+    uint32_t first_id;
+    uint32_t num_ids;
+    uint32_t entry_cost;
+    const uint32_t *edge_costs;                 /* num_ids, per event of a branch id */
+};
+
+struct bt_cct_edge;
+
+/* a calling context, the function called from its parent's context */
+struct bt_cct_node {
+    const struct bt_function *function;         /* NULL for the root of a thread */
+    struct bt_cct_node *parent;
+    struct bt_cct_edge *callees;                /* most recently added or used first */
+    uint64_t calls;
+    uint64_t cost;                              /* instructions of the function itself */
+    uint64_t total;                             /* with the nodes below, and its number, when written */
+    uint64_t number;
+    uint64_t counts[];                          /* events of every branch id of the function */
+};
+
+/* a call from a context, to a child or, for recursion, back to an ancestor */
+struct bt_cct_edge {
+    struct bt_cct_edge *next;
+    struct bt_cct_node *node;
+    uint64_t calls;
+};
+
+/* the tree of one thread and the contexts of its active calls */
+struct bt_cct {
+    struct bt_cct *next;                        /* list of the trees of all threads */
+    uint32_t thread;
+    uint64_t nodes;
+    struct bt_cct_node *root;
+    struct bt_cct_node *current;
+    struct bt_cct_node **stack;                 /* contexts to return to */
+    size_t depth;
+    size_t capacity;
+};
+
+static int cct_started;
+static int cct_trace;                           /* also record the trace */
+static __thread struct bt_cct *thread_cct;
+static struct bt_cct *ccts;
+static uint32_t num_ccts;
+
+static struct bt_cct_node *cct_node(const struct bt_function *function, struct bt_cct_node *parent)
+{
+    struct bt_cct_node *node = calloc(1, sizeof(*node) + (function ? function->num_ids : 0) * sizeof(node->counts[0]));
+
+    if (!node)
+        out_of_memory();
+    node->function = function;
+    node->parent = parent;
+    return node;
+}
+
+static void write_ccts(void);
+
+/**
+ * returns the tree of the calling thread, creating it on its first call
+ */
+static struct bt_cct *cct_thread(void)
+{
+    struct bt_cct *tree = thread_cct;
+    const char *trace;
+
+    if (tree)
+        return tree;
+    if (!__atomic_exchange_n(&cct_started, 1, __ATOMIC_ACQ_REL)) {
+        trace = getenv("BT_CCT_TRACE");
+        cct_trace = trace && strcmp(trace, "1") == 0;
+        atexit(write_ccts);
+    }
+    tree = calloc(1, sizeof(*tree));
+    if (!tree)
+        out_of_memory();
+    tree->root = tree->current = cct_node(NULL, NULL);
+    tree->nodes = 1;
+    tree->thread = __atomic_fetch_add(&num_ccts, 1, __ATOMIC_RELAXED);
+    tree->next = __atomic_load_n(&ccts, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&ccts, &tree->next, tree, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    thread_cct = tree;
+    return tree;
+}
+
+/**
+ * called on entry of every traced function of a program instrumented with -calling-context
+ * the call goes to the context's child for the function, or to the closest ancestor of
+ * the same function if it is recursive, which is created on the first such call
+ */
+void __bt_enter(const struct bt_function *function)
+{
+    struct bt_cct *tree = cct_thread();
+    struct bt_cct_node *current = tree->current, *node;
+    struct bt_cct_edge **link, *edge;
+
+    for (link = &current->callees; (edge = *link); link = &edge->next)
+        if (edge->node->function == function)
+            break;
+    if (edge) {
+        *link = edge->next;                     /* move to the front, calls tend to repeat */
+    } else {
+        for (node = current; node->function && node->function != function; node = node->parent)
+            ;
+        if (!node->function) {
+            node = cct_node(function, current);
+            tree->nodes++;
+        }
+        edge = calloc(1, sizeof(*edge));
+        if (!edge)
+            out_of_memory();
+        edge->node = node;
+    }
+    edge->next = current->callees;
+    current->callees = edge;
+
+    if (tree->depth == tree->capacity) {
+        tree->capacity = tree->capacity ? 2 * tree->capacity : 256;
+        tree->stack = realloc(tree->stack, tree->capacity * sizeof(tree->stack[0]));
+        if (!tree->stack)
+            out_of_memory();
+    }
+    tree->stack[tree->depth++] = current;
+    tree->current = edge->node;
+    if (__bt_enabled) {
+        edge->calls++;
+        edge->node->calls++;
+        edge->node->cost += function->entry_cost;
+    }
+}
+
+/**
+ * called before every return of a traced function of a program instrumented with -calling-context
+ */
+void __bt_exit(void)
+{
+    struct bt_cct *tree = thread_cct;
+
+    if (tree && tree->depth)
+        tree->current = tree->stack[--tree->depth];
+}
+
+/**
+ * counts "events" events of branch edge "id" in the context of the calling thread
+ */
+static void cct_count(uint32_t id, uint64_t events)
+{
+    struct bt_cct *tree = thread_cct;
+    struct bt_cct_node *node;
+    uint32_t i;
+
+    if (!tree || !(node = tree->current)->function)
+        return;
+    i = id - node->function->first_id;
+    if (i < node->function->num_ids) {
+        node->counts[i] += events;
+        node->cost += events * node->function->edge_costs[i];
+    }
+}
+
+/**
+ * numbers a node and the nodes below it in preorder, from *number, and adds up their instructions
+ */
+static uint64_t number_cct_node(struct bt_cct_node *node, uint64_t *number)
+{
+    struct bt_cct_edge *edge;
+
+    node->number = (*number)++;
+    node->total = node->cost;
+    for (edge = node->callees; edge; edge = edge->next)
+        if (edge->node->parent == node)
+            node->total += number_cct_node(edge->node, number);
+    return node->total;
+}
+
+/**
+ * writes the nodes below a node
+ * node: "n<node> n<parent> <function> calls <n> self <instructions> total <instructions> br_<id> x<n> ..."
+ * recursive call back to an ancestor: "n<node> -> n<ancestor> <function> calls <n>"
+ */
+static void write_cct_node(FILE *file, struct bt_cct_node *node)
+{
+    struct bt_cct_edge *edge;
+    struct bt_cct_node *callee;
+    uint32_t i;
+
+    for (edge = node->callees; edge; edge = edge->next) {
+        callee = edge->node;
+        if (callee->parent != node) {
+            fprintf(file, "n%llu -> n%llu %s calls %llu\n", (unsigned long long) node->number,
+                    (unsigned long long) callee->number, callee->function->name, (unsigned long long) edge->calls);
+            continue;
+        }
+        fprintf(file, "n%llu n%llu %s calls %llu self %llu total %llu", (unsigned long long) callee->number,
+                (unsigned long long) node->number, callee->function->name, (unsigned long long) callee->calls,
+                (unsigned long long) callee->cost, (unsigned long long) callee->total);
+        for (i = 0; i < callee->function->num_ids; i++)
+            if (callee->counts[i])
+                fprintf(file, " br_%u x%llu", callee->function->first_id + i, (unsigned long long) callee->counts[i]);
+        fprintf(file, "\n");
+        write_cct_node(file, callee);
+    }
+}
+
+/**
+ * writes the tree of every thread, registered with atexit
+ */
+static void write_ccts(void)
+{
+    const char *path = getenv("BT_CCT_FILE");
+    char default_path[64];
+    struct bt_cct *tree;
+    uint64_t number;
+    FILE *file;
+
+    if (!path || !*path) {
+        snprintf(default_path, sizeof(default_path), "calling_context.%d", (int) getpid());
+        path = default_path;
+    }
+    file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "branch tracer: cannot write %s\n", path);
+        return;
+    }
+    for (tree = __atomic_load_n(&ccts, __ATOMIC_ACQUIRE); tree; tree = tree->next) {
+        number = 0;
+        number_cct_node(tree->root, &number);
+        fprintf(file, "# thread %u: %llu contexts, %llu instructions\n", tree->thread,
+                (unsigned long long) (tree->nodes - 1), (unsigned long long) tree->root->total);
+        write_cct_node(file, tree->root);
+    }
+    fclose(file);
+}
+
+/**
+ * records that branch edge "id" was taken
+ * trace line: "br_<id>"
+ */
+void __bt_record(uint32_t id)
+{
+    unsigned char *p;
+
+    if (!__bt_enabled)
+        return;
+    if (cct_started) {
+        cct_count(id, 1);
+        if (!cct_trace)
+            return;
+    }
+    ensure_started();
+    if (flight_capacity) {
+        flight_record((uint64_t) id << 2 | BT_RECORD_BRANCH, 0);
+        return;
+    }
+    if (shm) {
+        shm_record((uint64_t) id << 2 | BT_RECORD_BRANCH, 0);
+        return;
+    }
+    if (trace_fd < 0) {
+        printf("br_%u\n", id);
+        return;
+    }
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd >= 0) {                        /* not finished by exit meanwhile */
+        p = put_uleb128(reserve_record(), (uint64_t) id << 2 | BT_RECORD_BRANCH);
+        commit_record(p, 1);
+        count_branch(id, 1);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/**
+ * records that branch edge "id" was taken "count" times in a row (-coalesce-loops)
+ * trace line: "br_<id> x<count>"
+ */
+void __bt_record_loop(uint32_t id, uint64_t count)
+{
+    unsigned char *p;
+
+    if (!__bt_enabled)
+        return;
+    if (cct_started) {
+        cct_count(id, count);
+        if (!cct_trace)
+            return;
+    }
+    ensure_started();
+    if (flight_capacity) {
+        flight_record((uint64_t) id << 2 | BT_RECORD_LOOP, count);
+        return;
+    }
+    if (shm) {
+        shm_record((uint64_t) id << 2 | BT_RECORD_LOOP, count);
+        return;
+    }
+    if (trace_fd < 0) {
+        printf("br_%u x%llu\n", id, (unsigned long long) count);
+        return;
+    }
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd >= 0) {
+        p = put_uleb128(reserve_record(), (uint64_t) id << 2 | BT_RECORD_LOOP);
+        p = put_uleb128(p, count);
+        commit_record(p, count);
+        count_branch(id, count);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/**
+ * records an indirect call of the function pointer "function"
+ * trace line: "*func_<address>"
+ */
+void __bt_record_call(void *function)
+{
+    unsigned char *p;
+
+    if (!__bt_enabled || (cct_started && !cct_trace))
+        return;
+    ensure_started();
+    if (flight_capacity) {
+        flight_record(BT_RECORD_CALL, (uint64_t) (uintptr_t) function);
+        return;
+    }
+    if (shm) {
+        shm_record(BT_RECORD_CALL, (uint64_t) (uintptr_t) function);
+        return;
+    }
+    if (trace_fd < 0) {
+        printf("*func_%p\n", function);
+        return;
+    }
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd >= 0) {
+        p = put_uleb128(reserve_record(), BT_RECORD_CALL);
+        p = put_uleb128(p, (uint64_t) (uintptr_t) function);
+        commit_record(p, 1);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
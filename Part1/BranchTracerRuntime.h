@@ -0,0 +1,39 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef BRANCH_TRACER_RUNTIME_H
+#define BRANCH_TRACER_RUNTIME_H
+
+/**
+ * functions of the branch-pointer tracer runtime (BranchTracerRuntime.c) that a traced
+ * program may call itself; they are declared weak, so a program that is also built
+ * without the tracer calls them as "if (__bt_dump) __bt_dump();"
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * writes the records kept by the flight recorder (BT_FLIGHT_RECORDER) to the next dump file,
+ * safe to call from a signal handler
+ */
+void __bt_dump(void) __attribute__((weak));
+
+/**
+ * switches tracing on and off, e.g. around a region of interest
+ */
+void __bt_start(void) __attribute__((weak));
+void __bt_stop(void) __attribute__((weak));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BRANCH_TRACER_RUNTIME_H */
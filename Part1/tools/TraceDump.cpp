@@ -0,0 +1,81 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// TraceDump.cpp
+
+// Prints a branch-pointer trace as the text the runtime prints without
+// BT_TRACE_FILE, so chunked traces can go through decode_trace.sh:
+//
+//   trace_dump out.trace | ./decode_trace.sh -d output/driver.c_BranchDictionary.txt
+//
+//   -first=<n> -count=<m>   only events n .. n + m - 1, one line per event; the chunk
+//                           holding event n is found from the index, nothing before it is read
+//   -chunks                 the chunk index instead of the events
+
+#include "TraceFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> TracePath(cl::Positional,
+    cl::desc("<trace>"), cl::Required);
+
+static cl::opt<uint64_t> FirstEvent("first",
+    cl::desc("Number of the first event to print"),
+    cl::value_desc("n"), cl::init(0));
+
+static cl::opt<uint64_t> EventCount("count",
+    cl::desc("Number of events to print (all without it)"),
+    cl::value_desc("m"), cl::init(0));
+
+static cl::opt<bool> ShowChunks("chunks",
+    cl::desc("Print the chunk index instead of the events"),
+    cl::init(false));
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "branch-pointer trace printer\n");
+    std::unique_ptr<TraceFile> Trace = TraceFile::open(TracePath);
+    if (!Trace) {
+        errs() << "Error: Could not read trace " << TracePath << "\n";
+        return 1;
+    }
+
+    raw_ostream &OS = outs();
+    const std::vector<TraceChunk> &Chunks = Trace->chunks();
+    if (ShowChunks) {
+        OS << (Trace->isChunked() ? "chunked" : "text") << " trace, "
+           << (Trace->isChunked() && !Trace->hasIndex() ? "no index, " : "")
+           << Trace->numEvents() << " events in " << Trace->numRecords() << " records\n";
+        OS << "chunk offset first_event events records branches\n";
+        for (size_t i = 0; i < Chunks.size(); i++) {
+            const TraceChunk &Chunk = Chunks[i];
+            OS << i << " " << Chunk.Offset << " " << Chunk.FirstEvent << " " << Chunk.Events << " "
+               << Chunk.Records << " " << Chunk.BranchCounts.size() << "\n";
+        }
+        return 0;
+    }
+
+    // one line per event of the range
+    if (FirstEvent > 0 || EventCount > 0) {
+        uint64_t Count = EventCount > 0 ? EventCount.getValue() : Trace->numEvents();
+        for (auto &Entry : Trace->events(FirstEvent, Count)) {
+            OS << TraceFile::format(Entry.second) << "\n";
+        }
+        return 0;
+    }
+
+    // the records as they are, coalesced loops stay "br_<id> x<count>"
+    for (size_t i = 0; i < Chunks.size(); i++) {
+        Trace->decodeChunk(i, [&](uint64_t, const TraceEvent &Event) {
+            OS << TraceFile::format(Event) << "\n";
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,464 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "TraceFile.h"
+#include "BranchTraceFormat.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/LEB128.h"
+#include <algorithm>
+
+using namespace llvm;
+
+// Split the buffer into lines without copying, calling F(Offset, Line) for each
+template <typename CallbackT>
+static void forEachLine(StringRef Data, CallbackT F) {
+    size_t Offset = 0;
+    while (Offset < Data.size()) {
+        size_t End = Data.find('\n', Offset);
+        if (End == StringRef::npos) {
+            End = Data.size();
+        }
+        F(Offset, Data.slice(Offset, End).rtrim('\r'));
+        Offset = End + 1;
+    }
+}
+
+std::unique_ptr<BranchDictionary> BranchDictionary::open(StringRef Path) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                                                       /*RequiresNullTerminator=*/false);
+    if (!File) {
+        return nullptr;
+    }
+    std::unique_ptr<BranchDictionary> Dictionary(new BranchDictionary());
+    Dictionary->Buffer = std::move(*File);
+    return Dictionary;
+}
+
+void BranchDictionary::buildIndex() {
+    if (Indexed) {
+        return;
+    }
+    Indexed = true;
+    forEachLine(Buffer->getBuffer(), [&](size_t, StringRef Line) {
+        uint64_t EntryID;
+        StringRef Key, Text;
+        std::tie(Key, Text) = Line.split(": ");
+        if (Key.consume_front("fn_") && !Key.getAsInteger(10, EntryID)) {
+            StringRef Name, Count;
+            std::tie(Name, Count) = Text.rsplit(", ");
+            FunctionIds Function = {EntryID, 0, Name};
+            if (!Count.getAsInteger(10, Function.Count)) {
+                Functions.push_back(Function);
+            }
+            return;
+        }
+        if (!Key.consume_front("br_") || Key.getAsInteger(10, EntryID)) {
+            return;
+        }
+        if (EntryID >= Entries.size()) {
+            Entries.resize(EntryID + 1);
+        }
+        Entries[EntryID] = Text;
+    });
+    llvm::sort(Functions, [](const FunctionIds &A, const FunctionIds &B) { return A.First < B.First; });
+}
+
+StringRef BranchDictionary::text(uint64_t ID) {
+    buildIndex();
+    return ID < Entries.size() ? Entries[ID] : StringRef();
+}
+
+StringRef BranchDictionary::function(uint64_t ID) {
+    buildIndex();
+    auto Next = std::upper_bound(Functions.begin(), Functions.end(), ID,
+        [](uint64_t Number, const FunctionIds &Function) { return Number < Function.First; });
+    if (Next == Functions.begin() || ID >= std::prev(Next)->First + std::prev(Next)->Count) {
+        return StringRef();
+    }
+    return std::prev(Next)->Name;
+}
+
+std::unique_ptr<TraceFile> TraceFile::open(StringRef Path) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                                                       /*RequiresNullTerminator=*/false);
+    if (!File) {
+        return nullptr;
+    }
+    std::unique_ptr<TraceFile> Trace(new TraceFile());
+    Trace->Buffer = std::move(*File);
+
+    // a chunked trace starts with its header, anything else is read as text
+    StringRef Data = Trace->Buffer->getBuffer();
+    if (Data.startswith(BT_TRACE_MAGIC)) {
+        if (Data.size() < sizeof(bt_file_header) ||
+            support::endian::read32le(Data.data() + 4) != BT_TRACE_VERSION ||
+            support::endian::read32le(Data.data() + 8) != BT_CHUNK_SIZE) {
+            return nullptr;
+        }
+        Trace->Chunked = true;
+    }
+    return Trace;
+}
+
+// "br_<id>", "br_<id> x<count>" or "*func_<address>"
+bool TraceFile::parseLine(StringRef Line, TraceEvent &Event) {
+    if (Line.consume_front("br_")) {
+        StringRef ID, Count;
+        std::tie(ID, Count) = Line.split(' ');
+        Event.Kind = TraceEvent::Branch;
+        Event.Repeat = 1;
+        if (ID.getAsInteger(10, Event.Value)) {
+            return false;
+        }
+        return Count.empty() || (Count.consume_front("x") && !Count.getAsInteger(10, Event.Repeat));
+    }
+    if (Line.consume_front("*func_")) {
+        Event.Kind = TraceEvent::Call;
+        Event.Repeat = 1;
+        if (Line == "(nil)") {
+            Event.Value = 0;
+            return true;
+        }
+        return !Line.getAsInteger(0, Event.Value);
+    }
+    return false;
+}
+
+std::string TraceFile::format(const TraceEvent &Event) {
+    if (Event.Kind == TraceEvent::Call) {
+        return "*func_0x" + utohexstr(Event.Value, /*LowerCase=*/true);
+    }
+    if (Event.Repeat != 1) {
+        return "br_" + utostr(Event.Value) + " x" + utostr(Event.Repeat);
+    }
+    return "br_" + utostr(Event.Value);
+}
+
+void TraceFile::buildIndex() {
+    if (Indexed) {
+        return;
+    }
+    Indexed = true;
+    if (!Chunked) {
+        scanText();
+    } else if (!(IndexFound = readChunkIndex())) {
+        scanChunks();
+    }
+    for (const TraceChunk &Chunk : Chunks) {
+        Events += Chunk.Events;
+        Records += Chunk.Records;
+    }
+}
+
+// The index at the end of a chunked trace, false if there is none or it does not fit the file
+bool TraceFile::readChunkIndex() {
+    StringRef Data = Buffer->getBuffer();
+    if (Data.size() < sizeof(bt_file_header) + 12 || !Data.endswith(BT_TRAILER_MAGIC)) {
+        return false;
+    }
+    uint64_t IndexOffset = support::endian::read64le(Data.end() - 12);
+    if (IndexOffset + 8 > Data.size() - 12 || Data.substr(IndexOffset, 4) != BT_INDEX_MAGIC) {
+        return false;
+    }
+
+    const char *P = Data.data() + IndexOffset + 4;
+    const char *End = Data.end() - 12;
+    uint32_t NumChunks = support::endian::read32le(P);
+    P += 4;
+    std::vector<TraceChunk> Index;
+    for (uint32_t i = 0; i < NumChunks; i++) {
+        if (End - P < 32) {
+            return false;
+        }
+        TraceChunk Chunk;
+        uint64_t ChunkOffset = support::endian::read64le(P);
+        Chunk.FirstEvent = support::endian::read64le(P + 8);
+        Chunk.Events = support::endian::read64le(P + 16);
+        Chunk.Records = support::endian::read32le(P + 24);
+        uint32_t NumCounts = support::endian::read32le(P + 28);
+        P += 32;
+        if (ChunkOffset + sizeof(bt_chunk_header) > IndexOffset || (uint64_t)(End - P) < NumCounts * 12ull) {
+            return false;
+        }
+        uint32_t Used = support::endian::read32le(Data.data() + ChunkOffset);
+        if (Used < sizeof(bt_chunk_header) || ChunkOffset + Used > IndexOffset) {
+            return false;
+        }
+        Chunk.Offset = ChunkOffset + sizeof(bt_chunk_header);
+        Chunk.Size = Used - sizeof(bt_chunk_header);
+        for (uint32_t j = 0; j < NumCounts; j++, P += 12) {
+            Chunk.BranchCounts.emplace_back(support::endian::read32le(P), support::endian::read64le(P + 4));
+        }
+        llvm::sort(Chunk.BranchCounts);
+        Index.push_back(std::move(Chunk));
+    }
+    Chunks = std::move(Index);
+    return true;
+}
+
+// Without an index (the program did not exit normally) the chunks are at fixed offsets,
+// their branch counts come from decoding them
+void TraceFile::scanChunks() {
+    StringRef Data = Buffer->getBuffer();
+    for (uint64_t Offset = sizeof(bt_file_header); Offset + sizeof(bt_chunk_header) <= Data.size(); Offset += BT_CHUNK_SIZE) {
+        const char *Header = Data.data() + Offset;
+        uint32_t Used = support::endian::read32le(Header);
+        if (Used < sizeof(bt_chunk_header) || Used > BT_CHUNK_SIZE || Offset + Used > Data.size()) {
+            break;
+        }
+        TraceChunk Chunk;
+        Chunk.Offset = Offset + sizeof(bt_chunk_header);
+        Chunk.Size = Used - sizeof(bt_chunk_header);
+        Chunk.Records = support::endian::read32le(Header + 4);
+        Chunk.FirstEvent = support::endian::read64le(Header + 8);
+        Chunk.Events = support::endian::read64le(Header + 16);
+        Chunks.push_back(std::move(Chunk));
+
+        DenseMap<uint64_t, uint64_t> Counts;
+        decodeChunk(Chunks.size() - 1, [&](uint64_t, const TraceEvent &Event) {
+            if (Event.Kind == TraceEvent::Branch) {
+                Counts[Event.Value] += Event.Repeat;
+            }
+        });
+        Chunks.back().BranchCounts.assign(Counts.begin(), Counts.end());
+        llvm::sort(Chunks.back().BranchCounts);
+    }
+}
+
+// A text trace is cut into chunks of about BT_CHUNK_SIZE bytes of whole lines
+void TraceFile::scanText() {
+    TraceChunk Chunk;
+    DenseMap<uint64_t, uint64_t> Counts;
+    auto finishChunk = [&](uint64_t End) {
+        Chunk.Size = End - Chunk.Offset;
+        Chunk.BranchCounts.assign(Counts.begin(), Counts.end());
+        llvm::sort(Chunk.BranchCounts);
+        uint64_t NextEvent = Chunk.FirstEvent + Chunk.Events;
+        Chunks.push_back(std::move(Chunk));
+        Chunk = TraceChunk();
+        Chunk.Offset = End;
+        Chunk.FirstEvent = NextEvent;
+        Counts.clear();
+    };
+
+    StringRef Data = Buffer->getBuffer();
+    forEachLine(Data, [&](size_t Offset, StringRef Line) {
+        if (Offset - Chunk.Offset >= BT_CHUNK_SIZE) {
+            finishChunk(Offset);
+        }
+        TraceEvent Event;
+        if (parseLine(Line, Event)) {
+            Chunk.Records++;
+            Chunk.Events += Event.Repeat;
+            if (Event.Kind == TraceEvent::Branch) {
+                Counts[Event.Value] += Event.Repeat;
+            }
+        }
+    });
+    if (Data.size() > Chunk.Offset) {
+        finishChunk(Data.size());
+    }
+}
+
+const std::vector<TraceChunk> &TraceFile::chunks() {
+    buildIndex();
+    return Chunks;
+}
+
+void TraceFile::decodeChunk(size_t Index, function_ref<void(uint64_t, const TraceEvent &)> F) {
+    buildIndex();
+    const TraceChunk &Chunk = Chunks[Index];
+    StringRef Data = Buffer->getBuffer().substr(Chunk.Offset, Chunk.Size);
+    uint64_t Number = Chunk.FirstEvent;
+    if (!Chunked) {
+        forEachLine(Data, [&](size_t, StringRef Line) {
+            TraceEvent Event;
+            if (parseLine(Line, Event)) {
+                F(Number, Event);
+                Number += Event.Repeat;
+            }
+        });
+        return;
+    }
+
+    const uint8_t *P = Data.bytes_begin();
+    const uint8_t *End = Data.bytes_end();
+    const char *Error = nullptr;
+    unsigned Length;
+    while (P < End) {
+        uint64_t Tag = decodeULEB128(P, &Length, End, &Error);
+        if (Error) {
+            return;
+        }
+        P += Length;
+
+        TraceEvent Event;
+        Event.Value = Tag >> 2;
+        switch (Tag & 3) {
+            case BT_RECORD_BRANCH:
+                break;
+            case BT_RECORD_LOOP:
+                Event.Repeat = decodeULEB128(P, &Length, End, &Error);
+                P += Length;
+                break;
+            case BT_RECORD_CALL:
+                Event.Kind = TraceEvent::Call;
+                Event.Value = decodeULEB128(P, &Length, End, &Error);
+                P += Length;
+                break;
+            default:
+                return;
+        }
+        if (Error) {
+            return;
+        }
+        F(Number, Event);
+        Number += Event.Repeat;
+    }
+}
+
+uint64_t TraceFile::numEvents() {
+    buildIndex();
+    return Events;
+}
+
+uint64_t TraceFile::numRecords() {
+    buildIndex();
+    return Records;
+}
+
+void TraceFile::buildBranchIndex() {
+    if (BranchesIndexed) {
+        return;
+    }
+    BranchesIndexed = true;
+    buildIndex();
+    for (const TraceChunk &Chunk : Chunks) {
+        for (const auto &Count : Chunk.BranchCounts) {
+            BranchCounts[Count.first] += Count.second;
+        }
+    }
+}
+
+void TraceFile::buildCallIndex() {
+    if (CallsIndexed) {
+        return;
+    }
+    CallsIndexed = true;
+    buildIndex();
+    for (size_t i = 0; i < Chunks.size(); i++) {
+        decodeChunk(i, [&](uint64_t Number, const TraceEvent &Event) {
+            if (Event.Kind == TraceEvent::Call) {
+                FirstCalls.try_emplace(Event.Value, Number);
+            }
+        });
+    }
+}
+
+// A span ends where a branch of another function, or of none the
+// dictionary knows, is taken; indirect calls stay in the span they are in
+void TraceFile::buildSpanIndex(BranchDictionary &Dictionary) {
+    if (SpansIndexed) {
+        return;
+    }
+    SpansIndexed = true;
+    buildIndex();
+    StringRef Current;
+    uint64_t First = 0, End = 0;
+    for (size_t i = 0; i < Chunks.size(); i++) {
+        decodeChunk(i, [&](uint64_t Number, const TraceEvent &Event) {
+            if (Event.Kind == TraceEvent::Branch) {
+                StringRef Function = Dictionary.function(Event.Value);
+                if (Function != Current) {
+                    if (!Current.empty()) {
+                        Spans[Current].emplace_back(First, End - 1);
+                    }
+                    Current = Function;
+                    First = Number;
+                }
+            }
+            End = Number + Event.Repeat;
+        });
+    }
+    if (!Current.empty()) {
+        Spans[Current].emplace_back(First, End - 1);
+    }
+}
+
+uint64_t TraceFile::countBranch(uint64_t ID) {
+    buildBranchIndex();
+    auto Count = BranchCounts.find(ID);
+    return Count == BranchCounts.end() ? 0 : Count->second;
+}
+
+// Only the chunks whose branch counts hold ID are decoded
+std::vector<uint64_t> TraceFile::branchEvents(uint64_t ID, uint64_t Limit) {
+    std::vector<uint64_t> Result;
+    buildIndex();
+    for (size_t i = 0; i < Chunks.size() && Result.size() < Limit; i++) {
+        const auto &Counts = Chunks[i].BranchCounts;
+        auto Count = std::lower_bound(Counts.begin(), Counts.end(), std::make_pair(ID, uint64_t(0)));
+        if (Count == Counts.end() || Count->first != ID) {
+            continue;
+        }
+        decodeChunk(i, [&](uint64_t Number, const TraceEvent &Event) {
+            if (Event.Kind != TraceEvent::Branch || Event.Value != ID) {
+                return;
+            }
+            for (uint64_t j = 0; j < Event.Repeat && Result.size() < Limit; j++) {
+                Result.push_back(Number + j);
+            }
+        });
+    }
+    return Result;
+}
+
+Optional<uint64_t> TraceFile::firstCall(uint64_t Address) {
+    buildCallIndex();
+    auto First = FirstCalls.find(Address);
+    if (First == FirstCalls.end()) {
+        return None;
+    }
+    return First->second;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> TraceFile::spans(BranchDictionary &Dictionary, StringRef Function, uint64_t Limit) {
+    buildSpanIndex(Dictionary);
+    auto Found = Spans.find(Function);
+    if (Found == Spans.end()) {
+        return {};
+    }
+    const std::vector<std::pair<uint64_t, uint64_t>> &All = Found->getValue();
+    return std::vector<std::pair<uint64_t, uint64_t>>(All.begin(), All.begin() + std::min<uint64_t>(Limit, All.size()));
+}
+
+// The chunk holding event First is found from the event ranges, then chunks are
+// decoded until Count events are collected
+std::vector<std::pair<uint64_t, TraceEvent>> TraceFile::events(uint64_t First, uint64_t Count) {
+    std::vector<std::pair<uint64_t, TraceEvent>> Result;
+    buildIndex();
+    if (First >= Events) {
+        return Result;
+    }
+
+    size_t Index = std::upper_bound(Chunks.begin(), Chunks.end(), First,
+        [](uint64_t Number, const TraceChunk &Chunk) { return Number < Chunk.FirstEvent; }) - Chunks.begin() - 1;
+    for (; Index < Chunks.size() && Result.size() < Count; Index++) {
+        decodeChunk(Index, [&](uint64_t Number, const TraceEvent &Event) {
+            uint64_t End = Number + Event.Repeat;
+            for (Number = std::max(Number, First); Number < End && Result.size() < Count; Number++) {
+                TraceEvent Single = Event;
+                Single.Repeat = 1;
+                Result.emplace_back(Number, Single);
+            }
+        });
+    }
+    return Result;
+}
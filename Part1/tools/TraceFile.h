@@ -0,0 +1,171 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// TraceFile.h
+
+// Read access to a branch-pointer trace and its branch dictionary for the
+// trace tools. Files are memory mapped and never parsed as a whole up
+// front: the indexes a query needs (the chunks of the trace, the chunks
+// holding each branch id, the first call to each function pointer, the
+// spans of each function) are built the first time a query asks for them
+// and kept for the next query.
+//
+// A trace is either the text the runtime prints ("br_4" lines) or the
+// chunked file it writes with BT_TRACE_FILE (BranchTraceFormat.h). Both are
+// read as a sequence of chunks that can be decoded on their own: the chunks
+// of a chunked trace come with their event ranges and branch counts in the
+// index at the end of the file, a text trace is cut into chunks of whole
+// lines while it is scanned once.
+//
+// Events are numbered as in the decoded trace, so a coalesced loop record
+// "br_4 x1000" stands for 1000 consecutive events.
+
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace llvm {
+
+    // One record of the trace
+    struct TraceEvent {
+        enum EventKind : uint8_t {
+            Branch,                 // br_<id>
+            Call                    // *func_<address>
+        };
+
+        EventKind Kind = Branch;
+        uint64_t Value = 0;         // branch id, or function pointer called by an indirect call
+        uint64_t Repeat = 1;        // number of events the record stands for (coalesced loops)
+    };
+
+    // A part of the trace that can be decoded on its own
+    struct TraceChunk {
+        uint64_t Offset = 0;        // of the records in the file
+        uint64_t Size = 0;          // bytes of records
+        uint64_t FirstEvent = 0;
+        uint64_t Events = 0;
+        uint64_t Records = 0;
+        std::vector<std::pair<uint64_t, uint64_t>> BranchCounts;   // (branch id, events), sorted by id
+    };
+
+    // The branch dictionary "br_<id>: <file>, <line>, <target line>"
+    class BranchDictionary {
+
+        public:
+            // Map a dictionary file, nullptr if it cannot be read
+            static std::unique_ptr<BranchDictionary> open(StringRef Path);
+
+            // "<file>, <line>, <target line>" of a branch id, empty if unknown
+            StringRef text(uint64_t ID);
+
+            // Name of the function whose branch ids include ID, empty if unknown
+            // (dictionaries without "fn_<first id>: <name>, <ids>" lines)
+            StringRef function(uint64_t ID);
+
+        private:
+            struct FunctionIds {
+                uint64_t First;
+                uint64_t Count;
+                StringRef Name;
+            };
+
+            std::unique_ptr<MemoryBuffer> Buffer;
+            std::vector<StringRef> Entries;     // indexed by id, built on first lookup
+            std::vector<FunctionIds> Functions; // by first id
+            bool Indexed = false;
+
+            void buildIndex();
+    };
+
+    class TraceFile {
+
+        public:
+            // Map a trace file, nullptr if it cannot be read or is not a trace
+            static std::unique_ptr<TraceFile> open(StringRef Path);
+
+            // Parse one trace line, false for lines of the program's own output
+            static bool parseLine(StringRef Line, TraceEvent &Event);
+
+            // Text of a record as printed by the runtime, "br_4", "br_4 x1000" or "*func_0x401136"
+            static std::string format(const TraceEvent &Event);
+
+            // Whether the trace is a chunked trace, and whether its index was found
+            bool isChunked() const { return Chunked; }
+            bool hasIndex() { buildIndex(); return IndexFound; }
+
+            uint64_t numEvents();
+            uint64_t numRecords();
+
+            const std::vector<TraceChunk> &chunks();
+
+            // Decode the records of chunk Index, calling F(number of the record's first event, record)
+            void decodeChunk(size_t Index, function_ref<void(uint64_t, const TraceEvent &)> F);
+
+            // Number of events of branch ID
+            uint64_t countBranch(uint64_t ID);
+
+            // Numbers of the first Limit events of branch ID
+            std::vector<uint64_t> branchEvents(uint64_t ID, uint64_t Limit);
+
+            // Number of the first event that is an indirect call of the function pointer Address
+            Optional<uint64_t> firstCall(uint64_t Address);
+
+            // First and last event of the first Limit spans of Function: stretches of
+            // consecutive events whose branches are its ids in Dictionary, with the
+            // indirect calls among them; the index is built with the dictionary of
+            // the first query
+            std::vector<std::pair<uint64_t, uint64_t>> spans(BranchDictionary &Dictionary, StringRef Function, uint64_t Limit);
+
+            // Events First .. First + Count - 1 (fewer at the end of the trace) with their numbers
+            std::vector<std::pair<uint64_t, TraceEvent>> events(uint64_t First, uint64_t Count);
+
+        private:
+            std::unique_ptr<MemoryBuffer> Buffer;
+            bool Chunked = false;
+            bool IndexFound = false;
+
+            // chunk index, with the branch counts of every chunk
+            bool Indexed = false;
+            std::vector<TraceChunk> Chunks;
+            uint64_t Events = 0;
+            uint64_t Records = 0;
+
+            // per-branch index: the event count of each branch id
+            bool BranchesIndexed = false;
+            DenseMap<uint64_t, uint64_t> BranchCounts;
+
+            // per-target index: the first indirect call of each function pointer
+            bool CallsIndexed = false;
+            DenseMap<uint64_t, uint64_t> FirstCalls;
+
+            // per-function index: the spans of each function, from its branch ids
+            bool SpansIndexed = false;
+            StringMap<std::vector<std::pair<uint64_t, uint64_t>>> Spans;
+
+            void buildIndex();
+            bool readChunkIndex();
+            void scanChunks();
+            void scanText();
+            void buildBranchIndex();
+            void buildCallIndex();
+            void buildSpanIndex(BranchDictionary &Dictionary);
+    };
+
+}
+
+#endif // TRACE_FILE_H
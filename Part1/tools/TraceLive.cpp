@@ -0,0 +1,295 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// TraceLive.cpp
+
+// Consumer of a program traced with BT_SHM: the runtime publishes the
+// records of every thread to a ring in shared memory (BranchTraceFormat.h)
+// and this tool reads them while the program runs, so a trace is analyzed
+// without ever being written to disk:
+//
+//   trace_live -shm=/bt_driver -d output/driver.c_BranchDictionary.txt &
+//   BT_SHM=/bt_driver ./driver
+//
+//   -print          the records as the runtime prints them, "# thread <n>" before
+//                   the records of another thread
+//   -top=<K>        the K hottest edges in the summary printed at the end
+//   -interval=<s>   also print the events and drops of every thread every s seconds
+//   -wait=<s>       give up if no program started tracing within s seconds (0 waits forever)
+//
+// The tool stops once the program exited (or died, its pid in the header is
+// gone) and every ring is drained, or on SIGINT, and removes the shared
+// memory object unless another program or consumer took over the name
+// meanwhile. An object left by a program that died is reset when the tool
+// starts. Records a program had to
+// drop because the consumer fell behind are counted per thread; with
+// BT_SHM_BLOCK=1 the program waits for the consumer instead.
+
+#include "TraceFile.h"
+#include "BranchTraceFormat.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace llvm;
+
+static cl::opt<std::string> ShmName("shm",
+    cl::desc("Shared memory object the program publishes to (its BT_SHM)"),
+    cl::value_desc("name"), cl::Required);
+
+static cl::opt<std::string> DictionaryPath("d",
+    cl::desc("Branch dictionary to print the branches with"),
+    cl::value_desc("dictionary"), cl::init(""));
+
+static cl::opt<bool> Print("print",
+    cl::desc("Print the records as they arrive"),
+    cl::init(false));
+
+static cl::opt<unsigned> TopEdges("top",
+    cl::desc("Number of hottest edges to print"),
+    cl::value_desc("K"), cl::init(10));
+
+static cl::opt<unsigned> Interval("interval",
+    cl::desc("Seconds between progress reports (0 for none)"),
+    cl::value_desc("s"), cl::init(0));
+
+static cl::opt<unsigned> Wait("wait",
+    cl::desc("Seconds to wait for a program to start tracing (0 waits forever)"),
+    cl::value_desc("s"), cl::init(0));
+
+static volatile sig_atomic_t Interrupted = 0;
+
+namespace {
+
+    // What was read from one ring
+    struct ThreadStats {
+        uint64_t Records = 0;
+        uint64_t Events = 0;
+    };
+
+    TraceEvent decodeRecord(const bt_shm_record &Record) {
+        TraceEvent Event;
+        Event.Value = Record.tag >> 2;
+        switch (Record.tag & 3) {
+            case BT_RECORD_LOOP:
+                Event.Repeat = Record.operand;
+                break;
+            case BT_RECORD_CALL:
+                Event.Kind = TraceEvent::Call;
+                Event.Value = Record.operand;
+                break;
+        }
+        return Event;
+    }
+
+    double percent(uint64_t Part, uint64_t Whole) {
+        return Whole ? 100.0 * Part / Whole : 0.0;
+    }
+
+}
+
+// Whether the program tracing to the object finished, or died without exiting
+static bool producerGone(bt_shm_header *Header, pid_t Producer) {
+    return __atomic_load_n(&Header->finished, __ATOMIC_ACQUIRE) || (kill(Producer, 0) != 0 && errno == ESRCH);
+}
+
+// Open the shared memory object, creating it if the program has not started
+// yet, and reset it if its program is gone; Status is the object's, to
+// recognize it when removing the name
+static bt_shm_header *mapShm(size_t Size, struct stat &Status) {
+    int FD = shm_open(ShmName.c_str(), O_RDWR | O_CREAT, 0600);
+    if (FD < 0 || fstat(FD, &Status) != 0 || ((size_t)Status.st_size < Size && ftruncate(FD, Size) != 0)) {
+        errs() << "Error: Could not open shared memory " << ShmName << ": " << strerror(errno) << "\n";
+        if (FD >= 0) {
+            close(FD);
+        }
+        return nullptr;
+    }
+    void *Map = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, FD, 0);
+    close(FD);
+    if (Map == MAP_FAILED) {
+        errs() << "Error: Could not map shared memory " << ShmName << ": " << strerror(errno) << "\n";
+        return nullptr;
+    }
+    auto *Header = static_cast<bt_shm_header *>(Map);
+    if (memcmp(Header->magic, BT_SHM_MAGIC, 4) != 0) {          // same initialization as the runtime's
+        Header->version = BT_SHM_VERSION;
+        Header->threads = BT_SHM_THREADS;
+        Header->records = BT_SHM_RECORDS;
+        uint32_t Magic;
+        memcpy(&Magic, BT_SHM_MAGIC, 4);
+        __atomic_store_n(reinterpret_cast<uint32_t *>(Header->magic), Magic, __ATOMIC_RELEASE);
+    } else if (Header->version != BT_SHM_VERSION || Header->threads != BT_SHM_THREADS || Header->records != BT_SHM_RECORDS) {
+        errs() << "Error: Shared memory " << ShmName << " has another layout (version " << Header->version << ")\n";
+        munmap(Map, Size);
+        return nullptr;
+    }
+
+    uint32_t Producer = __atomic_load_n(&Header->producer, __ATOMIC_ACQUIRE);
+    if (Producer != 0 && producerGone(Header, Producer)) {         // left by an earlier program
+        bt_shm_ring *Rings = reinterpret_cast<bt_shm_ring *>(Header + 1);
+        for (unsigned t = 0; t < std::min<unsigned>(Header->num_rings, BT_SHM_THREADS); t++) {
+            Rings[t].head = 0;
+            Rings[t].dropped = 0;
+            Rings[t].tail = 0;
+        }
+        __atomic_store_n(&Header->num_rings, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&Header->finished, 0, __ATOMIC_RELAXED);
+        __atomic_compare_exchange_n(&Header->producer, &Producer, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+    return Header;
+}
+
+// Remove the name only if it still is the object we mapped, and no other
+// program than the one we consumed (Producer, 0 for none) took it over
+static void unlinkShm(bt_shm_header *Header, const struct stat &Status, uint32_t Producer) {
+    int FD = shm_open(ShmName.c_str(), O_RDONLY, 0);
+    if (FD < 0) {
+        return;
+    }
+    struct stat Current;
+    bool Same = fstat(FD, &Current) == 0 && Current.st_dev == Status.st_dev && Current.st_ino == Status.st_ino;
+    close(FD);
+    uint32_t Now = __atomic_load_n(&Header->producer, __ATOMIC_ACQUIRE);
+    if (Same && (Now == 0 || Now == Producer)) {
+        shm_unlink(ShmName.c_str());
+    }
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "live consumer of branch-pointer traces\n");
+    std::unique_ptr<BranchDictionary> Dictionary;
+    if (!DictionaryPath.empty() && !(Dictionary = BranchDictionary::open(DictionaryPath))) {
+        errs() << "Error: Could not read dictionary " << DictionaryPath << "\n";
+        return 1;
+    }
+    auto text = [&](uint64_t ID) { return Dictionary ? Dictionary->text(ID) : StringRef(); };
+
+    size_t Size = sizeof(bt_shm_header) + BT_SHM_THREADS * sizeof(bt_shm_ring);
+    struct stat Status;
+    bt_shm_header *Header = mapShm(Size, Status);
+    if (!Header) {
+        return 1;
+    }
+    bt_shm_ring *Rings = reinterpret_cast<bt_shm_ring *>(Header + 1);
+    signal(SIGINT, [](int) { Interrupted = 1; });
+
+    // Step 1: Drain the rings until the program exited and nothing is left
+    raw_ostream &OS = outs();
+    std::vector<ThreadStats> Threads(BT_SHM_THREADS);
+    DenseMap<uint64_t, uint64_t> BranchCounts;
+    uint64_t Calls = 0, Idle = 0;
+    uint32_t Producer = 0;
+    unsigned LastPrinted = BT_SHM_THREADS;
+    auto Start = std::chrono::steady_clock::now(), LastReport = Start;
+    while (!Interrupted) {
+        uint32_t Current = __atomic_load_n(&Header->producer, __ATOMIC_ACQUIRE);
+        if (Current != 0) {
+            Producer = Current;
+        }
+        bool Finished = Producer != 0 && (__atomic_load_n(&Header->finished, __ATOMIC_ACQUIRE) || (Idle > 0 && producerGone(Header, Producer)));
+        unsigned NumRings = std::min<unsigned>(__atomic_load_n(&Header->num_rings, __ATOMIC_ACQUIRE), BT_SHM_THREADS);
+        uint64_t Consumed = 0;
+        for (unsigned t = 0; t < NumRings; t++) {
+            bt_shm_ring &Ring = Rings[t];
+            uint64_t Head = __atomic_load_n(&Ring.head, __ATOMIC_ACQUIRE);
+            uint64_t Tail = Ring.tail;
+            if (Head == Tail) {
+                continue;
+            }
+            if (Print && LastPrinted != t) {
+                OS << "# thread " << t << "\n";
+                LastPrinted = t;
+            }
+            for (; Tail != Head; Tail++) {
+                TraceEvent Event = decodeRecord(Ring.records[Tail & (BT_SHM_RECORDS - 1)]);
+                if (Event.Kind == TraceEvent::Branch) {
+                    BranchCounts[Event.Value] += Event.Repeat;
+                } else {
+                    Calls++;
+                }
+                Threads[t].Records++;
+                Threads[t].Events += Event.Repeat;
+                if (Print) {
+                    OS << TraceFile::format(Event) << "\n";
+                }
+            }
+            Consumed += Head - Ring.tail;
+            __atomic_store_n(&Ring.tail, Head, __ATOMIC_RELEASE);
+        }
+
+        auto Now = std::chrono::steady_clock::now();
+        if (Interval > 0 && Now - LastReport >= std::chrono::seconds(Interval)) {
+            for (unsigned t = 0; t < NumRings; t++) {
+                errs() << "thread " << t << ": " << Threads[t].Events << " events, "
+                       << __atomic_load_n(&Rings[t].dropped, __ATOMIC_RELAXED) << " records dropped\n";
+            }
+            LastReport = Now;
+        }
+        if (Finished && Consumed == 0) {
+            break;                              // read again after seeing finished, nothing can follow
+        }
+        if (NumRings == 0 && Wait > 0 && Now - Start >= std::chrono::seconds(Wait)) {
+            errs() << "Error: No program traced to " << ShmName << " within " << Wait << " seconds\n";
+            unlinkShm(Header, Status, Producer);
+            return 1;
+        }
+        Idle = Consumed ? 0 : Idle + 1;
+        if (Idle > 1000) {                      // spin while the program is busy, sleep while it is not
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        } else if (Idle > 0) {
+            std::this_thread::yield();
+        }
+    }
+    OS.flush();
+
+    // Step 2: Summary, per thread and of the hottest edges
+    unsigned NumRings = std::min<unsigned>(Header->num_rings, BT_SHM_THREADS);
+    uint64_t Events = 0, Records = 0, Dropped = 0;
+    for (unsigned t = 0; t < NumRings; t++) {
+        Events += Threads[t].Events;
+        Records += Threads[t].Records;
+        Dropped += __atomic_load_n(&Rings[t].dropped, __ATOMIC_RELAXED);
+    }
+    raw_ostream &Summary = Print ? errs() : outs();       // keep the printed records clean
+    Summary << "live trace: " << Events << " events in " << Records << " records from " << NumRings << " threads, "
+            << Dropped << " records dropped" << (Interrupted ? ", interrupted" : "") << "\n";
+    Summary << "\nthreads (thread, events, records, dropped records)\n";
+    for (unsigned t = 0; t < NumRings; t++) {
+        Summary << t << " " << Threads[t].Events << " " << Threads[t].Records << " " << Rings[t].dropped << "\n";
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> Hottest(BranchCounts.begin(), BranchCounts.end());
+    uint64_t BranchEvents = Events - Calls;
+    llvm::sort(Hottest, [](const std::pair<uint64_t, uint64_t> &A, const std::pair<uint64_t, uint64_t> &B) {
+        return A.second != B.second ? A.second > B.second : A.first < B.first;
+    });
+    Hottest.resize(std::min<size_t>(TopEdges, Hottest.size()));
+    Summary << "\ntop " << Hottest.size() << " edges (id, events, share of branch events, branch)\n";
+    for (const auto &Branch : Hottest) {
+        Summary << "br_" << Branch.first << " " << Branch.second << " " << format("%.2f%%", percent(Branch.second, BranchEvents))
+                << " " << text(Branch.first) << "\n";
+    }
+    Summary << "\nindirect calls: " << Calls << "\n";
+
+    unlinkShm(Header, Status, Producer);
+    munmap(Header, Size);
+    return 0;
+}
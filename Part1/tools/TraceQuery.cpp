@@ -0,0 +1,318 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// TraceQuery.cpp
+
+// Query service for branch-pointer traces. A daemon listening on a Unix
+// socket keeps every trace it was asked about mapped, together with the
+// indexes earlier queries built, so repeated questions about the same
+// large trace do not pay for reading it again.
+//
+//   trace_query -socket=/tmp/trace_query.sock -serve &
+//   trace_query -socket=/tmp/trace_query.sock open out.trace output/driver.c_BranchDictionary.txt
+//   trace_query -socket=/tmp/trace_query.sock count out.trace br_4
+//
+// Requests are single lines. Every response has at least one line, "none"
+// when there is nothing to report, and ends with an empty line:
+//   open <trace> [<dictionary>]         map a trace (again), with the dictionary used to print events
+//   events <trace>                      number of events, records and chunks
+//   count <trace> br_<id>               number of events of a branch
+//   occurrences <trace> br_<id> [<n>]   numbers of the first n (10) events of a branch
+//   window <trace> <event> [<radius>]   events around an event number (radius 5)
+//   first <trace> *func_<address>       first call to a function pointer
+//   spans <trace> <function> [<n>]      first and last event of the first n (10) stretches
+//                                       of events in a function, needs the dictionary
+//   close <trace>                       forget a trace and its indexes
+//   list                                traces that are open
+//   shutdown                            stop the daemon
+// Traces a request names are opened on first use.
+
+#include "TraceFile.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+static cl::opt<std::string> SocketPath("socket",
+    cl::desc("Unix socket of the query daemon"),
+    cl::value_desc("path"), cl::init("/tmp/trace_query.sock"));
+
+static cl::opt<bool> Serve("serve",
+    cl::desc("Run the query daemon instead of sending a query"),
+    cl::init(false));
+
+static cl::list<std::string> QueryWords(cl::Positional,
+    cl::desc("<query>"), cl::ZeroOrMore);
+
+namespace {
+
+    struct OpenTrace {
+        std::unique_ptr<TraceFile> Trace;
+        std::unique_ptr<BranchDictionary> Dictionary;
+    };
+
+    class QueryServer {
+
+        public:
+            // Answer one request, false once the daemon should stop
+            bool handle(StringRef Request, raw_ostream &OS);
+
+        private:
+            StringMap<OpenTrace> Traces;
+
+            OpenTrace *get(StringRef Path, raw_ostream &OS);
+            void printEvent(OpenTrace &T, uint64_t Number, const TraceEvent &Event, raw_ostream &OS);
+    };
+
+    // Write all of Data to a socket
+    bool writeAll(int FD, StringRef Data) {
+        while (!Data.empty()) {
+            ssize_t Written = ::write(FD, Data.data(), Data.size());
+            if (Written <= 0) {
+                return false;
+            }
+            Data = Data.drop_front(Written);
+        }
+        return true;
+    }
+
+    sockaddr_un socketAddress() {
+        sockaddr_un Address;
+        memset(&Address, 0, sizeof(Address));
+        Address.sun_family = AF_UNIX;
+        strncpy(Address.sun_path, SocketPath.c_str(), sizeof(Address.sun_path) - 1);
+        return Address;
+    }
+
+}
+
+OpenTrace *QueryServer::get(StringRef Path, raw_ostream &OS) {
+    auto Found = Traces.find(Path);
+    if (Found != Traces.end()) {
+        return &Found->second;
+    }
+    std::unique_ptr<TraceFile> Trace = TraceFile::open(Path);
+    if (!Trace) {
+        OS << "error: cannot read trace " << Path << "\n";
+        return nullptr;
+    }
+    OpenTrace &T = Traces[Path];
+    T.Trace = std::move(Trace);
+    return &T;
+}
+
+// "<number>: br_4: ex.c, 6, 7", without the dictionary text if there is none
+void QueryServer::printEvent(OpenTrace &T, uint64_t Number, const TraceEvent &Event, raw_ostream &OS) {
+    OS << Number << ": " << TraceFile::format(Event);
+    if (T.Dictionary && Event.Kind == TraceEvent::Branch) {
+        StringRef Text = T.Dictionary->text(Event.Value);
+        if (!Text.empty()) {
+            OS << ": " << Text;
+        }
+    }
+    OS << "\n";
+}
+
+bool QueryServer::handle(StringRef Request, raw_ostream &OS) {
+    SmallVector<StringRef, 4> Words;
+    Request.split(Words, ' ', -1, /*KeepEmpty=*/false);
+    if (Words.empty()) {
+        OS << "error: empty request\n";
+        return true;
+    }
+
+    StringRef Command = Words[0];
+    if (Command == "shutdown") {
+        OS << "ok\n";
+        return false;
+    }
+    if (Command == "list") {
+        for (auto &Entry : Traces) {
+            OS << Entry.getKey() << "\n";
+        }
+        return true;
+    }
+    if (!is_contained(ArrayRef<StringRef>({"open", "events", "count", "occurrences", "window", "first", "spans", "close"}), Command)) {
+        OS << "error: cannot understand \"" << Request << "\"\n";
+        return true;
+    }
+    if (Words.size() < 2) {
+        OS << "error: " << Command << " needs a trace file\n";
+        return true;
+    }
+
+    StringRef Path = Words[1];
+    if (Command == "close") {
+        Traces.erase(Path);
+        OS << "ok\n";
+        return true;
+    }
+    if (Command == "open") {
+        Traces.erase(Path);                 // the file may have been rewritten
+    }
+
+    OpenTrace *T = get(Path, OS);
+    if (!T) {
+        return true;
+    }
+
+    uint64_t Number = 0, Limit = 0;
+    TraceEvent Event;
+    if (Command == "open") {
+        if (Words.size() > 2 && !(T->Dictionary = BranchDictionary::open(Words[2]))) {
+            OS << "error: cannot read dictionary " << Words[2] << "\n";
+            return true;
+        }
+        OS << "ok\n";
+    } else if (Command == "events") {
+        OS << T->Trace->numEvents() << " events in " << T->Trace->numRecords() << " records, "
+           << T->Trace->chunks().size() << " chunks\n";
+    } else if ((Command == "count" || Command == "occurrences") && Words.size() > 2 &&
+               TraceFile::parseLine(Words[2], Event) && Event.Kind == TraceEvent::Branch) {
+        if (Command == "count") {
+            OS << T->Trace->countBranch(Event.Value) << "\n";
+        } else {
+            Limit = 10;
+            if (Words.size() > 3 && Words[3].getAsInteger(10, Limit)) {
+                OS << "error: bad count " << Words[3] << "\n";
+                return true;
+            }
+            for (uint64_t Occurrence : T->Trace->branchEvents(Event.Value, Limit)) {
+                OS << Occurrence << "\n";
+            }
+        }
+    } else if (Command == "window" && Words.size() > 2 && !Words[2].getAsInteger(10, Number)) {
+        Limit = 5;
+        if (Words.size() > 3 && Words[3].getAsInteger(10, Limit)) {
+            OS << "error: bad radius " << Words[3] << "\n";
+            return true;
+        }
+        uint64_t First = Number > Limit ? Number - Limit : 0;
+        for (auto &Entry : T->Trace->events(First, Number - First + Limit + 1)) {
+            printEvent(*T, Entry.first, Entry.second, OS);
+        }
+    } else if (Command == "first" && Words.size() > 2 &&
+               TraceFile::parseLine(Words[2], Event) && Event.Kind == TraceEvent::Call) {
+        if (Optional<uint64_t> First = T->Trace->firstCall(Event.Value)) {
+            OS << *First << "\n";
+        } else {
+            OS << "none\n";
+        }
+    } else if (Command == "spans" && Words.size() > 2) {
+        if (!T->Dictionary) {
+            OS << "error: spans need a dictionary, \"open " << Path << " <dictionary>\" first\n";
+            return true;
+        }
+        Limit = 10;
+        if (Words.size() > 3 && Words[3].getAsInteger(10, Limit)) {
+            OS << "error: bad count " << Words[3] << "\n";
+            return true;
+        }
+        for (const auto &Span : T->Trace->spans(*T->Dictionary, Words[2], Limit)) {
+            OS << Span.first << "-" << Span.second << "\n";
+        }
+    } else {
+        OS << "error: cannot understand \"" << Request << "\"\n";
+    }
+    return true;
+}
+
+// Accept clients one after the other and answer their requests
+static int serve() {
+    int Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un Address = socketAddress();
+    unlink(Address.sun_path);
+    if (Listener < 0 || bind(Listener, (sockaddr *)&Address, sizeof(Address)) < 0 || listen(Listener, 8) < 0) {
+        errs() << "Error: Could not listen on " << SocketPath << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);           // a client that went away must not stop the daemon
+
+    QueryServer Server;
+    bool Running = true;
+    while (Running) {
+        int Client = accept(Listener, nullptr, nullptr);
+        if (Client < 0) {
+            continue;
+        }
+
+        std::string Pending;
+        char Chunk[4096];
+        ssize_t Read;
+        while (Running && (Read = ::read(Client, Chunk, sizeof(Chunk))) > 0) {
+            Pending.append(Chunk, Read);
+            size_t End;
+            while (Running && (End = Pending.find('\n')) != std::string::npos) {
+                std::string Response;
+                raw_string_ostream OS(Response);
+                Running = Server.handle(StringRef(Pending).take_front(End).rtrim('\r'), OS);
+                if (OS.str().empty()) {
+                    OS << "none\n";        // an empty body would look like the end of the response
+                }
+                OS << "\n";
+                writeAll(Client, OS.str());
+                Pending.erase(0, End + 1);
+            }
+        }
+        close(Client);
+    }
+
+    close(Listener);
+    unlink(Address.sun_path);
+    return 0;
+}
+
+// Send one request and print the response, exit status 1 for errors
+static int query(const std::string &Request) {
+    int Server = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un Address = socketAddress();
+    if (Server < 0 || connect(Server, (sockaddr *)&Address, sizeof(Address)) < 0) {
+        errs() << "Error: Could not connect to " << SocketPath << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    writeAll(Server, Request + "\n");
+
+    std::string Response;
+    char Chunk[4096];
+    ssize_t Read;
+    while (StringRef(Response).find("\n\n") == StringRef::npos && (Read = ::read(Server, Chunk, sizeof(Chunk))) > 0) {
+        Response.append(Chunk, Read);
+    }
+    close(Server);
+
+    Response.resize(Response.size() - std::min<size_t>(1, Response.size()));   // drop the empty line
+    outs() << Response;
+    return StringRef(Response).startswith("error:") ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "branch-pointer trace query service\n");
+    if (Serve) {
+        return serve();
+    }
+    if (QueryWords.empty()) {
+        errs() << "Error: Nothing to ask, pass -serve or a query\n";
+        return 1;
+    }
+
+    std::string Request;
+    for (const std::string &Word : QueryWords) {
+        Request += (Request.empty() ? "" : " ") + Word;
+    }
+    return query(Request);
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// TraceStats.cpp
+
+// Summary of a branch-pointer trace, so the questions we used to grep
+// "br_N" lines for are answered in one pass:
+//
+//   trace_stats -d output/driver.c_BranchDictionary.txt -j 8 -top 20 out.trace
+//
+//   - events of every branch id
+//   - taken ratio of every target of a source branch line
+//   - the top K hottest edges
+//   - coalesced loop records: how often each loop ran and its trip counts
+//   - indirect call targets, with the branches taken right before the calls
+//
+// Chunks are decoded by a pool of threads, each adding to its own
+// histograms, which are merged at the end. The trace is mapped and read
+// one chunk at a time, so it can be larger than memory: only the
+// histograms are kept.
+
+#include "TraceFile.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+
+using namespace llvm;
+
+static cl::opt<std::string> TracePath(cl::Positional,
+    cl::desc("<trace>"), cl::Required);
+
+static cl::opt<std::string> DictionaryPath("d",
+    cl::desc("Branch dictionary to print the branches with"),
+    cl::value_desc("dictionary"), cl::init(""));
+
+static cl::opt<unsigned> Threads("j",
+    cl::desc("Number of threads (0 for one per core)"),
+    cl::value_desc("threads"), cl::init(0));
+
+static cl::opt<unsigned> TopEdges("top",
+    cl::desc("Number of hottest edges to print"),
+    cl::value_desc("K"), cl::init(10));
+
+namespace {
+
+    const uint64_t NoBranch = ~0ull;
+
+    struct LoopStats {
+        uint64_t Records = 0;
+        uint64_t Iterations = 0;
+        uint64_t Min = ~0ull;
+        uint64_t Max = 0;
+    };
+
+    // Histograms of one thread, or of the whole trace once merged
+    struct TraceStats {
+        DenseMap<uint64_t, uint64_t> BranchCounts;
+        DenseMap<uint64_t, LoopStats> Loops;
+        DenseMap<std::pair<uint64_t, uint64_t>, uint64_t> Calls;       // (target, branch before) -> calls
+
+        void merge(const TraceStats &Other);
+    };
+
+    // What a chunk cannot know on its own: the calls made before its first branch,
+    // whose branch before is the last branch of an earlier chunk
+    struct ChunkEdges {
+        std::vector<uint64_t> LeadingCalls;
+        uint64_t LastBranch = NoBranch;
+    };
+
+}
+
+void TraceStats::merge(const TraceStats &Other) {
+    for (const auto &Count : Other.BranchCounts) {
+        BranchCounts[Count.first] += Count.second;
+    }
+    for (const auto &Loop : Other.Loops) {
+        LoopStats &Merged = Loops[Loop.first];
+        Merged.Records += Loop.second.Records;
+        Merged.Iterations += Loop.second.Iterations;
+        Merged.Min = std::min(Merged.Min, Loop.second.Min);
+        Merged.Max = std::max(Merged.Max, Loop.second.Max);
+    }
+    for (const auto &Call : Other.Calls) {
+        Calls[Call.first] += Call.second;
+    }
+}
+
+static void collectChunk(TraceFile &Trace, size_t Index, TraceStats &Stats, ChunkEdges &Edges) {
+    uint64_t LastBranch = NoBranch;
+    Trace.decodeChunk(Index, [&](uint64_t, const TraceEvent &Event) {
+        if (Event.Kind == TraceEvent::Call) {
+            if (LastBranch == NoBranch) {
+                Edges.LeadingCalls.push_back(Event.Value);
+            } else {
+                Stats.Calls[std::make_pair(Event.Value, LastBranch)]++;
+            }
+            return;
+        }
+        Stats.BranchCounts[Event.Value] += Event.Repeat;
+        if (Event.Repeat != 1) {
+            LoopStats &Loop = Stats.Loops[Event.Value];
+            Loop.Records++;
+            Loop.Iterations += Event.Repeat;
+            Loop.Min = std::min(Loop.Min, Event.Repeat);
+            Loop.Max = std::max(Loop.Max, Event.Repeat);
+        }
+        LastBranch = Event.Value;
+    });
+    Edges.LastBranch = LastBranch;
+}
+
+static double percent(uint64_t Part, uint64_t Whole) {
+    return Whole ? 100.0 * Part / Whole : 0.0;
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "branch-pointer trace statistics\n");
+    std::unique_ptr<TraceFile> Trace = TraceFile::open(TracePath);
+    if (!Trace) {
+        errs() << "Error: Could not read trace " << TracePath << "\n";
+        return 1;
+    }
+    std::unique_ptr<BranchDictionary> Dictionary;
+    if (!DictionaryPath.empty() && !(Dictionary = BranchDictionary::open(DictionaryPath))) {
+        errs() << "Error: Could not read dictionary " << DictionaryPath << "\n";
+        return 1;
+    }
+    auto text = [&](uint64_t ID) { return Dictionary ? Dictionary->text(ID) : StringRef(); };
+
+    // Step 1: Decode the chunks in parallel, each thread taking the next chunk nobody took
+    const std::vector<TraceChunk> &Chunks = Trace->chunks();       // built before the threads start
+    ThreadPool Pool(hardware_concurrency(Threads));
+    unsigned NumThreads = std::max<unsigned>(1, std::min<size_t>(Pool.getThreadCount(), Chunks.size()));
+    std::vector<TraceStats> ThreadStats(NumThreads);
+    std::vector<ChunkEdges> Edges(Chunks.size());
+    std::atomic<size_t> NextChunk(0);
+    for (unsigned t = 0; t < NumThreads; t++) {
+        Pool.async([&, t] {
+            for (size_t i; (i = NextChunk++) < Chunks.size();) {
+                collectChunk(*Trace, i, ThreadStats[t], Edges[i]);
+            }
+        });
+    }
+    Pool.wait();
+
+    // Step 2: Merge the histograms, and give the calls at the start of a chunk the last branch before them
+    TraceStats Stats;
+    for (const TraceStats &Other : ThreadStats) {
+        Stats.merge(Other);
+    }
+    uint64_t LastBranch = NoBranch;
+    for (const ChunkEdges &Chunk : Edges) {
+        for (uint64_t Target : Chunk.LeadingCalls) {
+            Stats.Calls[std::make_pair(Target, LastBranch)]++;
+        }
+        if (Chunk.LastBranch != NoBranch) {
+            LastBranch = Chunk.LastBranch;
+        }
+    }
+
+    raw_ostream &OS = outs();
+    OS << "trace: " << Trace->numEvents() << " events in " << Trace->numRecords() << " records, "
+       << Chunks.size() << " chunks, " << NumThreads << " threads\n";
+
+    // Step 3: Events of every branch id
+    std::vector<std::pair<uint64_t, uint64_t>> Branches(Stats.BranchCounts.begin(), Stats.BranchCounts.end());
+    llvm::sort(Branches);
+    uint64_t BranchEvents = 0;
+    OS << "\nbranches (id, events, branch)\n";
+    for (const auto &Branch : Branches) {
+        OS << "br_" << Branch.first << " " << Branch.second << " " << text(Branch.first) << "\n";
+        BranchEvents += Branch.second;
+    }
+
+    // Step 4: Taken ratio of every target of a source branch line, from the dictionary
+    if (Dictionary) {
+        std::map<std::string, std::vector<std::pair<StringRef, uint64_t>>> Lines;       // "file, line" -> (target line, events)
+        for (const auto &Branch : Branches) {
+            StringRef Line, Target;
+            std::tie(Line, Target) = text(Branch.first).rsplit(", ");
+            if (!Target.empty()) {
+                Lines[Line.str()].emplace_back(Target, Branch.second);
+            }
+        }
+        OS << "\nbranch lines (file, line: target line events ratio, ...)\n";
+        for (const auto &Line : Lines) {
+            uint64_t Total = 0;
+            for (const auto &Target : Line.second) {
+                Total += Target.second;
+            }
+            OS << Line.first << ":";
+            for (const auto &Target : Line.second) {
+                OS << " " << Target.first << " " << Target.second << " " << format("%.2f%%", percent(Target.second, Total));
+            }
+            OS << "\n";
+        }
+    }
+
+    // Step 5: The hottest edges
+    std::vector<std::pair<uint64_t, uint64_t>> Hottest = Branches;
+    std::stable_sort(Hottest.begin(), Hottest.end(),
+        [](const std::pair<uint64_t, uint64_t> &A, const std::pair<uint64_t, uint64_t> &B) { return A.second > B.second; });
+    Hottest.resize(std::min<size_t>(TopEdges, Hottest.size()));
+    OS << "\ntop " << Hottest.size() << " edges (id, events, share of branch events, branch)\n";
+    for (const auto &Branch : Hottest) {
+        OS << "br_" << Branch.first << " " << Branch.second << " " << format("%.2f%%", percent(Branch.second, BranchEvents))
+           << " " << text(Branch.first) << "\n";
+    }
+
+    // Step 6: Coalesced loops
+    if (!Stats.Loops.empty()) {
+        std::vector<std::pair<uint64_t, LoopStats>> Loops(Stats.Loops.begin(), Stats.Loops.end());
+        llvm::sort(Loops, [](const std::pair<uint64_t, LoopStats> &A, const std::pair<uint64_t, LoopStats> &B) { return A.first < B.first; });
+        OS << "\nloops (id, runs, iterations, min, mean, max trip count, branch)\n";
+        for (const auto &Loop : Loops) {
+            const LoopStats &L = Loop.second;
+            OS << "br_" << Loop.first << " " << L.Records << " " << L.Iterations << " " << L.Min << " "
+               << format("%.1f", (double)L.Iterations / L.Records) << " " << L.Max << " " << text(Loop.first) << "\n";
+        }
+    }
+
+    // Step 7: Histogram of indirect call targets, with the branches taken right before the calls
+    if (!Stats.Calls.empty()) {
+        std::map<uint64_t, std::vector<std::pair<uint64_t, uint64_t>>> Targets;         // function pointer -> (calls, branch before)
+        uint64_t TotalCalls = 0;
+        for (const auto &Call : Stats.Calls) {
+            Targets[Call.first.first].emplace_back(Call.second, Call.first.second);
+            TotalCalls += Call.second;
+        }
+        std::vector<std::pair<uint64_t, uint64_t>> ByCalls;                             // (calls, function pointer)
+        for (auto &Target : Targets) {
+            uint64_t Calls = 0;
+            for (const auto &Before : Target.second) {
+                Calls += Before.first;
+            }
+            ByCalls.emplace_back(Calls, Target.first);
+            llvm::sort(Target.second, std::greater<std::pair<uint64_t, uint64_t>>());
+        }
+        llvm::sort(ByCalls, std::greater<std::pair<uint64_t, uint64_t>>());
+
+        OS << "\nindirect call targets (function pointer, calls, share, then the branches taken before them)\n";
+        for (const auto &Target : ByCalls) {
+            TraceEvent Event;
+            Event.Kind = TraceEvent::Call;
+            Event.Value = Target.second;
+            OS << TraceFile::format(Event) << " " << Target.first << " " << format("%.2f%%", percent(Target.first, TotalCalls)) << "\n";
+            for (const auto &Before : Targets[Target.second]) {
+                if (Before.second == NoBranch) {
+                    OS << "    " << Before.first << " at the start of the trace\n";
+                } else {
+                    OS << "    " << Before.first << " after br_" << Before.second << " " << text(Before.second) << "\n";
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Queries of trace_query with nothing to report must still end their response:
+# list with no trace open, occurrences of a branch that never ran, a window past
+# the end of the trace, spans of a function that never ran
+#
+# usage: trace_query_test.sh <trace_query> <BranchTracerRuntime.c>
+
+QUERY="$1"
+RUNTIME="$2"
+DIR=$(mktemp -d)
+SERVER=
+trap '[ -n "$SERVER" ] && kill $SERVER 2> /dev/null; rm -rf "$DIR"' EXIT
+
+# a trace of three events of br_1 and one of br_2
+printf 'void __bt_record(unsigned);\nint main(void) { __bt_record(1); __bt_record(1); __bt_record(2); __bt_record(1); return 0; }\n' > "$DIR/traced.c"
+${CC:-cc} "$DIR/traced.c" "$RUNTIME" -pthread -o "$DIR/traced" || exit 1
+BT_TRACE_FILE="$DIR/out.trace" "$DIR/traced" || exit 1
+
+"$QUERY" -socket="$DIR/socket" -serve &
+SERVER=$!
+for i in $(seq 50); do
+    [ -S "$DIR/socket" ] && break
+    sleep 0.1
+done
+
+failed=0
+# expect <response> <query words...>
+expect() {
+    local expected="$1" actual
+    shift
+    actual=$(timeout 5 "$QUERY" -socket="$DIR/socket" "$@")
+    if [ $? -eq 124 ]; then
+        echo "FAIL: \"$*\" did not return"
+        failed=1
+    elif [ "$actual" != "$expected" ]; then
+        echo "FAIL: \"$*\" answered \"$actual\", expected \"$expected\""
+        failed=1
+    fi
+}
+
+expect none list
+expect 3 count "$DIR/out.trace" br_1
+expect none occurrences "$DIR/out.trace" br_99999
+expect none window "$DIR/out.trace" 1000
+printf 'br_1: traced.c, 1, 1\nbr_2: traced.c, 1, 1\nfn_1: f, 1\nfn_2: g, 1\nfn_3: h, 1\n' > "$DIR/dictionary"
+expect ok open "$DIR/out.trace" "$DIR/dictionary"
+expect $'0-1\n3-3' spans "$DIR/out.trace" f
+expect 2-2 spans "$DIR/out.trace" g
+expect none spans "$DIR/out.trace" h
+expect "$DIR/out.trace" list
+expect ok shutdown
+wait $SERVER
+SERVER=
+
+[ $failed -eq 0 ] && echo "trace_query answered every query"
+exit $failed
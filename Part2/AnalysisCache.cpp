@@ -0,0 +1,413 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "AnalysisCache.h"
+#include "IOModels.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/xxhash.h"
+#include <algorithm>
+#include <functional>
+#include <set>
+
+using namespace llvm;
+
+// Bump when the analysis changes in a way that invalidates old results
+static const int64_t CacheVersion = 4;
+
+void AnalysisCache::load(StringRef Path)
+{
+    auto Buffer = MemoryBuffer::getFile(Path);
+    if (!Buffer) {
+        return;     // first run
+    }
+
+    Expected<json::Value> Parsed = json::parse((*Buffer)->getBuffer());
+    if (!Parsed) {
+        consumeError(Parsed.takeError());
+        errs() << "Warning: ignoring unreadable cache file " << Path << "\n";
+        return;
+    }
+
+    const json::Object *Root = Parsed->getAsObject();
+    const json::Object *Functions = Root ? Root->getObject("functions") : nullptr;
+    if (!Functions || Root->getInteger("version") != CacheVersion) {
+        return;
+    }
+
+    for (const auto &Function : *Functions) {
+        const json::Object *Object = Function.second.getAsObject();
+        Optional<StringRef> Key = Object ? Object->getString("key") : None;
+        const json::Array *Records = Object ? Object->getArray("records") : nullptr;
+        const json::Array *Anchors = Object ? Object->getArray("anchors") : nullptr;
+        const json::Object *Bases = Object ? Object->getObject("bases") : nullptr;
+        if (!Key || !Records || !Anchors || !Bases || Anchors->size() != Records->size()) {
+            continue;
+        }
+
+        Entry E;
+        if (!to_integer(*Key, E.Key, 16)) {
+            continue;
+        }
+        bool Valid = true;
+        for (const json::Value &Value : *Records) {
+            KeyPointRecord Record;
+            Valid &= FeatureReport::fromJSON(Value, Record);
+            E.Records.push_back(std::move(Record));
+        }
+        for (size_t i = 0; Valid && i < Anchors->size(); i++) {
+            const json::Array *Names = (*Anchors)[i].getAsArray();
+            Valid &= Names && Names->size() == E.Records[i].Features.size();
+            E.Anchors.emplace_back();
+            for (size_t j = 0; Valid && j < Names->size(); j++) {
+                Optional<StringRef> Name = (*Names)[j].getAsString();
+                Valid &= Name.hasValue();
+                E.Anchors.back().push_back(Name ? Name->str() : "");
+            }
+        }
+        for (const auto &Base : *Bases) {
+            Optional<int64_t> Line = Base.second.getAsInteger();
+            Valid &= Line.hasValue();
+            E.Bases[Base.first.str()] = Line ? *Line : 0;
+        }
+        if (Valid) {
+            Loaded[Function.first.str()] = std::move(E);
+        }
+    }
+}
+
+bool AnalysisCache::save(StringRef Path) const
+{
+    json::Object Functions;
+    for (const auto &Function : Current) {
+        const Entry &E = Function.getValue();
+        json::Array Records, Anchors;
+        for (const KeyPointRecord &Record : E.Records) {
+            Records.push_back(FeatureReport::toJSON(Record));
+        }
+        for (const std::vector<std::string> &Names : E.Anchors) {
+            Anchors.push_back(json::Array(Names));
+        }
+        json::Object Bases;
+        for (const auto &Base : E.Bases) {
+            Bases[Base.getKey()] = Base.getValue();
+        }
+        Functions[Function.getKey()] = json::Object{
+            {"key", utohexstr(E.Key)},
+            {"records", std::move(Records)},
+            {"anchors", std::move(Anchors)},
+            {"bases", std::move(Bases)},
+        };
+    }
+
+    std::error_code EC;
+    raw_fd_ostream OutFile(Path, EC, sys::fs::OF_Text);
+    if (EC) {
+        return false;
+    }
+    OutFile << json::Value(json::Object{
+        {"version", CacheVersion},
+        {"functions", std::move(Functions)},
+    }) << "\n";
+    return true;
+}
+
+uint64_t AnalysisCache::functionKey(const Function &F)
+{
+    std::string Buffer;
+    raw_string_ostream OS(Buffer);
+    OS << "v" << CacheVersion << " " << Options << "\n";
+    writeStructure(OS, F);
+    writeSourceText(OS, F);
+
+    // sources flowing in from callers and through pointer parameters
+    for (const Argument &A : F.args()) {
+        writeSources(OS, Taint.sourcesOf(&A));
+    }
+    writeSources(OS, Taint.memorySourcesOf(&F));
+
+    // globals read and callee summaries, in the order they appear
+    SmallPtrSet<const Value*, 8> Seen;
+    for (const Instruction &I : instructions(F)) {
+        if (const LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+            const GlobalVariable *GV = dyn_cast<GlobalVariable>(getUnderlyingObject(LI->getPointerOperand()));
+            if (GV && Seen.insert(GV).second) {
+                OS << "global " << GV->getName();
+                writeSources(OS, Taint.globalSourcesOf(GV));
+            }
+        } else if (const CallInst *CI = dyn_cast<CallInst>(&I)) {
+            const Function *Callee = CI->getCalledFunction();
+            if (Callee && !Callee->isDeclaration() && Seen.insert(Callee).second) {
+                OS << "callee " << Callee->getName() << " " << summaryHash(*Callee) << "\n";
+            } else if (Callee && Callee->isDeclaration()) {
+                // the model of the API (-ifd-api-models may change it) and what the call seeds
+                OS << "call " << Callee->getName();
+                if (const IOModel *Model = lookupIOModel(Callee->getName())) {
+                    OS << " model " << Model->Stream << " " << (int)Model->Return << " " << Model->Buffer
+                       << " " << Model->Values << " " << Model->Measures;
+                }
+                OS << "\n";
+                writeSources(OS, Taint.sourcesOf(CI));
+                writeSources(OS, Taint.streamsReadBy(CI));
+                for (const Value *Arg : CI->args()) {
+                    const Value *Object = Arg->getType()->isPointerTy() ? getUnderlyingObject(Arg) : nullptr;
+                    if (Object && isa<AllocaInst>(Object)) {
+                        writeSources(OS, Taint.sourcesOf(Object));
+                    } else if (const GlobalVariable *GV = dyn_cast_or_null<GlobalVariable>(Object)) {
+                        writeSources(OS, Taint.globalSourcesOf(GV));
+                    }
+                }
+            }
+        }
+    }
+
+    return xxHash64(OS.str());
+}
+
+const std::vector<KeyPointRecord> *AnalysisCache::lookup(const Function &F, uint64_t Key)
+{
+    auto It = Loaded.find(F.getName());
+    if (It == Loaded.end() || It->getValue().Key != Key) {
+        Misses++;
+        return nullptr;
+    }
+
+    // move the lines by as much as their functions moved
+    const Entry &Saved = It->getValue();
+    const Module &M = *F.getParent();
+    auto shift = [&](StringRef Name, unsigned &Line) {
+        if (Name.empty() || Line == 0) {
+            return true;
+        }
+        const Function *Anchor = M.getFunction(Name);
+        auto Base = Saved.Bases.find(Name);
+        if (!Anchor || Base == Saved.Bases.end()) {
+            return false;
+        }
+        Line = Line + baseLine(*Anchor) - Base->getValue();
+        return true;
+    };
+    std::vector<KeyPointRecord> Records = Saved.Records;
+    bool Valid = true;
+    for (size_t i = 0; i < Records.size(); i++) {
+        Valid &= shift(F.getName(), Records[i].Line);
+        for (size_t j = 0; j < Records[i].Features.size(); j++) {
+            Valid &= shift(Saved.Anchors[i][j], Records[i].Features[j].Line);
+        }
+    }
+    if (!Valid) {
+        Misses++;       // a function the records point into is gone
+        return nullptr;
+    }
+    Hits++;
+    insert(F, Key, std::move(Records));
+    return &Current[F.getName()].Records;
+}
+
+void AnalysisCache::insert(const Function &F, uint64_t Key, std::vector<KeyPointRecord> Records)
+{
+    Entry &E = Current[F.getName()];
+    E.Key = Key;
+    E.Records = std::move(Records);
+    E.Anchors.clear();
+    E.Bases.clear();
+    E.Bases[F.getName()] = baseLine(F);
+    for (const KeyPointRecord &Record : E.Records) {
+        E.Anchors.emplace_back();
+        for (const InputFeature &Feature : Record.Features) {
+            const Function *Anchor = Feature.Line ? functionAt(F, Feature.Line) : nullptr;
+            E.Anchors.back().push_back(Anchor ? Anchor->getName().str() : "");
+            if (Anchor) {
+                E.Bases[Anchor->getName()] = baseLine(*Anchor);
+            }
+        }
+    }
+}
+
+// The text of the lines of F's instructions, read the way the detector
+// reads the lines it quotes (the file name of the debug location, relative
+// to the working directory); a missing file or line hashes as empty
+void AnalysisCache::writeSourceText(raw_ostream &OS, const Function &F)
+{
+    std::set<std::pair<StringRef, unsigned>> Lines;
+    for (const Instruction &I : instructions(F)) {
+        if (const DebugLoc &Loc = I.getDebugLoc()) {
+            Lines.insert({Loc->getFilename(), Loc.getLine()});
+        }
+    }
+
+    for (const auto &Line : Lines) {
+        auto File = SourceFiles.find(Line.first);
+        if (File == SourceFiles.end()) {
+            std::vector<std::string> Text;
+            if (auto Buffer = MemoryBuffer::getFile(Line.first)) {
+                SmallVector<StringRef, 0> Split;
+                (*Buffer)->getBuffer().split(Split, '\n');
+                for (StringRef Line : Split) {
+                    Text.push_back(Line.str());
+                }
+            }
+            File = SourceFiles.try_emplace(Line.first, std::move(Text)).first;
+        }
+        const std::vector<std::string> &Text = File->getValue();
+        OS << "text " << Line.first << ":" << Line.second - baseLine(F) << " "
+           << (Line.second >= 1 && Line.second <= Text.size() ? Text[Line.second - 1] : "") << "\n";
+    }
+}
+
+unsigned AnalysisCache::baseLine(const Function &F)
+{
+    const DISubprogram *SP = F.getSubprogram();
+    return SP ? SP->getLine() : 0;
+}
+
+const Function *AnalysisCache::functionAt(const Function &F, unsigned Line)
+{
+    if (Ranges.empty()) {
+        for (const Function &G : *F.getParent()) {
+            unsigned First = baseLine(G), Last = First;
+            if (!First) {
+                continue;
+            }
+            for (const Instruction &I : instructions(G)) {
+                if (const DebugLoc &Loc = I.getDebugLoc()) {
+                    Last = std::max(Last, Loc.getLine());
+                }
+            }
+            Ranges.push_back({Last, &G});
+        }
+    }
+    const Function *Found = nullptr;
+    for (const auto &Range : Ranges) {
+        if (Line >= baseLine(*Range.second) && Line <= Range.first) {
+            if (Range.second == &F) {
+                return &F;
+            }
+            Found = Found ? Found : Range.second;
+        }
+    }
+    return Found;
+}
+
+uint64_t AnalysisCache::summaryHash(const Function &F)
+{
+    auto It = Summaries.find(&F);
+    if (It != Summaries.end()) {
+        return It->second;
+    }
+
+    std::string Buffer;
+    raw_string_ostream OS(Buffer);
+    writeSources(OS, Taint.returnSourcesOf(&F));
+    writeSources(OS, Taint.memorySourcesOf(&F));
+    uint64_t Hash = xxHash64(OS.str());
+    Summaries[&F] = Hash;
+    return Hash;
+}
+
+// Canonical text of F: values are named by their position in F so that
+// edits elsewhere in the module (new string constants, renumbered
+// metadata) do not change it
+void AnalysisCache::writeStructure(raw_ostream &OS, const Function &F) const
+{
+    unsigned Base = baseLine(F);
+    DenseMap<const Value*, unsigned> Local;
+    unsigned Index = 0;
+    for (const Argument &A : F.args()) {
+        Local[&A] = Index++;
+        OS << "arg " << *A.getType() << "\n";
+    }
+    for (const BasicBlock &BB : F) {
+        Local[&BB] = Index++;
+        for (const Instruction &I : BB) {
+            Local[&I] = Index++;
+        }
+    }
+
+    std::function<void(const Value*)> writeOperand = [&](const Value *V) {
+        auto It = Local.find(V);
+        if (It != Local.end()) {
+            OS << "%" << It->second;
+        } else if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(V)) {
+            // private string constants are identified by their contents
+            if (GV->hasPrivateLinkage() && GV->isConstant() && GV->hasInitializer()) {
+                writeOperand(GV->getInitializer());
+            } else {
+                OS << "@" << GV->getName();
+            }
+        } else if (const GlobalValue *G = dyn_cast<GlobalValue>(V)) {
+            OS << "@" << G->getName();
+        } else if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(V)) {
+            OS << CE->getOpcodeName() << "(";
+            for (const Value *Operand : CE->operands()) {
+                writeOperand(Operand);
+                OS << ",";
+            }
+            OS << ")";
+        } else if (isa<MetadataAsValue>(V)) {
+            OS << "metadata";
+        } else {
+            V->printAsOperand(OS, true);
+        }
+    };
+
+    for (const BasicBlock &BB : F) {
+        OS << "bb\n";
+        for (const Instruction &I : BB) {
+            OS << I.getOpcodeName() << " " << *I.getType();
+            if (const CmpInst *Cmp = dyn_cast<CmpInst>(&I)) {
+                OS << " " << CmpInst::getPredicateName(Cmp->getPredicate());
+            } else if (const AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
+                OS << " " << *AI->getAllocatedType();
+            } else if (const GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(&I)) {
+                OS << " " << *GEP->getSourceElementType();
+            }
+            for (const Value *Operand : I.operands()) {
+                OS << " ";
+                writeOperand(Operand);
+            }
+            if (const DebugLoc &Loc = I.getDebugLoc()) {
+                OS << " !" << (int)Loc.getLine() - (int)Base << ":" << Loc.getCol();
+            }
+            OS << "\n";
+        }
+    }
+}
+
+// Sources are written by what they stand for, not by their per-run IDs
+void AnalysisCache::writeSources(raw_ostream &OS, const TaintAnalysis::SourceSet *Sources) const
+{
+    std::vector<std::string> Names;
+    if (Sources) {
+        for (unsigned ID : *Sources) {
+            // lines relative to the function of the call that reads the source
+            const InputSource &Source = Taint.source(ID);
+            const Function *F = Source.Call ? Source.Call->getFunction() : nullptr;
+            int Line = F ? (int)Source.Line - (int)baseLine(*F) : (int)Source.Line;
+            Names.push_back((FeatureReport::kindName(Source.Kind) + ":" + Source.Name + ":" +
+                             (F ? F->getName() : "") + ":" + Twine(Line)).str());
+        }
+    }
+    std::sort(Names.begin(), Names.end());
+    OS << "[";
+    for (const std::string &Name : Names) {
+        OS << Name << ";";
+    }
+    OS << "]\n";
+}
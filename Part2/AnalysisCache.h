@@ -0,0 +1,107 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// AnalysisCache.h
+
+// On-disk cache of the key point records of each function, so that
+// re-running the detector after editing one function only re-analyzes
+// that function and the callers whose inputs changed.
+//
+// A function's records are reused when its key matches. The key hashes
+// the structure of the function's IR (opcodes, types, operands, constants
+// and debug locations, but not slot numbers or names of other functions'
+// values) together with everything the taint analysis feeds into it:
+// the sources reaching its parameters, the globals it loads and the
+// memory it reaches through pointers, the summary hash of every callee
+// (the sources flowing out of the callee's return value and pointer
+// arguments), the I/O model of every call to a declared function and
+// the sources the call seeds, and the detector options that change which
+// key points are reported (-ifd-selects). Descriptions quote source
+// lines, so the text of every line the function's instructions are on is
+// hashed too.
+//
+// Lines are hashed relative to the first line of their function, so
+// inserting lines above a function does not invalidate it. The lines of
+// cached records are moved by as much as the functions they point into
+// moved since the records were saved.
+
+#ifndef ANALYSIS_CACHE_H
+#define ANALYSIS_CACHE_H
+
+#include "FeatureReport.h"
+#include "TaintAnalysis.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+    class AnalysisCache {
+
+        public:
+            // Options are the detector options that change its records, part of every key
+            AnalysisCache(const TaintAnalysis &Taint, StringRef Options) : Taint(Taint), Options(Options.str()) {}
+
+            // Read a cache file, a missing or outdated file leaves the cache empty
+            void load(StringRef Path);
+
+            // Write the entries of the functions seen in this run
+            bool save(StringRef Path) const;
+
+            // Key of the analysis results of F
+            uint64_t functionKey(const Function &F);
+
+            // Records of F from the cache file if its key is unchanged, nullptr otherwise
+            const std::vector<KeyPointRecord> *lookup(const Function &F, uint64_t Key);
+
+            // Remember the records of F for the next run
+            void insert(const Function &F, uint64_t Key, std::vector<KeyPointRecord> Records);
+
+            unsigned hits() const { return Hits; }
+            unsigned misses() const { return Misses; }
+
+        private:
+            struct Entry {
+                uint64_t Key;
+                std::vector<KeyPointRecord> Records;
+                std::vector<std::vector<std::string>> Anchors;  // function of each feature's line, "" for none
+                StringMap<unsigned> Bases;                      // first line of those functions and of F
+            };
+
+            const TaintAnalysis &Taint;
+            std::string Options;
+            StringMap<Entry> Loaded;        // entries read from the cache file
+            StringMap<Entry> Current;       // entries of this run, written by save
+            DenseMap<const Function*, uint64_t> Summaries;
+            std::vector<std::pair<unsigned, const Function*>> Ranges;     // last line and function, by first line
+            StringMap<std::vector<std::string>> SourceFiles;              // lines of the source files read so far
+            unsigned Hits = 0;
+            unsigned Misses = 0;
+
+            // Hash of the sources flowing out of F into its callers
+            uint64_t summaryHash(const Function &F);
+
+            // First line of F in its file, 0 without debug info
+            static unsigned baseLine(const Function &F);
+
+            // Function of the module whose lines include Line, preferring F
+            const Function *functionAt(const Function &F, unsigned Line);
+
+            void writeStructure(raw_ostream &OS, const Function &F) const;
+            void writeSourceText(raw_ostream &OS, const Function &F);
+            void writeSources(raw_ostream &OS, const TaintAnalysis::SourceSet *Sources) const;
+    };
+
+}
+
+#endif // ANALYSIS_CACHE_H
@@ -0,0 +1,473 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// FeatureExtractor.cpp
+
+#include "FeatureExtractor.h"
+#include "IOModels.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include <set>
+#include <tuple>
+
+using namespace llvm;
+
+namespace {
+
+    // Calls that open, read or position an input stream, the criterion of the slice
+    bool isStreamCall(const CallBase *CB) {
+        const Function *Callee = CB->getCalledFunction();
+        if (!Callee || !Callee->isDeclaration()) {
+            return false;
+        }
+        const IOModel *Model = lookupIOModel(Callee->getName());
+        if (!Model) {
+            return false;
+        }
+        return Model->readsStream() || Model->Return == IORole::NewStream
+            || Callee->getName() == "fseek" || Callee->getName() == "rewind";
+    }
+
+    // The FILE* or descriptor a stream call reads is not memory of the program
+    bool isStreamArgument(const CallBase *CB, unsigned i) {
+        if (!isStreamCall(CB)) {
+            return false;
+        }
+        const IOModel *Model = lookupIOModel(CB->getCalledFunction()->getName());
+        return Model->Stream >= 0 ? i == (unsigned)Model->Stream : false;
+    }
+
+    // Calls that cannot write memory the slice reads: the other modeled
+    // I/O APIs (output, fclose, strlen) and functions that only read memory
+    bool writesNoMemory(const CallBase *CB) {
+        if (CB->onlyReadsMemory() || isa<DbgInfoIntrinsic>(CB)) {
+            return true;
+        }
+        const Function *Callee = CB->getCalledFunction();
+        return Callee && Callee->isDeclaration() && lookupIOModel(Callee->getName()) && !isStreamCall(CB);
+    }
+
+    // The local or global variable a pointer refers to, nullptr if unknown
+    const Value *memoryObject(const Value *Ptr) {
+        const Value *Object = getUnderlyingObject(Ptr);
+        return isa<AllocaInst>(Object) || isa<GlobalVariable>(Object) ? Object : nullptr;
+    }
+
+    // A character buffer filled by %s is not a numeric feature
+    bool isString(const Value *Ptr) {
+        const Value *Object = getUnderlyingObject(Ptr);
+        Type *Ty = nullptr;
+        if (const AllocaInst *AI = dyn_cast<AllocaInst>(Object)) {
+            Ty = AI->getAllocatedType();
+        } else if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(Object)) {
+            Ty = GV->getValueType();
+        }
+        return Ty && Ty->isArrayTy() && Ty->getArrayElementType()->isIntegerTy(8);
+    }
+
+    // Text of a printf format printing Text literally
+    std::string formatText(StringRef Text) {
+        std::string Format;
+        for (char C : Text) {
+            if (C == '%') {
+                Format += "%%";
+            } else if (C == '"' || C == '\\') {
+                Format += '\\';
+                Format += C;
+            } else {
+                Format += C;
+            }
+        }
+        return Format;
+    }
+}
+
+// Build the extractor in a copy of the module, M itself is not changed
+bool FeatureExtractor::writeToFile(const Module &M, const FeatureReport &Report, StringRef Path)
+{
+    Features.clear();
+    InputFunctions.clear();
+
+    ValueToValueMapTy VMap;
+    std::unique_ptr<Module> Clone = CloneModule(M, VMap);
+    Function *Main = Clone->getFunction("main");
+    if (!Main || Main->isDeclaration()) {
+        errs() << "Error: no main function to build the feature extractor from\n";
+        return false;
+    }
+
+    findInputFunctions(*Clone);
+    sliceMain(*Main);
+    recordFeatures(*Clone, Report, VMap);
+    emitPrinter(*Clone, *Main);
+
+    if (verifyModule(*Clone, &errs())) {
+        errs() << "Error: the feature extractor is not valid IR\n";
+        return false;
+    }
+
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+    if (EC) {
+        errs() << "Error: Could not open feature extractor file " << Path << "\n";
+        return false;
+    }
+    Clone->print(OS, nullptr);
+    return true;
+}
+
+// A function reads input if it calls a stream API, a function pointer
+// (conservatively) or a function that reads input
+void FeatureExtractor::findInputFunctions(Module &Clone)
+{
+    bool Changed = true;
+    while (Changed) {
+        Changed = false;
+        for (Function &F : Clone) {
+            if (F.isDeclaration() || InputFunctions.count(&F)) {
+                continue;
+            }
+            for (Instruction &I : instructions(F)) {
+                CallBase *CB = dyn_cast<CallBase>(&I);
+                if (!CB || CB->isInlineAsm()) {
+                    continue;
+                }
+                Function *Callee = CB->getCalledFunction();
+                if (isStreamCall(CB) || !Callee || InputFunctions.count(Callee)) {
+                    InputFunctions.insert(&F);
+                    Changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Backward slice of main from its input reading calls and its calls that
+// do not return. Memory dependences are tracked per local or global
+// variable: a kept load keeps every store and call that may write its
+// variable, and an access through an unknown pointer may touch any of
+// them. Conditional branches outside the slice jump straight to their
+// immediate post-dominator, the code only they reached becomes dead.
+void FeatureExtractor::sliceMain(Function &Main)
+{
+    // the exit status would pull in the computation the extractor skips
+    for (BasicBlock &BB : Main) {
+        ReturnInst *RI = dyn_cast_or_null<ReturnInst>(BB.getTerminator());
+        if (RI && RI->getReturnValue()) {
+            RI->setOperand(0, Constant::getNullValue(RI->getReturnValue()->getType()));
+        }
+    }
+
+    // Block B is control dependent on the branch of A if B post-dominates a
+    // successor of A but not A itself
+    PostDominatorTree PDT(Main);
+    DenseMap<const BasicBlock*, SmallVector<BasicBlock*, 2>> ControlDeps;
+    DenseMap<const BasicBlock*, BasicBlock*> Joins;
+    for (BasicBlock &A : Main) {
+        if (A.getTerminator()->getNumSuccessors() < 2 || !PDT.getNode(&A)) {
+            continue;
+        }
+        DomTreeNode *IPDom = PDT.getNode(&A)->getIDom();
+        Joins[&A] = IPDom ? IPDom->getBlock() : nullptr;
+        for (BasicBlock *S : successors(&A)) {
+            for (DomTreeNode *Runner = PDT.getNode(S); Runner && Runner != IPDom; Runner = Runner->getIDom()) {
+                if (Runner->getBlock()) {
+                    ControlDeps[Runner->getBlock()].push_back(&A);
+                }
+            }
+        }
+    }
+
+    SmallPtrSet<Instruction*, 32> Kept;
+    SmallVector<Instruction*, 64> Worklist;
+    auto keep = [&](Value *V) {
+        Instruction *I = dyn_cast<Instruction>(V);
+        if (I && I->getFunction() == &Main && Kept.insert(I).second) {
+            Worklist.push_back(I);
+        }
+    };
+
+    std::vector<StoreInst*> Stores;
+    std::vector<CallBase*> Writers;
+    for (Instruction &I : instructions(Main)) {
+        if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+            Stores.push_back(SI);
+        } else if (CallBase *CB = dyn_cast<CallBase>(&I)) {
+            if (!writesNoMemory(CB)) {
+                Writers.push_back(CB);
+            }
+            Function *Callee = CB->getCalledFunction();
+            if (isStreamCall(CB) || CB->doesNotReturn() || (!Callee && !CB->isInlineAsm()) || InputFunctions.count(Callee)) {
+                keep(CB);
+            }
+        } else if (Joins.count(I.getParent()) && I.isTerminator()) {
+            // a branch without a join point, or whose join point has phis, stays
+            BasicBlock *Join = Joins.lookup(I.getParent());
+            if (!Join || isa<PHINode>(Join->front())) {
+                keep(&I);
+            }
+        }
+    }
+
+    // Keep the stores and calls that may write Object, every variable if
+    // Object is nullptr, or every global variable if Globals is set
+    bool AllWritten = false, GlobalsWritten = false;
+    SmallPtrSet<const Value*, 16> Written;
+    auto keepWriters = [&](const Value *Object, bool Globals) {
+        if (AllWritten || (Globals && GlobalsWritten) || (Object && !Written.insert(Object).second)) {
+            return;
+        }
+        AllWritten |= !Object && !Globals;
+        GlobalsWritten |= Globals;
+        auto mayWrite = [&](const Value *Target) {
+            return !Target || (!Object && !Globals) || Target == Object || (Globals && isa<GlobalVariable>(Target));
+        };
+        for (StoreInst *SI : Stores) {
+            if (mayWrite(memoryObject(SI->getPointerOperand()))) {
+                keep(SI);
+            }
+        }
+        for (CallBase *CB : Writers) {
+            Function *Callee = CB->getCalledFunction();
+            bool Writes = !Callee || (!Callee->isDeclaration() && (!Object || isa<GlobalVariable>(Object)));
+            for (unsigned i = 0; i < CB->arg_size(); i++) {
+                Value *Arg = CB->getArgOperand(i);
+                Writes |= Arg->getType()->isPointerTy() && !isStreamArgument(CB, i) && mayWrite(memoryObject(Arg));
+            }
+            if (Writes) {
+                keep(CB);
+            }
+        }
+    };
+
+    while (!Worklist.empty()) {
+        Instruction *I = Worklist.pop_back_val();
+        for (Value *Operand : I->operands()) {
+            keep(Operand);
+        }
+        if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+            keepWriters(memoryObject(LI->getPointerOperand()), false);
+        } else if (CallBase *CB = dyn_cast<CallBase>(I)) {
+            for (unsigned i = 0; i < CB->arg_size(); i++) {
+                Value *Arg = CB->getArgOperand(i);
+                if (Arg->getType()->isPointerTy() && !isStreamArgument(CB, i)) {
+                    keepWriters(memoryObject(Arg), false);
+                }
+            }
+            Function *Callee = CB->getCalledFunction();
+            if (!Callee || !Callee->isDeclaration()) {
+                keepWriters(nullptr, true);     // the callee may read any global variable
+            }
+        } else if (PHINode *PN = dyn_cast<PHINode>(I)) {
+            for (BasicBlock *Incoming : PN->blocks()) {
+                keep(Incoming->getTerminator());
+            }
+        }
+        for (BasicBlock *A : ControlDeps.lookup(I->getParent())) {
+            keep(A->getTerminator());
+        }
+    }
+
+    for (auto &Entry : Joins) {
+        BasicBlock *A = const_cast<BasicBlock*>(Entry.first);
+        Instruction *T = A->getTerminator();
+        if (!Kept.count(T)) {
+            BranchInst::Create(Entry.second, T);
+            T->eraseFromParent();
+        }
+    }
+
+    std::vector<Instruction*> Dead;
+    for (Instruction &I : instructions(Main)) {
+        if (!I.isTerminator() && !isa<AllocaInst>(I) && !Kept.count(&I)) {
+            Dead.push_back(&I);
+        }
+    }
+    for (Instruction *I : Dead) {
+        I->replaceAllUsesWith(UndefValue::get(I->getType()));
+    }
+    for (Instruction *I : Dead) {
+        I->eraseFromParent();
+    }
+    removeUnreachableBlocks(Main);
+}
+
+// Record the numeric features of the report where their sources are read:
+// the variable a scalar is scanned into, the size of a stream after it is
+// opened (or first read, for streams opened elsewhere), and the length of
+// stdin at the entry of main
+void FeatureExtractor::recordFeatures(Module &Clone, const FeatureReport &Report, ValueToValueMapTy &VMap)
+{
+    std::set<std::tuple<FeatureKind, std::string, unsigned>> Wanted;
+    for (const KeyPointRecord &Record : Report.records()) {
+        for (const InputFeature &Feature : Record.Features) {
+            if (Feature.Kind == FeatureKind::ScalarValue || Feature.Kind == FeatureKind::FileSize || Feature.Kind == FeatureKind::StdinLength) {
+                Wanted.emplace(Feature.Kind, Feature.Name, Feature.Line);
+            }
+        }
+    }
+
+    LLVMContext &Context = Clone.getContext();
+    Type *Int8Ptr = Type::getInt8PtrTy(Context);
+    Type *Int64 = Type::getInt64Ty(Context);
+    Function *Main = Clone.getFunction("main");
+
+    for (unsigned ID = 0; ID < Taint.numSources(); ID++) {
+        const InputSource &Source = Taint.source(ID);
+        if (!Wanted.count(std::make_tuple(Source.Kind, Source.Name, Source.Line))) {
+            continue;
+        }
+
+        if (Source.Kind == FeatureKind::StdinLength) {
+            IRBuilder<> IRB(&*Main->getEntryBlock().getFirstInsertionPt());
+            Constant *Stdin = Clone.getOrInsertGlobal("stdin", Int8Ptr);
+            Value *Size = IRB.CreateCall(getStreamSize(Clone), {IRB.CreateLoad(Int8Ptr, IRB.CreatePointerCast(Stdin, Int8Ptr->getPointerTo()))});
+            Feature &F = getFeature(Clone, Source.Kind, Source.Name, false);
+            IRB.CreateStore(Size, F.Value);
+            IRB.CreateStore(IRB.CreateICmpSGE(Size, ConstantInt::get(Int64, 0)), F.Known);
+            continue;
+        }
+
+        CallInst *Call = cast_or_null<CallInst>(VMap.lookup(Source.Call));
+        if (!Call || (Source.Operand != ~0u && Source.Operand >= Call->arg_size())) {
+            continue;
+        }
+        Value *Input = Source.Operand == ~0u ? Call : Call->getArgOperand(Source.Operand);
+
+        if (Source.Kind == FeatureKind::ScalarValue) {
+            Type *Ty = Input->getType()->getPointerElementType();
+            if ((!Ty->isIntegerTy() && !Ty->isFloatingPointTy()) || isString(Input)) {
+                errs() << "Warning: feature " << Source.Name << " on line " << Source.Line << " is not a number, it is not extracted\n";
+                continue;
+            }
+            IRBuilder<> IRB(Call->getNextNode());
+            IRB.SetCurrentDebugLocation(Call->getDebugLoc());
+            Value *Scanned = IRB.CreateLoad(Ty, Input);
+            Feature &F = getFeature(Clone, Source.Kind, Source.Name, Ty->isFloatingPointTy());
+            if (Ty->isFloatingPointTy()) {
+                Scanned = IRB.CreateFPCast(Scanned, IRB.getDoubleTy());
+            } else {
+                Scanned = IRB.CreateIntCast(Scanned, Int64, !Ty->isIntegerTy(1));
+            }
+            IRB.CreateStore(Scanned, F.Value);
+            IRB.CreateStore(IRB.getTrue(), F.Known);
+        } else if (!Input->getType()->isPointerTy()) {
+            errs() << "Warning: file " << Source.Name << " on line " << Source.Line << " is a descriptor, its size is not extracted\n";
+        } else {
+            // a stream opened elsewhere is measured once, at its first read
+            Feature &F = getFeature(Clone, Source.Kind, Source.Name, false);
+            Instruction *At = Call->getNextNode();
+            if (Source.Operand != ~0u) {
+                IRBuilder<> IRB(At);
+                At = SplitBlockAndInsertIfThen(IRB.CreateNot(IRB.CreateLoad(IRB.getInt1Ty(), F.Known)), At, false);
+            }
+            IRBuilder<> IRB(At);
+            IRB.SetCurrentDebugLocation(Call->getDebugLoc());
+            Value *Size = IRB.CreateCall(getStreamSize(Clone), {IRB.CreatePointerCast(Input, Int8Ptr)});
+            IRB.CreateStore(Size, F.Value);
+            IRB.CreateStore(IRB.CreateICmpSGE(Size, ConstantInt::get(Int64, 0)), F.Known);
+        }
+    }
+}
+
+FeatureExtractor::Feature &FeatureExtractor::getFeature(Module &Clone, FeatureKind Kind, const std::string &Name, bool Floating)
+{
+    std::string Key = (FeatureReport::kindName(Kind) + ":" + Name).str();
+    for (Feature &F : Features) {
+        if (F.Key == Key) {
+            return F;
+        }
+    }
+
+    LLVMContext &Context = Clone.getContext();
+    Type *Ty = Floating ? Type::getDoubleTy(Context) : Type::getInt64Ty(Context);
+    Type *Flag = Type::getInt1Ty(Context);
+    Feature F;
+    F.Key = Key;
+    F.Kind = Kind;
+    F.Value = new GlobalVariable(Clone, Ty, false, GlobalValue::InternalLinkage, Constant::getNullValue(Ty), "ifd.feature");
+    F.Known = new GlobalVariable(Clone, Flag, false, GlobalValue::InternalLinkage, ConstantInt::getFalse(Context), "ifd.known");
+    Features.push_back(F);
+    return Features.back();
+}
+
+// ifd.print_features prints {"<key>": <value or null>, ...} on stdout, at
+// the exit of the program however it exits
+void FeatureExtractor::emitPrinter(Module &Clone, Function &Main)
+{
+    LLVMContext &Context = Clone.getContext();
+    Type *Int32 = Type::getInt32Ty(Context);
+    Function *Printer = Function::Create(FunctionType::get(Type::getVoidTy(Context), false), GlobalValue::InternalLinkage, "ifd.print_features", Clone);
+    FunctionCallee Printf = Clone.getOrInsertFunction("printf", FunctionType::get(Int32, {Type::getInt8PtrTy(Context)}, true));
+
+    IRBuilder<> IRB(BasicBlock::Create(Context, "entry", Printer));
+    IRB.CreateCall(Printf, {IRB.CreateGlobalStringPtr("{", "ifd.format")});
+    for (size_t i = 0; i < Features.size(); i++) {
+        const Feature &F = Features[i];
+        std::string Prefix = (i ? ", \"" : "\"") + formatText(F.Key) + "\": ";
+        Type *Ty = F.Value->getValueType();
+        Value *Format = IRB.CreateSelect(IRB.CreateLoad(F.Known->getValueType(), F.Known),
+                                         IRB.CreateGlobalStringPtr(Prefix + (Ty->isDoubleTy() ? "%.17g" : "%lld"), "ifd.format"),
+                                         IRB.CreateGlobalStringPtr(Prefix + "null", "ifd.format"));
+        IRB.CreateCall(Printf, {Format, IRB.CreateLoad(Ty, F.Value)});
+    }
+    IRB.CreateCall(Printf, {IRB.CreateGlobalStringPtr("}\n", "ifd.format")});
+    IRB.CreateRetVoid();
+
+    FunctionCallee Atexit = Clone.getOrInsertFunction("atexit", FunctionType::get(Int32, {Printer->getType()}, false));
+    IRBuilder<> Entry(&*Main.getEntryBlock().getFirstInsertionPt());
+    Entry.CreateCall(Atexit, {Printer});
+}
+
+Function *FeatureExtractor::getStreamSize(Module &Clone)
+{
+    if (Function *F = Clone.getFunction("ifd.stream_size")) {
+        return F;
+    }
+
+    LLVMContext &Context = Clone.getContext();
+    Type *Int8Ptr = Type::getInt8PtrTy(Context);
+    Type *Int64 = Type::getInt64Ty(Context);
+    Type *Int32 = Type::getInt32Ty(Context);
+    Function *F = Function::Create(FunctionType::get(Int64, {Int8Ptr}, false), GlobalValue::InternalLinkage, "ifd.stream_size", Clone);
+    FunctionCallee Ftell = Clone.getOrInsertFunction("ftell", FunctionType::get(Int64, {Int8Ptr}, false));
+    FunctionCallee Fseek = Clone.getOrInsertFunction("fseek", FunctionType::get(Int32, {Int8Ptr, Int64, Int32}, false));
+
+    // seek to the end and back, a stream that cannot seek (a pipe) has no size
+    Argument *Stream = F->getArg(0);
+    BasicBlock *Entry = BasicBlock::Create(Context, "entry", F);
+    BasicBlock *Measure = BasicBlock::Create(Context, "measure", F);
+    BasicBlock *Unknown = BasicBlock::Create(Context, "unknown", F);
+    IRBuilder<> IRB(Entry);
+    IRB.CreateCondBr(IRB.CreateIsNull(Stream), Unknown, Measure);
+
+    IRB.SetInsertPoint(Measure);
+    Value *Position = IRB.CreateCall(Ftell, {Stream});
+    Value *Seeked = IRB.CreateCall(Fseek, {Stream, ConstantInt::get(Int64, 0), ConstantInt::get(Int32, 2)});
+    Value *Size = IRB.CreateCall(Ftell, {Stream});
+    IRB.CreateCall(Fseek, {Stream, Position, ConstantInt::get(Int32, 0)});
+    Value *Measured = IRB.CreateAnd(IRB.CreateICmpSGE(Position, ConstantInt::get(Int64, 0)), IRB.CreateICmpEQ(Seeked, ConstantInt::get(Int32, 0)));
+    IRB.CreateRet(IRB.CreateSelect(Measured, Size, ConstantInt::get(Int64, -1)));
+
+    IRB.SetInsertPoint(Unknown);
+    IRB.CreateRet(ConstantInt::get(Int64, -1));
+    return F;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// FeatureExtractor.h
+
+// Lightweight feature extractors generated from the input feature report.
+// The extractor of a program is a copy of its module in which main is cut
+// down to a backward slice of the code that reads the input: the calls to
+// I/O APIs and to functions that (transitively) read input, plus the
+// instructions and branches those depend on through def-use chains,
+// memory and control dependence. Output and the work the input drives
+// are removed, so the extractor runs in the time it takes to read the
+// input.
+//
+// The value of every numeric seminal feature (scalar values, file sizes
+// and the stdin length) is copied into a shadow global right after the
+// call that reads it, and an atexit handler prints all of them as one
+// JSON object, e.g.
+//   {"scalar_value:n": 100, "file_size:fp": 5120, "stdin_length:stdin": 12}
+// the same form cost_sweep.sh reads from <input>.features. Functions
+// other than main are kept whole.
+
+#ifndef FEATURE_EXTRACTOR_H
+#define FEATURE_EXTRACTOR_H
+
+#include "FeatureReport.h"
+#include "TaintAnalysis.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+    class FeatureExtractor {
+
+        public:
+            explicit FeatureExtractor(const TaintAnalysis &Taint) : Taint(Taint) {}
+
+            // Write the extractor of M for the features of Report to Path as
+            // textual IR, returns false if it cannot be built or written
+            bool writeToFile(const Module &M, const FeatureReport &Report, StringRef Path);
+
+        private:
+            // A feature printed by the extractor, filled in where it is read
+            struct Feature {
+                std::string Key;                    // "<kind>:<name>", as in the runs of cost_model
+                FeatureKind Kind;
+                GlobalVariable *Value = nullptr;    // i64, or double for floating point scalars
+                GlobalVariable *Known = nullptr;    // i1, set once the value was read
+            };
+
+            const TaintAnalysis &Taint;
+            std::vector<Feature> Features;
+
+            // Functions that read input through an I/O API, directly or through their callees
+            SmallPtrSet<const Function*, 16> InputFunctions;
+
+            void findInputFunctions(Module &Clone);
+
+            // Cut main down to the backward slice of its input reading calls
+            void sliceMain(Function &Main);
+
+            // Copy the features read by the sources of the report into shadow globals
+            void recordFeatures(Module &Clone, const FeatureReport &Report, ValueToValueMapTy &VMap);
+
+            // Shadow globals of a feature, created on first use
+            Feature &getFeature(Module &Clone, FeatureKind Kind, const std::string &Name, bool Floating);
+
+            // Emit the atexit handler printing the features and register it at the entry of main
+            void emitPrinter(Module &Clone, Function &Main);
+
+            // ifd.stream_size(FILE*): length of a stream, -1 if it cannot be measured
+            Function *getStreamSize(Module &Clone);
+    };
+
+}
+
+#endif // FEATURE_EXTRACTOR_H
@@ -0,0 +1,251 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "FeatureReport.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <algorithm>
+#include <tuple>
+
+using namespace llvm;
+
+// Add a record to the report
+void FeatureReport::add(KeyPointRecord Record) {
+    Records.push_back(std::move(Record));
+}
+
+// Sort records by (file, line, column, kind) and assign dense IDs in that order
+// so that two runs over the same source give identical output
+void FeatureReport::finalize() {
+    std::stable_sort(Records.begin(), Records.end(),
+        [](const KeyPointRecord &A, const KeyPointRecord &B) {
+            return std::tie(A.File, A.Line, A.Column, A.Kind) <
+                   std::tie(B.File, B.Line, B.Column, B.Kind);
+        });
+
+    for (unsigned i = 0; i < Records.size(); i++) {
+        Records[i].ID = i;
+    }
+}
+
+StringRef FeatureReport::kindName(KeyPointKind Kind) {
+    switch (Kind) {
+        case KeyPointKind::Branch:      return "branch";
+        case KeyPointKind::IfElse:      return "if_else";
+        case KeyPointKind::Loop:        return "loop";
+        case KeyPointKind::IOCall:      return "io_call";
+        case KeyPointKind::Switch:      return "switch";
+        case KeyPointKind::Select:      return "select";
+        case KeyPointKind::IndirectBranch: return "indirect_branch";
+    }
+    return "unknown";
+}
+
+StringRef FeatureReport::kindName(FeatureKind Kind) {
+    switch (Kind) {
+        case FeatureKind::ScalarValue:      return "scalar_value";
+        case FeatureKind::FileSize:         return "file_size";
+        case FeatureKind::StdinLength:      return "stdin_length";
+        case FeatureKind::FileContent:      return "file_content";
+        case FeatureKind::StdinContent:     return "stdin_content";
+        case FeatureKind::Constant:         return "constant";
+        case FeatureKind::Argument:         return "argument";
+        case FeatureKind::CallResult:       return "call_result";
+        case FeatureKind::SourceExpression: return "source_expression";
+    }
+    return "unknown";
+}
+
+void FeatureReport::write(raw_ostream &OS, ReportFormat Format) const {
+    switch (Format) {
+        case ReportFormat::JSONLines:   writeJSONLines(OS); break;
+        case ReportFormat::Binary:      writeBinary(OS);    break;
+        case ReportFormat::Text:        writeText(OS);      break;
+    }
+}
+
+bool FeatureReport::writeToFile(StringRef Path, ReportFormat Format) const {
+    std::error_code EC;
+    sys::fs::OpenFlags Flags = Format == ReportFormat::Binary ? sys::fs::OF_None : sys::fs::OF_Text;
+    raw_fd_ostream OutFile(Path, EC, Flags);
+    if (EC) {
+        return false;
+    }
+    write(OutFile, Format);
+    return true;
+}
+
+bool FeatureReport::readFromFile(StringRef Path) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+    if (!Buffer) {
+        return false;
+    }
+    Records.clear();
+    SmallVector<StringRef, 16> Lines;
+    (*Buffer)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+    for (StringRef Line : Lines) {
+        Expected<json::Value> Parsed = json::parse(Line);
+        KeyPointRecord Record;
+        if (!Parsed) {
+            consumeError(Parsed.takeError());
+            return false;
+        }
+        if (!fromJSON(*Parsed, Record)) {
+            return false;
+        }
+        Records.push_back(std::move(Record));
+    }
+    return true;
+}
+
+// One JSON object per line:
+// {"id":0,"file":"ex.c","line":6,"column":23,"kind":"branch","description":"i compared to n",
+//  "features":[{"kind":"scalar_value","name":"n","line":0}, ...]}
+void FeatureReport::writeJSONLines(raw_ostream &OS) const {
+    for (const KeyPointRecord &R : Records) {
+        OS << toJSON(R) << "\n";
+    }
+}
+
+json::Value FeatureReport::toJSON(const KeyPointRecord &R) {
+    json::Array Features;
+    for (const InputFeature &IF : R.Features) {
+        Features.push_back(json::Object{
+            {"kind", kindName(IF.Kind)},
+            {"name", IF.Name},
+            {"line", IF.Line},
+        });
+    }
+    return json::Object{
+        {"id", R.ID},
+        {"file", R.File},
+        {"line", R.Line},
+        {"column", R.Column},
+        {"kind", kindName(R.Kind)},
+        {"description", R.Description},
+        {"features", std::move(Features)},
+    };
+}
+
+// Find the enumerator whose kindName is Name
+template <typename KindT>
+static bool parseKind(StringRef Name, KindT &Kind) {
+    for (unsigned i = 0; i <= static_cast<unsigned>(KindT::LastKind); i++) {
+        if (FeatureReport::kindName(static_cast<KindT>(i)) == Name) {
+            Kind = static_cast<KindT>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FeatureReport::fromJSON(const json::Value &Value, KeyPointRecord &R) {
+    const json::Object *Object = Value.getAsObject();
+    if (!Object) {
+        return false;
+    }
+
+    Optional<int64_t> ID = Object->getInteger("id");
+    Optional<StringRef> File = Object->getString("file");
+    Optional<int64_t> Line = Object->getInteger("line");
+    Optional<int64_t> Column = Object->getInteger("column");
+    Optional<StringRef> Kind = Object->getString("kind");
+    Optional<StringRef> Description = Object->getString("description");
+    const json::Array *Features = Object->getArray("features");
+    if (!ID || !File || !Line || !Column || !Kind || !Description || !Features || !parseKind(*Kind, R.Kind)) {
+        return false;
+    }
+    R.ID = *ID;
+    R.File = File->str();
+    R.Line = *Line;
+    R.Column = *Column;
+    R.Description = Description->str();
+
+    R.Features.clear();
+    for (const json::Value &Entry : *Features) {
+        const json::Object *FeatureObject = Entry.getAsObject();
+        if (!FeatureObject) {
+            return false;
+        }
+        InputFeature IF;
+        Optional<StringRef> FeatureKindName = FeatureObject->getString("kind");
+        Optional<StringRef> Name = FeatureObject->getString("name");
+        Optional<int64_t> FeatureLine = FeatureObject->getInteger("line");
+        if (!FeatureKindName || !Name || !FeatureLine || !parseKind(*FeatureKindName, IF.Kind)) {
+            return false;
+        }
+        IF.Name = Name->str();
+        IF.Line = *FeatureLine;
+        R.Features.push_back(IF);
+    }
+    return true;
+}
+
+// Compact little-endian binary form:
+//   "IFDR" u32 version
+//   u32 #strings, then per string: u32 length, bytes
+//   u32 #records, then per record:
+//     u32 id, u32 file, u32 line, u32 column, u8 kind, u32 description, u32 #features
+//     per feature: u8 kind, u32 name, u32 line
+// file, description and name are indices into the string table.
+void FeatureReport::writeBinary(raw_ostream &OS) const {
+    StringMap<uint32_t> StringIDs;
+    std::vector<StringRef> Strings;
+    auto intern = [&](StringRef S) {
+        auto Inserted = StringIDs.try_emplace(S, Strings.size());
+        if (Inserted.second) {
+            Strings.push_back(Inserted.first->getKey());
+        }
+        return Inserted.first->getValue();
+    };
+
+    for (const KeyPointRecord &R : Records) {
+        intern(R.File);
+        intern(R.Description);
+        for (const InputFeature &IF : R.Features) {
+            intern(IF.Name);
+        }
+    }
+
+    support::endian::Writer W(OS, support::little);
+    OS << "IFDR";
+    W.write<uint32_t>(1);
+
+    W.write<uint32_t>(Strings.size());
+    for (StringRef S : Strings) {
+        W.write<uint32_t>(S.size());
+        OS << S;
+    }
+
+    W.write<uint32_t>(Records.size());
+    for (const KeyPointRecord &R : Records) {
+        W.write<uint32_t>(R.ID);
+        W.write<uint32_t>(StringIDs.lookup(R.File));
+        W.write<uint32_t>(R.Line);
+        W.write<uint32_t>(R.Column);
+        W.write<uint8_t>(static_cast<uint8_t>(R.Kind));
+        W.write<uint32_t>(StringIDs.lookup(R.Description));
+        W.write<uint32_t>(R.Features.size());
+        for (const InputFeature &IF : R.Features) {
+            W.write<uint8_t>(static_cast<uint8_t>(IF.Kind));
+            W.write<uint32_t>(StringIDs.lookup(IF.Name));
+            W.write<uint32_t>(IF.Line);
+        }
+    }
+}
+
+// The original human readable format, e.g. "Line 4: n"
+void FeatureReport::writeText(raw_ostream &OS) const {
+    for (const KeyPointRecord &R : Records) {
+        OS << "Line " << R.Line << ": " << R.Description << "\n";
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// FeatureReport.h
+
+// Structured result model for the input feature detector.
+// Each key point (branch, I/O call, ...) found by the analysis becomes one
+// KeyPointRecord holding the input features that influence it. The report
+// is sorted by source location so the output does not depend on module
+// iteration order, and can be written as JSON Lines, a compact binary
+// form, or the original "Line N: ..." text.
+
+#ifndef FEATURE_REPORT_H
+#define FEATURE_REPORT_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+    // What kind of program point a record describes
+    enum class KeyPointKind : uint8_t {
+        Branch,         // conditional branch (loop condition, ternary, ...)
+        IfElse,         // conditional branch of an if / else if statement
+        Loop,           // trip count of a loop
+        IOCall,         // call to an input API (fopen, getc, ...)
+        Switch,         // switch statement
+        Select,         // branch-free conditional (select instruction)
+        IndirectBranch, // computed goto
+        LastKind = IndirectBranch
+    };
+
+    // What part of the input a feature stands for
+    enum class FeatureKind : uint8_t {
+        ScalarValue,        // value of a variable, e.g. n read by scanf
+        FileSize,           // size (length) of a file stream
+        StdinLength,        // length of the standard input
+        FileContent,        // characters read from a file stream
+        StdinContent,       // characters read from the standard input
+        Constant,           // constant operand of a key point
+        Argument,           // function argument
+        CallResult,         // return value of a call
+        SourceExpression,   // condition text taken from the source line
+        LastKind = SourceExpression
+    };
+
+    // Output formats understood by FeatureReport::write
+    enum class ReportFormat {
+        JSONLines,
+        Binary,
+        Text
+    };
+
+    struct InputFeature {
+        FeatureKind Kind;
+        std::string Name;           // variable / stream name or expression text
+        unsigned Line = 0;          // line the feature is defined on, 0 if unknown
+    };
+
+    struct KeyPointRecord {
+        unsigned ID = 0;            // assigned by FeatureReport::finalize
+        std::string File;
+        unsigned Line = 0;
+        unsigned Column = 0;
+        KeyPointKind Kind;
+        std::string Description;    // human readable text used by the text format
+        std::vector<InputFeature> Features;
+    };
+
+    class FeatureReport {
+
+        public:
+            // Add a record, the ID is assigned later by finalize
+            void add(KeyPointRecord Record);
+
+            // Sort records by source location and number them densely
+            void finalize();
+
+            const std::vector<KeyPointRecord> &records() const { return Records; }
+
+            // Serialize all records in the given format
+            void write(raw_ostream &OS, ReportFormat Format) const;
+
+            // Write all records to a file, returns false if it cannot be opened
+            bool writeToFile(StringRef Path, ReportFormat Format) const;
+
+            // Read the records of a JSON Lines report, returns false if it cannot be read
+            bool readFromFile(StringRef Path);
+
+            static StringRef kindName(KeyPointKind Kind);
+            static StringRef kindName(FeatureKind Kind);
+
+            // JSON form of a record, as written in the JSON Lines report
+            static json::Value toJSON(const KeyPointRecord &Record);
+            static bool fromJSON(const json::Value &Value, KeyPointRecord &Record);
+
+        private:
+            std::vector<KeyPointRecord> Records;
+
+            void writeJSONLines(raw_ostream &OS) const;
+            void writeBinary(raw_ostream &OS) const;
+            void writeText(raw_ostream &OS) const;
+    };
+
+}
+
+#endif // FEATURE_REPORT_H
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "IOModels.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> ExtraModels("ifd-api-models",
+    cl::desc("JSON file with additional I/O API models"),
+    cl::value_desc("filename"), cl::init(""));
+
+namespace {
+
+    const int S = IOModel::Stdin;
+    const int NS = IOModel::NoStream;
+    const int X = IOModel::None;
+
+    struct ModelRow {
+        const char *Name;
+        int Stream;
+        IORole Return;
+        int Buffer;
+        int Values;
+        int Measures;
+    };
+
+    //  name                stream  return                  buffer  values  measures
+    const ModelRow ModelTable[] = {
+        // opening and closing streams
+        {"fopen",           NS,     IORole::NewStream,      X,      X,      X},
+        {"fopen64",         NS,     IORole::NewStream,      X,      X,      X},
+        {"fdopen",          NS,     IORole::NewStream,      X,      X,      X},
+        {"freopen",         NS,     IORole::NewStream,      X,      X,      X},
+        {"open",            NS,     IORole::NewStream,      X,      X,      X},
+        {"open64",          NS,     IORole::NewStream,      X,      X,      X},
+        {"fclose",          NS,     IORole::None,           X,      X,      X},
+        {"close",           NS,     IORole::None,           X,      X,      X},
+
+        // character and line input
+        {"getc",            0,      IORole::Content,        X,      X,      X},
+        {"_IO_getc",        0,      IORole::Content,        X,      X,      X},
+        {"fgetc",           0,      IORole::Content,        X,      X,      X},
+        {"getchar",         S,      IORole::Content,        X,      X,      X},
+        {"gets",            S,      IORole::Content,        0,      X,      X},
+        {"fgets",           2,      IORole::Content,        0,      X,      X},
+        {"getline",         2,      IORole::Length,         0,      X,      X},
+
+        // block input
+        {"fread",           3,      IORole::Length,         0,      X,      X},
+        {"read",            0,      IORole::Length,         1,      X,      X},
+
+        // formatted input
+        {"scanf",           S,      IORole::Length,         X,      1,      X},
+        {"__isoc99_scanf",  S,      IORole::Length,         X,      1,      X},
+        {"fscanf",          0,      IORole::Length,         X,      2,      X},
+        {"__isoc99_fscanf", 0,      IORole::Length,         X,      2,      X},
+
+        // end of stream and position queries
+        {"feof",            0,      IORole::Length,         X,      X,      X},
+        {"ftell",           0,      IORole::Length,         X,      X,      X},
+        {"fseek",           NS,     IORole::None,           X,      X,      X},
+        {"rewind",          NS,     IORole::None,           X,      X,      X},
+
+        // output never carries input
+        {"fwrite",          NS,     IORole::None,           X,      X,      X},
+        {"write",           NS,     IORole::None,           X,      X,      X},
+        {"fputc",           NS,     IORole::None,           X,      X,      X},
+        {"putc",            NS,     IORole::None,           X,      X,      X},
+        {"putchar",         NS,     IORole::None,           X,      X,      X},
+        {"fputs",           NS,     IORole::None,           X,      X,      X},
+        {"puts",            NS,     IORole::None,           X,      X,      X},
+        {"printf",          NS,     IORole::None,           X,      X,      X},
+        {"fprintf",         NS,     IORole::None,           X,      X,      X},
+        {"fflush",          NS,     IORole::None,           X,      X,      X},
+        {"perror",          NS,     IORole::None,           X,      X,      X},
+
+        // length of content already read
+        {"strlen",          NS,     IORole::Length,         X,      X,      0},
+    };
+
+    bool parseRole(StringRef Name, IORole &Role) {
+        if (Name == "none")         Role = IORole::None;
+        else if (Name == "content") Role = IORole::Content;
+        else if (Name == "length")  Role = IORole::Length;
+        else if (Name == "stream")  Role = IORole::NewStream;
+        else return false;
+        return true;
+    }
+
+    // Read additional models from a JSON array of objects, e.g.
+    // {"name": "getline", "stream": 2, "return": "length", "buffer": 0}
+    // "stream" is an argument index, "stdin" or omitted for calls reading no stream
+    void loadModels(StringRef Path, StringMap<IOModel> &Models) {
+        auto Buffer = MemoryBuffer::getFile(Path);
+        if (!Buffer) {
+            errs() << "Error: Could not open API model file " << Path << "\n";
+            return;
+        }
+
+        Expected<json::Value> Parsed = json::parse((*Buffer)->getBuffer());
+        if (!Parsed) {
+            errs() << "Error: " << Path << ": " << toString(Parsed.takeError()) << "\n";
+            return;
+        }
+
+        const json::Array *Entries = Parsed->getAsArray();
+        if (!Entries) {
+            errs() << "Error: " << Path << ": expected an array of API models\n";
+            return;
+        }
+
+        for (const json::Value &Entry : *Entries) {
+            const json::Object *Object = Entry.getAsObject();
+            Optional<StringRef> Name = Object ? Object->getString("name") : None;
+            if (!Name) {
+                errs() << "Error: " << Path << ": API model without a name\n";
+                continue;
+            }
+
+            IOModel Model;
+            Model.Name = Name->str();
+            if (Optional<StringRef> Stream = Object->getString("stream")) {
+                Model.Stream = *Stream == "stdin" ? IOModel::Stdin : IOModel::NoStream;
+            } else if (Optional<int64_t> Stream = Object->getInteger("stream")) {
+                Model.Stream = *Stream;
+            }
+            if (Optional<StringRef> Role = Object->getString("return")) {
+                if (!parseRole(*Role, Model.Return)) {
+                    errs() << "Error: " << Path << ": unknown return role " << *Role << "\n";
+                }
+            }
+            if (Optional<int64_t> Index = Object->getInteger("buffer")) {
+                Model.Buffer = *Index;
+            }
+            if (Optional<int64_t> Index = Object->getInteger("values")) {
+                Model.Values = *Index;
+            }
+            if (Optional<int64_t> Index = Object->getInteger("measures")) {
+                Model.Measures = *Index;
+            }
+            Models[Model.Name] = Model;
+        }
+    }
+
+    StringMap<IOModel> buildModels() {
+        StringMap<IOModel> Models;
+        for (const ModelRow &Row : ModelTable) {
+            IOModel Model;
+            Model.Name = Row.Name;
+            Model.Stream = Row.Stream;
+            Model.Return = Row.Return;
+            Model.Buffer = Row.Buffer;
+            Model.Values = Row.Values;
+            Model.Measures = Row.Measures;
+            Models[Row.Name] = Model;
+        }
+        if (!ExtraModels.empty()) {
+            loadModels(ExtraModels, Models);
+        }
+        return Models;
+    }
+
+}
+
+// One hash lookup per call, the table is built on first use
+const IOModel *llvm::lookupIOModel(StringRef Name)
+{
+    static const StringMap<IOModel> Models = buildModels();
+    auto It = Models.find(Name);
+    return It == Models.end() ? nullptr : &It->second;
+}
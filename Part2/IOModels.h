@@ -0,0 +1,60 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// IOModels.h
+
+// Hardcoded semantics of the libc I/O APIs in scope (getc, fopen, scanf,
+// fclose, fread, fwrite, ...). Each model says which argument names the
+// stream a call reads, and whether the return value and the pointer
+// arguments carry input content, an input length, scanned values or a new
+// stream. The taint analysis uses this to tell "the size of file fp"
+// apart from the value of each character read from fp.
+//
+// The models are a declarative table in IOModels.cpp; more can be added
+// at run time with -ifd-api-models=<file.json>, e.g.
+//   [{"name": "getline", "stream": 2, "return": "length", "buffer": 0}]
+
+#ifndef IO_MODELS_H
+#define IO_MODELS_H
+
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <string>
+
+namespace llvm {
+
+    // What a return value carries
+    enum class IORole : uint8_t {
+        None,           // nothing derived from the input
+        Content,        // data read from the stream (getc, fgets)
+        Length,         // how much of the stream was read or is left (fread, scanf, feof)
+        NewStream       // a stream opened by the call (fopen, open)
+    };
+
+    struct IOModel {
+        static const int Stdin = -1;        // the call reads stdin implicitly
+        static const int None = -1;         // for argument indices other than Stream
+        static const int NoStream = -2;     // the call reads no stream
+
+        std::string Name;
+        int Stream = NoStream;      // argument holding the FILE* / file descriptor read
+        IORole Return = IORole::None;
+        int Buffer = None;          // argument filled with content read from the stream
+        int Values = None;          // first of the pointer arguments filled with scanned values
+        int Measures = None;        // the return value is the length of this argument's content
+
+        bool readsStream() const { return Stream != NoStream; }
+    };
+
+    // Look up the model of a function by name, nullptr if it has none
+    const IOModel *lookupIOModel(StringRef Name);
+
+}
+
+#endif // IO_MODELS_H
@@ -21,10 +21,19 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "LoopTripCount.h"
+#include "AnalysisCache.h"
+#include "FeatureExtractor.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/TimeProfiler.h"
 
 // This program detects input features influencing key points (the conditional branching points and the call to a function via function pointers) in a program
 /*
@@ -53,6 +62,59 @@ The output of the tool should indicate what the seminal input features are for t
 // Pass ID variable  
 char InputFeatureDetector::ID = 0;
 
+#define DEBUG_TYPE "input-pointer-tracer"
+
+// shown by -stats
+STATISTIC(NumFunctionsAnalyzed, "Number of functions analyzed");
+STATISTIC(NumFunctionsCached, "Number of functions reused from the analysis cache");
+STATISTIC(NumKeyPoints, "Number of key points reported");
+STATISTIC(NumFeatures, "Number of input features reported");
+STATISTIC(NumSourceLinesRead, "Number of source lines read");
+STATISTIC(NumRegexEvaluations, "Number of regular expression searches");
+
+namespace {
+    // A phase of runOnModule, timed by -time-passes and recorded by -time-trace
+    struct PhaseTimer {
+        NamedRegionTimer Timer;
+        TimeTraceScope Trace;
+
+        PhaseTimer(StringRef Name, StringRef Description)
+            : Timer(Name, Description, DEBUG_TYPE, "Input feature detector phases", TimePassesIsEnabled),
+              Trace(Description) {}
+    };
+}
+
+// Where and how the seminal input features are written
+static cl::opt<std::string> ReportFile("ifd-output",
+    cl::desc("File to write the input feature report to (default: ../output/<source>_InputFeatures.<ext>)"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<ReportFormat> ReportFileFormat("ifd-format",
+    cl::desc("Format of the input feature report"),
+    cl::values(clEnumValN(ReportFormat::JSONLines, "jsonl", "one JSON object per key point (default)"),
+               clEnumValN(ReportFormat::Binary, "binary", "compact binary form"),
+               clEnumValN(ReportFormat::Text, "text", "\"Line N: feature\" text")),
+    cl::init(ReportFormat::JSONLines));
+
+// Per-function results are cached between runs, see AnalysisCache.h
+static cl::opt<std::string> CacheFile("ifd-cache",
+    cl::desc("Analysis cache file (default: ../output/<source>_InputFeatures.cache)"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<bool> NoCache("ifd-no-cache",
+    cl::desc("Analyze every function, do not read or write the analysis cache"),
+    cl::init(false));
+
+// A standalone module that only reads the input and prints the numeric features, see FeatureExtractor.h
+static cl::opt<std::string> ExtractorFile("ifd-extractor",
+    cl::desc("Write a feature extractor for the reported features to this LLVM IR file"),
+    cl::value_desc("filename"), cl::init(""));
+
+// select instructions are branch-free conditionals, reporting them is optional
+static cl::opt<bool> DetectSelects("ifd-selects",
+    cl::desc("Also report select instructions as key points"),
+    cl::init(false));
+
 /*
 Method: A possible way to solve the problem is to use def-use relations to infer what part of the input is 
 related with the key points in the program that determine the execution time of a program. 
@@ -65,17 +127,59 @@ bool InputFeatureDetector::runOnModule(Module &M)
     LLVMContext& Context = M.getContext();
     std::string filename;
 
+    for (Function &F : M)               // the source file is named by the first debug location
+    {
+        for (Instruction &I : instructions(F))
+        {
+            if ( filename.empty() && I.getDebugLoc())
+            {
+                const DebugLoc &debugInfo = I.getDebugLoc();
+                filename = debugInfo -> getFilename().str();        // get the filename
+            }
+        }
+    }
+    filename = llvm::sys::path::filename(filename).str();
+
+    {
+        PhaseTimer Timer("taint", "Taint analysis");
+        Taint.run(M);                   // def-use facts are needed by detectBranch
+    }
+
+    // results of functions whose IR and inputs did not change are reused
+    AnalysisCache Cache(Taint, DetectSelects ? "selects" : "");
+    std::string cacheFile = CacheFile.empty() ? "../output/" + filename + "_InputFeatures.cache" : std::string(CacheFile);
+    if (!NoCache)
+    {
+        PhaseTimer Timer("cache-load", "Analysis cache load");
+        Cache.load(cacheFile);
+    }
+
+    Optional<PhaseTimer> DetectTimer;
+    DetectTimer.emplace("detect", "Key point detection");
+
     for (Function &F : M)               // iterate over all functions in the module
     {
+        if (F.isDeclaration())
+            continue;
+
+        TimeTraceScope FunctionTrace("Detect key points", F.getName());
+        uint64_t key = NoCache ? 0 : Cache.functionKey(F);
+        if (const std::vector<KeyPointRecord> *cached = NoCache ? nullptr : Cache.lookup(F, key))
+        {
+            for (const KeyPointRecord &Record : *cached)
+                Report.add(Record);
+            ++NumFunctionsCached;
+            continue;
+        }
+
+        ++NumFunctionsAnalyzed;
+        size_t firstRecord = Report.records().size();
+        detectLoops(F);
+
         for (BasicBlock &BB : F)        // iterate over all basic blocks in the function
         {
             for (Instruction &I : BB)   // iterate over all instructions in the basic block
             {
-                if ( filename.empty() && I.getDebugLoc())
-                {
-                    const DebugLoc &debugInfo = I.getDebugLoc();
-                    filename = debugInfo -> getFilename().str();        // get the filename
-                }
                 if (BranchInst *BI = dyn_cast<BranchInst>(&I)){          // if the instruction is a branch instruction
                     if ( BI -> isConditional() ){                        // and a conditional branch
                         // printExecutedBranchInfo(Context, BI, M);
@@ -83,17 +187,109 @@ bool InputFeatureDetector::runOnModule(Module &M)
                         detectBranch(BI);
                     }
                 }
+                if (SwitchInst *SI = dyn_cast<SwitchInst>(&I))          // switch statements
+                    detectSwitch(SI);
+                if (IndirectBrInst *IBI = dyn_cast<IndirectBrInst>(&I)) // computed gotos
+                    detectIndirectBranch(IBI);
+                if (SelectInst *SI = dyn_cast<SelectInst>(&I))          // branch-free conditionals, when requested
+                    if (DetectSelects)
+                        detectSelect(SI);
                 if (CallInst *CI = dyn_cast<CallInst>(&I))              // if the instruction is a call instruction
                     // printFunctionPtr(Context, CI, F, M);
                     detectCall(Context, CI, F, M);
             }
         }
+
+        if (!NoCache)
+            Cache.insert(F, key, std::vector<KeyPointRecord>(Report.records().begin() + firstRecord, Report.records().end()));
+    }
+
+    DetectTimer.reset();
+    {
+        PhaseTimer Timer("report", "Report writing");
+        Report.finalize();
+        Report.write(errs(), ReportFormat::Text);
+        writeReport(filename);
+    }
+    if (!ExtractorFile.empty())
+    {
+        PhaseTimer Timer("extractor", "Feature extractor generation");
+        FeatureExtractor Extractor(Taint);
+        if (Extractor.writeToFile(M, Report, ExtractorFile))
+            errs() << "writing feature extractor to " + ExtractorFile + "\n";
+    }
+    NumKeyPoints += Report.records().size();
+    for (const KeyPointRecord &Record : Report.records())
+        NumFeatures += Record.Features.size();
+
+    if (!NoCache)
+    {
+        PhaseTimer Timer("cache-save", "Analysis cache save");
+        if (!Cache.save(cacheFile))
+            errs() << "Error: Could not write cache file " << cacheFile << "\n";
+        else
+            errs() << "reused " << Cache.hits() << " of " << Cache.hits() + Cache.misses() << " functions from " << cacheFile << "\n";
     }
 
-    // writeToOutfile(llvm::sys::path::filename(filename).str());
+    Taint.clear();
     return true; // module was modified
 }
 
+// Write the finalized report to -ifd-output, or to "../output/filename_InputFeatures.<ext>"
+void InputFeatureDetector::writeReport(const std::string& filename)
+{
+    std::string file = ReportFile;
+    if (file.empty()) {
+        const char *ext = ReportFileFormat == ReportFormat::Binary ? ".bin"
+                        : ReportFileFormat == ReportFormat::Text   ? ".txt" : ".jsonl";
+        file = "../output/" + filename + "_InputFeatures" + ext;
+    }
+
+    if (!Report.writeToFile(file, ReportFileFormat)) {
+        errs() << "Error: Could not open report file " << file << "\n";
+        return;
+    }
+    errs() << "writing to " + file + "\n";
+}
+
+// Start a record for a key point at the debug location of I
+KeyPointRecord InputFeatureDetector::makeRecord(Instruction *I, KeyPointKind Kind)
+{
+    KeyPointRecord Record;
+    Record.Kind = Kind;
+    if (const DebugLoc &debugInfo = I->getDebugLoc()) {
+        Record.File = llvm::sys::path::filename(debugInfo->getFilename()).str();
+        Record.Line = debugInfo.getLine();
+        Record.Column = debugInfo.getCol();
+    }
+    return Record;
+}
+
+// Add every input source the key point condition V depends on as a feature of the record
+void InputFeatureDetector::addInputFeatures(KeyPointRecord &Record, Value *V)
+{
+    for (unsigned ID : Taint.featuresOf(V)) {
+        const InputSource &Source = Taint.source(ID);
+        Record.Features.push_back({Source.Kind, Source.Name, Source.Line});
+    }
+}
+
+// Name an operand the same way printAsOperand does, e.g. "%5" or "i32 0"
+InputFeature InputFeatureDetector::operandFeature(Value *V, FeatureKind Kind, Module *M)
+{
+    InputFeature Feature;
+    Feature.Kind = Kind;
+    raw_string_ostream OS(Feature.Name);
+    V->printAsOperand(OS, false, M);
+    OS.flush();
+    if (Instruction *I = dyn_cast<Instruction>(V)) {
+        if (I->getDebugLoc()) {
+            Feature.Line = I->getDebugLoc().getLine();
+        }
+    }
+    return Feature;
+}
+
 /*
 The output of the tool should indicate what the seminal input 
 features are for the given program. For Example 2.1, the output 
@@ -128,24 +324,32 @@ void InputFeatureDetector::detectBranch(BranchInst *BI)
     // check if the branch instruction is an if-else statement
     std::string line = getLineFromFile(BI->getDebugLoc().getLine(), BI->getDebugLoc()->getFilename().str());
     if(startsWithControlStructure(line)){
-        errs() << "Line " << BI->getDebugLoc().getLine() << ": if-else branch length of `";
         //remove leading and trailing whitespace from line
         std::string lineNoWhitespace = trim(line);
 
-        errs() << lineNoWhitespace << "`\n";
+        KeyPointRecord Record = makeRecord(BI, KeyPointKind::IfElse);
+        Record.Description = "if-else branch length of `" + lineNoWhitespace + "`";
+        Record.Features.push_back({FeatureKind::SourceExpression, lineNoWhitespace, Record.Line});
+        addInputFeatures(Record, condition);
+        Report.add(std::move(Record));
         return;
     }
 
     if(!isa<ICmpInst>(condition)){
-        errs() << "Line " << BI->getDebugLoc().getLine() << ": ";
-        std::string line = getLineFromFile(BI->getDebugLoc().getLine(), BI->getDebugLoc()->getFilename().str());
         std::string condition = extractBetweenParentheses(line);
-        errs() << condition << "\n";
+
+        KeyPointRecord Record = makeRecord(BI, KeyPointKind::Branch);
+        Record.Description = condition;
+        Record.Features.push_back({FeatureKind::SourceExpression, condition, Record.Line});
+        addInputFeatures(Record, BI->getCondition());
+        Report.add(std::move(Record));
         return;
     }
     // Analyze the condition
     if (ICmpInst *cmp = dyn_cast<ICmpInst>(condition)) {
         // The condition is a comparison instruction
+        Module *M = BI->getModule();
+        KeyPointRecord Record = makeRecord(cmp, KeyPointKind::Branch);
 
         // Get the operands of the comparison
         Value *leftOperand = cmp->getOperand(0);
@@ -154,54 +358,58 @@ void InputFeatureDetector::detectBranch(BranchInst *BI)
         // Check if the comparison is an equality comparison becuase if it is then the condition is processed differently
         if(cmp->getPredicate() == CmpInst::Predicate::ICMP_EQ) {
             // Get the operands of the comparison
-            errs() << "Line " << cmp->getDebugLoc().getLine() << ": ";
-            leftOperand->printAsOperand(errs(), false, BI->getModule());
-            errs() << " == ";
-            rightOperand->printAsOperand(errs(), false, BI->getModule());
-            errs() << "\n";
+            InputFeature left = operandFeature(leftOperand, FeatureKind::ScalarValue, M);
+            InputFeature right = operandFeature(rightOperand, FeatureKind::ScalarValue, M);
+            Record.Description = left.Name + " == " + right.Name;
+            Record.Features.push_back(left);
+            Record.Features.push_back(right);
+            addInputFeatures(Record, cmp);
+            Report.add(std::move(Record));
             return;
         }
 
         // Process the operands to find seminal input features
         if (isa<Constant>(leftOperand) || isa<Constant>(rightOperand)) {
             // Constants take highest precedence
-            if (isa<Constant>(leftOperand)) {
-                errs() << "Line " << cmp->getDebugLoc().getLine() << ": ";
-                leftOperand->printAsOperand(errs(), false, BI->getModule());
-                errs() << "\n";
-            } else {
-                errs() << "Line " << cmp->getDebugLoc().getLine() << ": ";
-                rightOperand->printAsOperand(errs(), false, BI->getModule());
-                errs() << "\n";
-            }
+            Value *operand = isa<Constant>(leftOperand) ? leftOperand : rightOperand;
+            Record.Features.push_back(operandFeature(operand, FeatureKind::Constant, M));
         } else if (isa<Argument>(leftOperand) || isa<Argument>(rightOperand)) {
-            if (isa<Argument>(leftOperand)) {
-                errs() << "Line " << cmp->getDebugLoc().getLine() << ": ";
-                leftOperand->printAsOperand(errs(), false, BI->getModule());
-                errs() << "\n";
-            } else {
-                errs() << "Line " << cmp->getDebugLoc().getLine() << ": ";
-                rightOperand->printAsOperand(errs(), false, BI->getModule());
-                errs() << "\n";
-            }
+            Value *operand = isa<Argument>(leftOperand) ? leftOperand : rightOperand;
+            Record.Features.push_back(operandFeature(operand, FeatureKind::Argument, M));
         } else if(isa<CallInst>(leftOperand) || isa<CallInst>(rightOperand) || isa<LoadInst>(leftOperand) || isa<LoadInst>(rightOperand)) {
             if (isa<CallInst>(leftOperand) && isa<LoadInst>(rightOperand)) { // left operand is seminal input i = 0; foo() > i; i++
-                errs() << "Line " << cmp->getDebugLoc().getLine() << ": ";
-                leftOperand->printAsOperand(errs(), false, BI->getModule());
-                errs() << "\n";
+                Record.Features.push_back(operandFeature(leftOperand, FeatureKind::CallResult, M));
             } else if (isa<CallInst>(rightOperand) && isa<LoadInst>(leftOperand)) { // right operand is seminal input i = 0; i < foo(); i++
-                errs() << "Line " << cmp->getDebugLoc().getLine() << ": ";
-                rightOperand->printAsOperand(errs(), false, BI->getModule());
-                errs() << "\n";
+                Record.Features.push_back(operandFeature(rightOperand, FeatureKind::CallResult, M));
             } else if(isa<LoadInst>(leftOperand) && isa<LoadInst>(rightOperand)){ // both operands are variables i = 0; i < n; i++
-                std::string leftOperandLine = getLineFromFile(dyn_cast<Instruction>(leftOperand)->getDebugLoc().getLine(), dyn_cast<Instruction>(leftOperand)->getDebugLoc()->getFilename().str());                BasicBlock *BB = BI->getSuccessor(0);
-                auto operands = parseCondition(leftOperandLine);
-                errs() << "Line " << cmp->getDebugLoc().getLine() << ": ";
-                errs() << operands[0] << " compared to " << operands[1] << "\n";
+                // name the variables from debug info, the source line is only parsed without it
+                std::vector<std::string> operands = {
+                    TaintAnalysis::variableName(cast<LoadInst>(leftOperand)->getPointerOperand()),
+                    TaintAnalysis::variableName(cast<LoadInst>(rightOperand)->getPointerOperand())
+                };
+                if (operands[0].empty() || operands[1].empty()) {
+                    std::string leftOperandLine = getLineFromFile(dyn_cast<Instruction>(leftOperand)->getDebugLoc().getLine(), dyn_cast<Instruction>(leftOperand)->getDebugLoc()->getFilename().str());
+                    operands = parseCondition(leftOperandLine);
+                }
+                if (operands.size() < 2) {
+                    return;
+                }
+                Record.Description = operands[0] + " compared to " + operands[1];
+                Record.Features.push_back({FeatureKind::ScalarValue, operands[0], Record.Line});
+                Record.Features.push_back({FeatureKind::ScalarValue, operands[1], Record.Line});
             } else { // condition is not processed here
                 return;
             }
+        } else {
+            return;
+        }
+
+        if (Record.Description.empty()) {
+            Record.Description = Record.Features.front().Name;
         }
+        addInputFeatures(Record, cmp);
+        Report.add(std::move(Record));
+        return;
     } else if (isa<CallInst>(condition)) { // condition is a call instruction, FIXME: may remove this in case runOnModule() already can detect this. e.g. while(foo())
         //detectCall(Context, dyn_cast<CallInst>(condition), *BI->getParent(), M);
     } else { // condition evaluates to a value which is processed as either true or false 
@@ -212,6 +420,55 @@ void InputFeatureDetector::detectBranch(BranchInst *BI)
     // For example, conditions involving function calls, arithmetic operations, etc.
 }
 
+// Switch statements are key points with one edge per case, the
+// features are the input sources of the value switched on
+void InputFeatureDetector::detectSwitch(SwitchInst *SI)
+{
+    KeyPointRecord Record = makeRecord(SI, KeyPointKind::Switch);
+    Record.Description = "switch on " + valueText(SI->getCondition(), SI->getModule()) +
+                         " (" + std::to_string(SI->getNumSuccessors()) + " edges)";
+    addInputFeatures(Record, SI->getCondition());
+    Report.add(std::move(Record));
+}
+
+// A computed goto depends on the inputs its address is computed from
+void InputFeatureDetector::detectIndirectBranch(IndirectBrInst *IBI)
+{
+    KeyPointRecord Record = makeRecord(IBI, KeyPointKind::IndirectBranch);
+    Record.Description = "indirect branch on " + valueText(IBI->getAddress(), IBI->getModule());
+    addInputFeatures(Record, IBI->getAddress());
+    Report.add(std::move(Record));
+}
+
+// A select chooses between two values without branching
+void InputFeatureDetector::detectSelect(SelectInst *SI)
+{
+    KeyPointRecord Record = makeRecord(SI, KeyPointKind::Select);
+    Value *condition = SI->getCondition();
+    if (CmpInst *cmp = dyn_cast<CmpInst>(condition)) {
+        Record.Description = "select on " + valueText(cmp->getOperand(0), SI->getModule()) + " " +
+                             CmpInst::getPredicateName(cmp->getPredicate()).str() + " " +
+                             valueText(cmp->getOperand(1), SI->getModule());
+    } else {
+        Record.Description = "select on " + valueText(condition, SI->getModule());
+    }
+    addInputFeatures(Record, condition);
+    Report.add(std::move(Record));
+}
+
+// Name a value after the variable it was loaded from, e.g. "s" instead of "%0"
+std::string InputFeatureDetector::valueText(Value *V, Module *M)
+{
+    if (CastInst *cast = dyn_cast<CastInst>(V))
+        V = cast->getOperand(0);
+    if (LoadInst *load = dyn_cast<LoadInst>(V)) {
+        std::string name = TaintAnalysis::variableName(load->getPointerOperand());
+        if (!name.empty())
+            return name;
+    }
+    return operandFeature(V, FeatureKind::ScalarValue, M).Name;
+}
+
 // Recursively trace instruction to source
 Value* InputFeatureDetector::traceToSource(Instruction* inst) {
     if (inst && (isa<Argument>(inst) || isa<CallInst>(inst))) {
@@ -233,27 +490,77 @@ void InputFeatureDetector::detectCall(LLVMContext& Context, CallInst *CI, Functi
         return;
     }
 
-    // Check if it's a file I/O call
-    if (calledFunc->getName() == "fopen" || calledFunc->getName() == "open") {
-
-        // fopen/open defines the file to be processed
+    // Check if it's a file I/O call, see IOModels.cpp for the modeled APIs
+    const IOModel *Model = lookupIOModel(calledFunc->getName());
+    if (!Model) {
+        return;
+    }
 
-        Value* filenameParam = CI->getArgOperand(0); 
+    if (Model->Return == IORole::NewStream) {
 
-        std::string line = getLineFromFile(CI->getDebugLoc().getLine(), CI->getDebugLoc()->getFilename().str());
-        std::string variableName = extractVariableName(line);
+        // fopen/open defines the file to be processed, its length is a feature
+        std::string variableName;
+        if (const TaintAnalysis::SourceSet *Sources = Taint.sourcesOf(CI)) {
+            for (unsigned ID : *Sources) {
+                if (Taint.source(ID).Call == CI) {
+                    variableName = Taint.source(ID).Name;
+                }
+            }
+        }
+        if (variableName.empty()) {
+            std::string line = getLineFromFile(CI->getDebugLoc().getLine(), CI->getDebugLoc()->getFilename().str());
+            variableName = extractVariableName(line);
+        }
 
-        // Filename is a global constant string
-        errs() << "Line " << CI->getDebugLoc().getLine() << ": " << "Length of file " << variableName << "\n";
+        KeyPointRecord Record = makeRecord(CI, KeyPointKind::IOCall);
+        Record.Description = "Length of file " + variableName;
+        Record.Features.push_back({FeatureKind::FileSize, variableName, Record.Line});
+        Report.add(std::move(Record));
 
+    } else if (Model->Return == IORole::Content || Model->Buffer != IOModel::None) { // Line 3: size of stdin
+        // reading the content of a stream: how much is read depends on its length
+        const TaintAnalysis::SourceSet *Streams = Taint.streamsReadBy(CI);
+        if (!Streams) {
+            return;
+        }
+        for (unsigned ID : *Streams) {
+            const InputSource &Stream = Taint.source(ID);
+            KeyPointRecord Record = makeRecord(CI, KeyPointKind::IOCall);
+            Record.Description = Stream.Kind == FeatureKind::StdinLength ? "Size of stdin" : "Length of file " + Stream.Name;
+            Record.Features.push_back({Stream.Kind, Stream.Name, Stream.Line});
+            Report.add(std::move(Record));
+        }
+    }
+}
 
-    } else if(calledFunc->getName() == "gets" || calledFunc->getName() == "getc") { // Line 3: size of stdin
-        errs() << "Line " << CI->getDebugLoc().getLine() << ": Size of stdin\n";
+// Report the trip count of every loop of F in terms of the input sources
+// it depends on, e.g. "Line 6: trip count = n"
+void InputFeatureDetector::detectLoops(Function &F)
+{
+    LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+    ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>(F).getSE();
+
+    TripCountAnalysis TripCounts(LI, SE, Taint);
+    for (const LoopTripCount &Count : TripCounts.run()) {
+        KeyPointRecord Record;
+        Record.Kind = KeyPointKind::Loop;
+        if (Count.Loc) {
+            Record.File = llvm::sys::path::filename(Count.Loc->getFilename()).str();
+            Record.Line = Count.Loc.getLine();
+            Record.Column = Count.Loc.getCol();
+        }
+        Record.Description = "trip count = " + Count.Expression;
+        for (unsigned ID : Count.Sources) {
+            const InputSource &Source = Taint.source(ID);
+            Record.Features.push_back({Source.Kind, Source.Name, Source.Line});
+        }
+        Report.add(std::move(Record));
     }
 }
 
 void InputFeatureDetector::getAnalysisUsage(AnalysisUsage &AU) const {
     AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
 }
 
 std::string InputFeatureDetector::getLineFromFile(int lineNumber, const std::string& filename) {
@@ -267,6 +574,7 @@ std::string InputFeatureDetector::getLineFromFile(int lineNumber, const std::str
         if (!getline(file, line)) {
             return "";
         }
+        ++NumSourceLinesRead;
     }
 
     return line;
@@ -312,6 +620,7 @@ std::string InputFeatureDetector::extractVariableName(const std::string& line) {
     std::regex pattern(R"(\bFILE\s*\*\s*(\w+)\s*=|^\s*\*\s*(\w+)\s*=)");
     std::smatch matches;
 
+    ++NumRegexEvaluations;
     if (std::regex_search(line, matches, pattern)) {
         for (size_t i = 1; i < matches.size(); ++i) {
             if (!matches[i].str().empty()) {
@@ -335,6 +644,7 @@ std::vector<std::string> InputFeatureDetector::parseCondition(const std::string&
     std::smatch matches;
     std::vector<std::string> operands;
 
+    ++NumRegexEvaluations;
     if (std::regex_search(str, matches, pattern) && matches.size() >= 4) {
         operands.push_back(tr(matches[1].str())); // Left operand
         operands.push_back(tr(matches[3].str())); // Right operand
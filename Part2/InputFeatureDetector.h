@@ -29,6 +29,10 @@
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "FeatureReport.h"
+#include "IOModels.h"
+#include "TaintAnalysis.h"
 #include <map>
 #include <fstream>
 #include <string>
@@ -61,12 +65,38 @@ namespace {
 
         private:
     
-            // Analysis state
-            std::set<Value*> InputFeatures;
+            // Analysis state: input sources flowing into every value
+            TaintAnalysis Taint;
+
+            // Key points found so far, written out at the end of runOnModule
+            FeatureReport Report;
+
+            // Start a record for a key point at the location of instruction I
+            KeyPointRecord makeRecord(Instruction *I, KeyPointKind Kind);
+
+            // Add the input sources flowing into V to the record
+            void addInputFeatures(KeyPointRecord &Record, Value *V);
+
+            // Variable name of a loaded value, or the operand as printed by LLVM
+            std::string valueText(Value *V, Module *M);
+
+            // Describe an operand of a key point as an input feature
+            InputFeature operandFeature(Value *V, FeatureKind Kind, Module *M);
+
+            // Write the report to the file selected by -ifd-output
+            void writeReport(const std::string& filename);
 
             // Detect branch features
             void detectBranch(BranchInst *BI);
 
+            // Detect features of switch statements, computed gotos and selects
+            void detectSwitch(SwitchInst *SI);
+            void detectIndirectBranch(IndirectBrInst *IBI);
+            void detectSelect(SelectInst *SI);
+
+            // Detect the input features that determine loop trip counts
+            void detectLoops(Function &F);
+
             // Detect call features
             void detectCall(LLVMContext& Context, CallInst *CI, Function &F, Module &M);
 
@@ -0,0 +1,446 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "LoopTripCount.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "input-pointer-tracer"
+
+STATISTIC(NumLoops, "Number of loops visited for trip counts");
+STATISTIC(NumTripCounts, "Number of loops with a trip count");
+
+namespace {
+
+    // Collects the SCEVUnknown leaves of an expression
+    struct UnknownCollector {
+        SmallVector<const SCEVUnknown*, 4> Unknowns;
+
+        bool follow(const SCEV *S) {
+            if (const SCEVUnknown *U = dyn_cast<SCEVUnknown>(S)) {
+                Unknowns.push_back(U);
+            }
+            return true;
+        }
+        bool isDone() const { return false; }
+    };
+
+    // The alloca a loaded (and possibly extended) value is read from
+    const AllocaInst *loadedVariable(Value *V) {
+        if (CastInst *Cast = dyn_cast<CastInst>(V)) {
+            V = Cast->getOperand(0);
+        }
+        if (LoadInst *LI = dyn_cast<LoadInst>(V)) {
+            return dyn_cast<AllocaInst>(getUnderlyingObject(LI->getPointerOperand()));
+        }
+        return nullptr;
+    }
+
+    bool passesPointerTo(const CallBase *CB, const Value *Object) {
+        for (const Value *Arg : CB->args()) {
+            if (Arg->getType()->isPointerTy() && getUnderlyingObject(Arg) == Object) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Name of an IR value as the programmer wrote it
+    std::string valueName(const Value *V) {
+        if (const LoadInst *LI = dyn_cast<LoadInst>(V)) {
+            std::string Name = TaintAnalysis::variableName(LI->getPointerOperand());
+            if (!Name.empty()) {
+                return Name;
+            }
+        }
+        if (const CallInst *CI = dyn_cast<CallInst>(V)) {
+            if (const Function *Callee = CI->getCalledFunction()) {
+                return Callee->getName().str() + "()";
+            }
+        }
+        if (V->hasName()) {
+            return TaintAnalysis::variableName(V);
+        }
+        std::string Name;
+        raw_string_ostream OS(Name);
+        V->printAsOperand(OS, false);
+        return OS.str();
+    }
+
+}
+
+std::vector<LoopTripCount> TripCountAnalysis::run()
+{
+    std::vector<LoopTripCount> Results;
+    for (Loop *L : LI.getLoopsInPreorder()) {
+        LoopTripCount Result;
+        ++NumLoops;
+        if (analyze(L, Result)) {
+            Results.push_back(std::move(Result));
+            ++NumTripCounts;
+        }
+    }
+    return Results;
+}
+
+// Combine the counts of every exit of L: one exit gives "X", several give "min(X, Y)"
+bool TripCountAnalysis::analyze(Loop *L, LoopTripCount &Result)
+{
+    SmallVector<std::string, 2> Bounds;
+    auto addBound = [&](const std::string &Bound) {
+        if (std::find(Bounds.begin(), Bounds.end(), Bound) == Bounds.end()) {
+            Bounds.push_back(Bound);
+        }
+    };
+
+    const SCEV *Taken = SE.getBackedgeTakenCount(L);
+    if (!isa<SCEVCouldNotCompute>(Taken)) {
+        const SCEV *Count = SE.getAddExpr(Taken, SE.getOne(Taken->getType()));
+        addBound(format(Count));
+        addSources(Count, Result.Sources);
+    } else {
+        SmallVector<BasicBlock*, 4> Exiting;
+        L->getExitingBlocks(Exiting);
+        for (BasicBlock *BB : Exiting) {
+            BranchInst *BI = dyn_cast<BranchInst>(BB->getTerminator());
+            if (!BI || !BI->isConditional()) {
+                continue;
+            }
+
+            if (const SCEV *Count = countedExit(L, BI)) {
+                addBound(format(Count));
+                addSources(Count, Result.Sources);
+                continue;
+            }
+
+            // not a counted exit: end of input tests bound the loop by a stream
+            // length, other input dependent exits are listed by their sources
+            std::string Inputs;
+            for (unsigned ID : Taint.featuresOf(BI->getCondition())) {
+                const InputSource &Source = Taint.source(ID);
+                Result.Sources.set(ID);
+                if (Source.Kind == FeatureKind::FileSize) {
+                    addBound("length of file " + Source.Name);
+                } else if (Source.Kind == FeatureKind::StdinLength) {
+                    addBound("length of stdin");
+                } else {
+                    Inputs += (Inputs.empty() ? "" : ", ") + Source.Name;
+                }
+            }
+            if (!Inputs.empty()) {
+                addBound("f(" + Inputs + ")");
+            }
+        }
+    }
+
+    if (Bounds.empty()) {
+        return false;
+    }
+
+    Result.L = L;
+    Result.Loc = L->getStartLoc();
+    if (Bounds.size() == 1) {
+        Result.Expression = Bounds.front();
+    } else {
+        Result.Expression = "min(";
+        for (unsigned i = 0; i < Bounds.size(); i++) {
+            Result.Expression += (i ? ", " : "") + Bounds[i];
+        }
+        Result.Expression += ")";
+    }
+    return true;
+}
+
+// Count the iterations of a loop leaving through BI when BI compares a
+// memory induction variable against a loop invariant bound:
+//   continue while i <  n, i += c  ->  (n - start + c - 1) / c
+//   continue while i <= n, i += c  ->  (n - start) / c + 1
+// and the mirrored forms for counting down and for i != n
+const SCEV *TripCountAnalysis::countedExit(Loop *L, BranchInst *BI)
+{
+    ICmpInst *Cmp = dyn_cast<ICmpInst>(BI->getCondition());
+    if (!Cmp) {
+        return nullptr;
+    }
+
+    CmpInst::Predicate Pred = Cmp->getPredicate();
+    Value *Induction = Cmp->getOperand(0);
+    Value *Bound = Cmp->getOperand(1);
+
+    const AllocaInst *Var = loadedVariable(Induction);
+    int64_t Step = Var ? inductionStep(L, Var) : 0;
+    if (!Step) {
+        std::swap(Induction, Bound);
+        Pred = CmpInst::getSwappedPredicate(Pred);
+        Var = loadedVariable(Induction);
+        Step = Var ? inductionStep(L, Var) : 0;
+    }
+    if (!Step || !Bound->getType()->isIntegerTy() || !isInvariant(L, Bound)) {
+        return nullptr;
+    }
+
+    // normalize to "the loop continues while Induction Pred Bound"
+    if (!L->contains(BI->getSuccessor(0))) {
+        Pred = CmpInst::getInversePredicate(Pred);
+    }
+
+    // without a store before the loop, the count starts from the variable's value on entry
+    Type *Ty = Bound->getType();
+    Value *StartValue = startValue(L, Var);
+    if (StartValue && !SE.isSCEVable(StartValue->getType())) {
+        return nullptr;
+    }
+    const SCEV *Start = SE.getSCEV(StartValue ? StartValue : Induction);
+    if (!Start->getType()->isIntegerTy()) {
+        return nullptr;
+    }
+    Start = SE.getTruncateOrSignExtend(Start, Ty);
+    const SCEV *Limit = SE.getSCEV(Bound);
+
+    uint64_t AbsStep = std::abs(Step);
+    const SCEV *StepSize = SE.getConstant(Ty, AbsStep);
+    const SCEV *Distance = Step > 0 ? SE.getMinusSCEV(Limit, Start) : SE.getMinusSCEV(Start, Limit);
+    auto divide = [&](const SCEV *D, bool RoundUp) {
+        if (AbsStep == 1) {
+            return D;
+        }
+        if (RoundUp) {
+            D = SE.getAddExpr(D, SE.getConstant(Ty, AbsStep - 1));
+        }
+        return SE.getUDivExpr(D, StepSize);
+    };
+
+    switch (Pred) {
+        case CmpInst::ICMP_SLT:
+        case CmpInst::ICMP_ULT:
+            return Step > 0 ? divide(Distance, true) : nullptr;
+        case CmpInst::ICMP_SGT:
+        case CmpInst::ICMP_UGT:
+            return Step < 0 ? divide(Distance, true) : nullptr;
+        case CmpInst::ICMP_SLE:
+        case CmpInst::ICMP_ULE:
+            return Step > 0 ? SE.getAddExpr(divide(Distance, false), SE.getOne(Ty)) : nullptr;
+        case CmpInst::ICMP_SGE:
+        case CmpInst::ICMP_UGE:
+            return Step < 0 ? SE.getAddExpr(divide(Distance, false), SE.getOne(Ty)) : nullptr;
+        case CmpInst::ICMP_NE:
+            return AbsStep == 1 ? Distance : nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+// Every store to Var inside L must be "Var = Var + c" (or "Var - c") with the same c
+int64_t TripCountAnalysis::inductionStep(Loop *L, const AllocaInst *Var)
+{
+    int64_t Step = 0;
+    for (BasicBlock *BB : L->blocks()) {
+        for (Instruction &I : *BB) {
+            if (const CallBase *CB = dyn_cast<CallBase>(&I)) {
+                if (!isa<DbgInfoIntrinsic>(CB) && passesPointerTo(CB, Var)) {
+                    return 0;
+                }
+            }
+
+            StoreInst *SI = dyn_cast<StoreInst>(&I);
+            if (!SI || getUnderlyingObject(SI->getPointerOperand()) != Var) {
+                continue;
+            }
+
+            BinaryOperator *BO = dyn_cast<BinaryOperator>(SI->getValueOperand());
+            if (!BO || (BO->getOpcode() != Instruction::Add && BO->getOpcode() != Instruction::Sub)) {
+                return 0;
+            }
+            ConstantInt *C = dyn_cast<ConstantInt>(BO->getOperand(1));
+            Value *Previous = BO->getOperand(0);
+            if (!C && BO->getOpcode() == Instruction::Add) {
+                C = dyn_cast<ConstantInt>(BO->getOperand(0));
+                Previous = BO->getOperand(1);
+            }
+            if (!C || loadedVariable(Previous) != Var) {
+                return 0;
+            }
+
+            int64_t ThisStep = BO->getOpcode() == Instruction::Add ? C->getSExtValue() : -C->getSExtValue();
+            if (Step && Step != ThisStep) {
+                return 0;
+            }
+            Step = ThisStep;
+        }
+    }
+    return Step;
+}
+
+// Look for the last store to Var in the preheader and the straight line code before it
+Value *TripCountAnalysis::startValue(Loop *L, const AllocaInst *Var)
+{
+    BasicBlock *BB = L->getLoopPreheader();
+    for (unsigned Hops = 0; BB && Hops < 4; Hops++, BB = BB->getSinglePredecessor()) {
+        for (auto It = BB->rbegin(); It != BB->rend(); ++It) {
+            if (StoreInst *SI = dyn_cast<StoreInst>(&*It)) {
+                if (getUnderlyingObject(SI->getPointerOperand()) == Var) {
+                    return SI->getValueOperand();
+                }
+            } else if (const CallBase *CB = dyn_cast<CallBase>(&*It)) {
+                if (!isa<DbgInfoIntrinsic>(CB) && passesPointerTo(CB, Var)) {
+                    return nullptr;     // e.g. scanf("%d", &i)
+                }
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool TripCountAnalysis::isWrittenIn(Loop *L, const Value *Object)
+{
+    for (BasicBlock *BB : L->blocks()) {
+        for (Instruction &I : *BB) {
+            if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+                if (getUnderlyingObject(SI->getPointerOperand()) == Object) {
+                    return true;
+                }
+            } else if (const CallBase *CB = dyn_cast<CallBase>(&I)) {
+                if (isa<DbgInfoIntrinsic>(CB)) {
+                    continue;
+                }
+                if (passesPointerTo(CB, Object)) {
+                    return true;
+                }
+                const Function *Callee = CB->getCalledFunction();
+                if (isa<GlobalVariable>(Object) && (!Callee || !Callee->isDeclaration())) {
+                    return true;    // the callee may write the global
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool TripCountAnalysis::isInvariant(Loop *L, const Value *V, unsigned Depth)
+{
+    const Instruction *I = dyn_cast<Instruction>(V);
+    if (!I || !L->contains(I)) {
+        return true;
+    }
+    if (Depth > 8) {
+        return false;
+    }
+
+    if (const LoadInst *LI = dyn_cast<LoadInst>(I)) {
+        const Value *Object = getUnderlyingObject(LI->getPointerOperand());
+        return (isa<AllocaInst>(Object) || isa<GlobalVariable>(Object)) &&
+               !isWrittenIn(L, Object) && isInvariant(L, LI->getPointerOperand(), Depth + 1);
+    }
+    if (isa<BinaryOperator>(I) || isa<CastInst>(I) || isa<GetElementPtrInst>(I)) {
+        for (const Value *Operand : I->operands()) {
+            if (!isInvariant(L, Operand, Depth + 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+// Print a trip count with source variable names, e.g. "(n - 1) / 2"
+std::string TripCountAnalysis::format(const SCEV *S)
+{
+    switch (S->getSCEVType()) {
+        case scConstant:
+            return std::to_string(cast<SCEVConstant>(S)->getAPInt().getSExtValue());
+        case scUnknown:
+            return valueName(cast<SCEVUnknown>(S)->getValue());
+        case scTruncate:
+        case scZeroExtend:
+        case scSignExtend:
+        case scPtrToInt:
+            return format(cast<SCEVCastExpr>(S)->getOperand());
+        case scAddExpr: {
+            // variables first, a constant offset last
+            const SCEVAddExpr *Add = cast<SCEVAddExpr>(S);
+            std::string Result;
+            const SCEVConstant *Offset = nullptr;
+            for (const SCEV *Op : Add->operands()) {
+                if (const SCEVConstant *C = dyn_cast<SCEVConstant>(Op)) {
+                    Offset = C;
+                    continue;
+                }
+                const SCEVMulExpr *Mul = dyn_cast<SCEVMulExpr>(Op);
+                if (Mul && Mul->getNumOperands() == 2 && isa<SCEVConstant>(Mul->getOperand(0)) &&
+                    cast<SCEVConstant>(Mul->getOperand(0))->getAPInt().isAllOnes()) {
+                    Result += (Result.empty() ? "-" : " - ") + format(Mul->getOperand(1));
+                } else {
+                    Result += (Result.empty() ? "" : " + ") + format(Op);
+                }
+            }
+            if (Offset) {
+                int64_t Value = Offset->getAPInt().getSExtValue();
+                Result += (Value < 0 ? " - " : " + ") + std::to_string(std::abs(Value));
+            }
+            return Result;
+        }
+        case scMulExpr: {
+            std::string Result;
+            for (const SCEV *Op : cast<SCEVMulExpr>(S)->operands()) {
+                std::string Term = format(Op);
+                if (isa<SCEVAddExpr>(Op)) {
+                    Term = "(" + Term + ")";
+                }
+                Result += (Result.empty() ? "" : " * ") + Term;
+            }
+            return Result;
+        }
+        case scUDivExpr: {
+            const SCEVUDivExpr *Div = cast<SCEVUDivExpr>(S);
+            std::string LHS = format(Div->getLHS());
+            if (isa<SCEVAddExpr>(Div->getLHS()) || isa<SCEVMulExpr>(Div->getLHS())) {
+                LHS = "(" + LHS + ")";
+            }
+            return LHS + " / " + format(Div->getRHS());
+        }
+        case scSMaxExpr:
+        case scUMaxExpr:
+        case scSMinExpr:
+        case scUMinExpr:
+        case scSequentialUMinExpr: {
+            const SCEVNAryExpr *MinMax = cast<SCEVNAryExpr>(S);
+            bool IsMax = S->getSCEVType() == scSMaxExpr || S->getSCEVType() == scUMaxExpr;
+            std::string Result = IsMax ? "max(" : "min(";
+            for (unsigned i = 0; i < MinMax->getNumOperands(); i++) {
+                Result += (i ? ", " : "") + format(MinMax->getOperand(i));
+            }
+            return Result + ")";
+        }
+        default: {
+            std::string Result;
+            raw_string_ostream OS(Result);
+            S->print(OS);
+            return OS.str();
+        }
+    }
+}
+
+// Input sources of every variable the expression refers to
+void TripCountAnalysis::addSources(const SCEV *S, TaintAnalysis::SourceSet &Sources)
+{
+    UnknownCollector Collector;
+    visitAll(S, Collector);
+    for (const SCEVUnknown *U : Collector.Unknowns) {
+        Sources |= Taint.featuresOf(U->getValue());
+    }
+}
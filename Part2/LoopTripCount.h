@@ -0,0 +1,80 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// LoopTripCount.h
+
+// Symbolic trip counts of the loops of a function, expressed in terms of
+// the input sources found by the taint analysis, e.g. "trip count = n"
+// or "trip count = length of file fp".
+//
+// ScalarEvolution is asked for the backedge-taken count first. In -O0 IR
+// loop counters live in allocas and SCEV cannot see them, so counted
+// loops whose exit compares a memory induction variable (stored as
+// i = i + c inside the loop) against a loop invariant bound are
+// recognized here and their count is built with SCEV expressions. Exits
+// that test for the end of a stream contribute the stream length.
+
+#ifndef LOOP_TRIP_COUNT_H
+#define LOOP_TRIP_COUNT_H
+
+#include "TaintAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/DebugLoc.h"
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+    struct LoopTripCount {
+        const Loop *L;
+        DebugLoc Loc;                       // location of the loop statement
+        std::string Expression;             // e.g. "n - 1" or "min(1000, length of file fp)"
+        TaintAnalysis::SourceSet Sources;   // input sources the count depends on
+    };
+
+    class TripCountAnalysis {
+
+        public:
+            TripCountAnalysis(LoopInfo &LI, ScalarEvolution &SE, const TaintAnalysis &Taint)
+                : LI(LI), SE(SE), Taint(Taint) {}
+
+            // Trip counts of every loop of the function, outer loops first
+            std::vector<LoopTripCount> run();
+
+        private:
+            LoopInfo &LI;
+            ScalarEvolution &SE;
+            const TaintAnalysis &Taint;
+
+            bool analyze(Loop *L, LoopTripCount &Result);
+
+            // Trip count of a loop leaving through the exiting branch BI, nullptr if not counted
+            const SCEV *countedExit(Loop *L, BranchInst *BI);
+
+            // Step c of an induction variable stored as "Var = Var + c" in L, 0 if none
+            int64_t inductionStep(Loop *L, const AllocaInst *Var);
+
+            // Value stored to Var right before entering L, nullptr if unknown
+            Value *startValue(Loop *L, const AllocaInst *Var);
+
+            // True if memory of Object may be written inside L
+            bool isWrittenIn(Loop *L, const Value *Object);
+
+            // True if V does not change while L runs
+            bool isInvariant(Loop *L, const Value *V, unsigned Depth = 0);
+
+            // Print an expression with variable names instead of IR values
+            std::string format(const SCEV *S);
+            void addSources(const SCEV *S, TaintAnalysis::SourceSet &Sources);
+    };
+
+}
+
+#endif // LOOP_TRIP_COUNT_H
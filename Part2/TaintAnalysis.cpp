@@ -0,0 +1,490 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "TaintAnalysis.h"
+#include "IOModels.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include <new>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "input-pointer-tracer"
+
+STATISTIC(NumInputSources, "Number of input sources seeded by the taint analysis");
+STATISTIC(NumFunctionVisits, "Number of function visits until the taint facts are stable");
+
+// Number every value of the module and propagate sources until nothing changes
+void TaintAnalysis::run(Module &M)
+{
+    for (GlobalVariable &GV : M.globals()) {
+        GlobalNumbering[&GV] = GlobalFacts.size();
+        GlobalFacts.emplace_back();
+    }
+
+    for (Function &F : M) {
+        if (!F.isDeclaration()) {
+            enqueue(createState(F));
+        }
+    }
+
+    while (!Worklist.empty()) {
+        FunctionState *S = Worklist.back();
+        Worklist.pop_back();
+        S->InWorklist = false;
+        solve(*S);
+        ++NumFunctionVisits;
+    }
+    NumInputSources += Sources.size();
+}
+
+// Release the numbering, the facts and the bump allocator
+void TaintAnalysis::clear()
+{
+    for (auto &Entry : States) {
+        for (SourceSet &Facts : Entry.second->Facts) {
+            Facts.~SourceSet();
+        }
+    }
+    States.clear();
+    Numbering.clear();
+    GlobalNumbering.clear();
+    GlobalFacts.clear();
+    Sources.clear();
+    SourceIDs.clear();
+    ContentIDs.clear();
+    ReadStreams.clear();
+    Worklist.clear();
+    Alloc.Reset();
+}
+
+const TaintAnalysis::SourceSet *TaintAnalysis::sourcesOf(const Value *V) const
+{
+    const Function *F = nullptr;
+    if (const Instruction *I = dyn_cast<Instruction>(V)) {
+        F = I->getFunction();
+    } else if (const Argument *A = dyn_cast<Argument>(V)) {
+        F = A->getParent();
+    }
+
+    auto State = States.find(F);
+    auto Index = Numbering.find(V);
+    if (State == States.end() || Index == Numbering.end()) {
+        return nullptr;
+    }
+    return &State->second->Facts[Index->second];
+}
+
+TaintAnalysis::SourceSet TaintAnalysis::featuresOf(const Value *Condition) const
+{
+    const SourceSet *Facts = sourcesOf(Condition);
+    if (!Facts) {
+        return SourceSet();
+    }
+
+    const ICmpInst *Cmp = dyn_cast<ICmpInst>(Condition);
+    bool EndOfInput = false;
+    if (Cmp && Cmp->isEquality()) {
+        for (const Value *Operand : Cmp->operands()) {
+            const ConstantInt *CI = dyn_cast<ConstantInt>(Operand);
+            EndOfInput |= (CI && CI->isMinusOne()) || isa<ConstantPointerNull>(Operand);
+        }
+    }
+    if (!EndOfInput) {
+        return *Facts;
+    }
+
+    SourceSet Result;
+    for (unsigned ID : *Facts) {
+        Result.set(Sources[ID].Stream != ~0u ? Sources[ID].Stream : ID);
+    }
+    return Result;
+}
+
+const TaintAnalysis::SourceSet *TaintAnalysis::streamsReadBy(const CallInst *CI) const
+{
+    auto It = ReadStreams.find(CI);
+    return It == ReadStreams.end() ? nullptr : &It->second;
+}
+
+const TaintAnalysis::SourceSet *TaintAnalysis::returnSourcesOf(const Function *F) const
+{
+    auto State = States.find(F);
+    return State == States.end() ? nullptr : &State->second->Facts[State->second->ReturnSlot];
+}
+
+const TaintAnalysis::SourceSet *TaintAnalysis::memorySourcesOf(const Function *F) const
+{
+    auto State = States.find(F);
+    return State == States.end() ? nullptr : &State->second->Facts[State->second->UnknownMemorySlot];
+}
+
+const TaintAnalysis::SourceSet *TaintAnalysis::globalSourcesOf(const GlobalVariable *GV) const
+{
+    auto Index = GlobalNumbering.find(GV);
+    return Index == GlobalNumbering.end() ? nullptr : &GlobalFacts[Index->second];
+}
+
+// Name of the variable a pointer refers to, taken from debug info when available
+std::string TaintAnalysis::variableName(const Value *V)
+{
+    const Value *Object = getUnderlyingObject(V);
+    if (const AllocaInst *AI = dyn_cast<AllocaInst>(Object)) {
+        for (DbgDeclareInst *DDI : FindDbgDeclareUses(const_cast<AllocaInst*>(AI))) {
+            return DDI->getVariable()->getName().str();
+        }
+    }
+    return Object->getName().str();
+}
+
+// Number the arguments and instructions of F and allocate its facts
+TaintAnalysis::FunctionState *TaintAnalysis::createState(Function &F)
+{
+    unsigned NumValues = F.arg_size();
+    for (BasicBlock &BB : F) {
+        NumValues += BB.size();
+    }
+
+    FunctionState *S = new (Alloc.Allocate<FunctionState>()) FunctionState();
+    S->F = &F;
+    S->NumValues = NumValues;
+    S->ReturnSlot = NumValues;
+    S->UnknownMemorySlot = NumValues + 1;
+    S->InWorklist = false;
+
+    unsigned NumSlots = NumValues + 2;
+    SourceSet *Facts = Alloc.Allocate<SourceSet>(NumSlots);
+    for (unsigned i = 0; i < NumSlots; i++) {
+        new (&Facts[i]) SourceSet();
+    }
+    S->Facts = MutableArrayRef<SourceSet>(Facts, NumSlots);
+
+    unsigned Index = 0;
+    for (Argument &A : F.args()) {
+        Numbering[&A] = Index++;
+    }
+    for (Instruction &I : instructions(F)) {
+        Numbering[&I] = Index++;
+    }
+
+    States[&F] = S;
+    return S;
+}
+
+void TaintAnalysis::enqueue(FunctionState *S)
+{
+    if (!S->InWorklist) {
+        S->InWorklist = true;
+        Worklist.push_back(S);
+    }
+}
+
+// Every function calling S.F has to see its new return value or memory sources
+void TaintAnalysis::enqueueCallers(const FunctionState &S)
+{
+    for (const User *U : S.F->users()) {
+        if (const CallInst *Caller = dyn_cast<CallInst>(U)) {
+            auto State = States.find(Caller->getFunction());
+            if (State != States.end()) {
+                enqueue(State->second);
+            }
+        }
+    }
+}
+
+// Iterate over the instructions of one function until its facts are stable
+void TaintAnalysis::solve(FunctionState &S)
+{
+    SourceSet Memory = S.Facts[S.UnknownMemorySlot];
+    bool Changed = true;
+    while (Changed) {
+        Changed = false;
+        for (const BasicBlock &BB : *S.F) {
+            for (const Instruction &I : BB) {
+                Changed |= transfer(S, const_cast<Instruction&>(I));
+            }
+        }
+    }
+    // memory reached through pointer parameters is copied back at the calls
+    if (S.Facts[S.UnknownMemorySlot] != Memory) {
+        enqueueCallers(S);
+    }
+}
+
+bool TaintAnalysis::transfer(FunctionState &S, Instruction &I)
+{
+    if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+        SourceSet &Memory = location(S, SI->getPointerOperand());
+        bool Changed = merge(Memory, SI->getValueOperand(), S);
+        if (Changed && isa<GlobalVariable>(getUnderlyingObject(SI->getPointerOperand()))) {
+            // every function reading the global has to see the new sources
+            for (auto &Entry : States) {
+                enqueue(Entry.second);
+            }
+        }
+        return Changed;
+    }
+
+    if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+        SourceSet &Result = fact(S, LI);
+        bool Changed = Result |= location(S, LI->getPointerOperand());
+        Changed |= merge(Result, LI->getPointerOperand(), S);
+        return Changed;
+    }
+
+    if (CallInst *CI = dyn_cast<CallInst>(&I)) {
+        return transferCall(S, CI);
+    }
+
+    if (ReturnInst *RI = dyn_cast<ReturnInst>(&I)) {
+        if (!RI->getReturnValue() || !merge(S.Facts[S.ReturnSlot], RI->getReturnValue(), S)) {
+            return false;
+        }
+        enqueueCallers(S);
+        return true;
+    }
+
+    if (I.getType()->isVoidTy() || isa<AllocaInst>(I)) {
+        return false;
+    }
+
+    // arithmetic, casts, compares, phis, selects, address computations
+    bool Changed = false;
+    SourceSet &Result = fact(S, &I);
+    for (Value *Operand : I.operands()) {
+        Changed |= merge(Result, Operand, S);
+    }
+    return Changed;
+}
+
+bool TaintAnalysis::transferCall(FunctionState &S, CallInst *CI)
+{
+    if (isa<DbgInfoIntrinsic>(CI)) {
+        return false;
+    }
+
+    if (MemTransferInst *MTI = dyn_cast<MemTransferInst>(CI)) {
+        return location(S, MTI->getRawDest()) |= location(S, MTI->getRawSource());
+    }
+
+    bool Changed = false;
+    if (seedInputCall(S, CI, Changed)) {
+        return Changed;
+    }
+
+    Function *Callee = CI->getCalledFunction();
+    auto State = Callee ? States.find(Callee) : States.end();
+    if (State != States.end()) {
+        // defined function: arguments flow into parameters, the return value flows back
+        FunctionState &T = *State->second;
+        bool CalleeChanged = false;
+        for (unsigned i = 0; i < CI->arg_size() && i < Callee->arg_size(); i++) {
+            Value *Arg = CI->getArgOperand(i);
+            CalleeChanged |= merge(T.Facts[i], Arg, S);
+            if (Arg->getType()->isPointerTy()) {
+                // memory reached through pointer parameters is shared with the callee
+                SourceSet &Memory = location(S, Arg);
+                CalleeChanged |= T.Facts[T.UnknownMemorySlot] |= Memory;
+                Changed |= Memory |= T.Facts[T.UnknownMemorySlot];
+            }
+        }
+        if (CalleeChanged) {
+            enqueue(&T);
+        }
+        Changed |= fact(S, CI) |= T.Facts[T.ReturnSlot];
+        return Changed;
+    }
+
+    // external or indirect call: the result depends on every argument
+    if (CI->getType()->isVoidTy()) {
+        return false;
+    }
+    SourceSet &Result = fact(S, CI);
+    Changed |= merge(Result, CI->getCalledOperand(), S);
+    for (Value *Arg : CI->args()) {
+        Changed |= merge(Result, Arg, S);
+        if (Arg->getType()->isPointerTy()) {
+            Changed |= Result |= location(S, Arg);
+        }
+    }
+    return Changed;
+}
+
+// Facts for the memory Ptr points into: its alloca, its global, or the
+// function's unknown memory slot
+TaintAnalysis::SourceSet &TaintAnalysis::location(FunctionState &S, Value *Ptr)
+{
+    const Value *Object = getUnderlyingObject(Ptr);
+    if (const AllocaInst *AI = dyn_cast<AllocaInst>(Object)) {
+        if (AI->getFunction() == S.F) {
+            return S.Facts[Numbering.lookup(AI)];
+        }
+    } else if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(Object)) {
+        return GlobalFacts[GlobalNumbering.lookup(GV)];
+    }
+    return S.Facts[S.UnknownMemorySlot];
+}
+
+TaintAnalysis::SourceSet &TaintAnalysis::fact(FunctionState &S, const Value *V)
+{
+    return S.Facts[Numbering.lookup(V)];
+}
+
+// Add the sources of V to Into. Constants and globals carry none, and the
+// slot of an alloca holds its contents, not the (untainted) address
+bool TaintAnalysis::merge(SourceSet &Into, const Value *V, FunctionState &S)
+{
+    if ((!isa<Instruction>(V) && !isa<Argument>(V)) || isa<AllocaInst>(V)) {
+        return false;
+    }
+    return Into |= fact(S, V);
+}
+
+unsigned TaintAnalysis::getSource(const CallInst *Key, unsigned Operand, FeatureKind Kind, const std::string &Name, const CallInst *At)
+{
+    auto Inserted = SourceIDs.try_emplace(std::make_pair(Key, Operand), Sources.size());
+    if (Inserted.second) {
+        InputSource Source;
+        Source.Call = At;
+        Source.Kind = Kind;
+        Source.Name = Name;
+        if (Key) {
+            Source.Operand = Operand;
+        }
+        if (At->getDebugLoc()) {
+            Source.Line = At->getDebugLoc().getLine();
+        }
+        Sources.push_back(Source);
+    }
+    return Inserted.first->second;
+}
+
+// The content of a stream is one source per stream, linked to its length source
+unsigned TaintAnalysis::getContentSource(unsigned Length)
+{
+    auto Inserted = ContentIDs.try_emplace(Length, Sources.size());
+    if (Inserted.second) {
+        InputSource Source = Sources[Length];
+        Source.Kind = Source.Kind == FeatureKind::StdinLength ? FeatureKind::StdinContent : FeatureKind::FileContent;
+        Source.Stream = Length;
+        Sources.push_back(Source);
+    }
+    return Inserted.first->second;
+}
+
+// Find the streams an I/O call reads: stdin, or the files whose length
+// source flows into the stream argument
+TaintAnalysis::SourceSet TaintAnalysis::streamSources(FunctionState &S, CallInst *CI, int StreamArg)
+{
+    SourceSet Streams;
+    if (StreamArg == IOModel::Stdin) {
+        Streams.set(getSource(nullptr, 0, FeatureKind::StdinLength, "stdin", CI));
+        return Streams;
+    }
+    if (StreamArg < 0 || (unsigned)StreamArg >= CI->arg_size()) {
+        return Streams;
+    }
+
+    Value *Stream = CI->getArgOperand(StreamArg);
+    if (LoadInst *LI = dyn_cast<LoadInst>(Stream)) {
+        GlobalVariable *GV = dyn_cast<GlobalVariable>(LI->getPointerOperand());
+        if (GV && GV->getName() == "stdin") {
+            return streamSources(S, CI, IOModel::Stdin);
+        }
+    }
+
+    if (isa<Instruction>(Stream) || isa<Argument>(Stream)) {
+        for (unsigned ID : fact(S, Stream)) {
+            FeatureKind Kind = Sources[ID].Kind;
+            if (Kind == FeatureKind::FileSize || Kind == FeatureKind::StdinLength) {
+                Streams.set(ID);
+            }
+        }
+    }
+    if (Streams.empty()) {
+        // a stream we did not see being opened
+        Streams.set(getSource(CI, StreamArg, FeatureKind::FileSize, variableName(Stream), CI));
+    }
+    return Streams;
+}
+
+// Apply the model of a called I/O API, see IOModels.h
+bool TaintAnalysis::seedInputCall(FunctionState &S, CallInst *CI, bool &Changed)
+{
+    Function *Callee = CI->getCalledFunction();
+    if (!Callee || !Callee->isDeclaration()) {
+        return false;
+    }
+
+    const IOModel *Model = lookupIOModel(Callee->getName());
+    if (!Model) {
+        return false;
+    }
+
+    SourceSet Streams;
+    if (Model->readsStream()) {
+        Streams = streamSources(S, CI, Model->Stream);
+        Changed |= ReadStreams[CI] |= Streams;
+    }
+
+    SourceSet Content;
+    for (unsigned Length : Streams) {
+        Content.set(getContentSource(Length));
+    }
+
+    switch (Model->Return) {
+        case IORole::NewStream: {
+            // name the file after the variable the stream is stored in
+            std::string Variable;
+            for (const User *U : CI->users()) {
+                if (const StoreInst *SI = dyn_cast<StoreInst>(U)) {
+                    Variable = variableName(SI->getPointerOperand());
+                    break;
+                }
+            }
+            Changed |= fact(S, CI).test_and_set(getSource(CI, ~0u, FeatureKind::FileSize, Variable, CI));
+            break;
+        }
+        case IORole::Content:
+            Changed |= fact(S, CI) |= Content;
+            break;
+        case IORole::Length:
+            Changed |= fact(S, CI) |= Streams;
+            if (Model->Measures != IOModel::None && (unsigned)Model->Measures < CI->arg_size()) {
+                // strlen of content read from a stream is the length of that stream
+                Value *Measured = CI->getArgOperand(Model->Measures);
+                SourceSet Lengths;
+                for (unsigned ID : location(S, Measured)) {
+                    Lengths.set(Sources[ID].Stream != ~0u ? Sources[ID].Stream : ID);
+                }
+                Changed |= fact(S, CI) |= Lengths;
+            }
+            break;
+        case IORole::None:
+            break;
+    }
+
+    if (Model->Buffer != IOModel::None && (unsigned)Model->Buffer < CI->arg_size()) {
+        Changed |= location(S, CI->getArgOperand(Model->Buffer)) |= Content;
+    }
+
+    if (Model->Values != IOModel::None) {
+        for (unsigned i = Model->Values; i < CI->arg_size(); i++) {
+            Value *Arg = CI->getArgOperand(i);
+            if (Arg->getType()->isPointerTy()) {
+                unsigned ID = getSource(CI, i, FeatureKind::ScalarValue, variableName(Arg), CI);
+                Changed |= location(S, Arg).test_and_set(ID);
+            }
+        }
+    }
+    return true;
+}
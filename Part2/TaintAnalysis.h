@@ -0,0 +1,154 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// TaintAnalysis.h
+
+// Def-use based taint analysis used by the input feature detector.
+// Every input source (a variable filled by scanf, a stream opened by
+// fopen, ...) gets a dense ID. The analysis computes, for every value in
+// the module, the set of source IDs that flow into it, following
+// def-use chains, loads and stores through stack and global memory, and
+// arguments / return values of calls.
+//
+// Values are numbered densely per function and their facts are kept in
+// flat arrays of SparseBitVector allocated from a bump allocator owned by
+// the analysis, so a run costs a few large allocations instead of one
+// node per fact. Call clear() at the end of the pass run to release it.
+//
+// Calls to I/O APIs are seeded from the models in IOModels.h: every
+// stream has a length source (file size or stdin length) and a content
+// source, so a loop that only tests getc() against EOF depends on the
+// length of the stream rather than on every character read.
+
+#ifndef TAINT_ANALYSIS_H
+#define TAINT_ANALYSIS_H
+
+#include "FeatureReport.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SparseBitVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Allocator.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+
+    // A part of the program input, created at the call that reads it
+    struct InputSource {
+        const CallInst *Call;
+        FeatureKind Kind;
+        std::string Name;       // variable the input is stored in, e.g. "n"
+        unsigned Line = 0;      // line of the call
+        unsigned Operand = ~0u; // argument of Call holding the input, ~0u for the return value
+        unsigned Stream = ~0u;  // for content sources, the length source of their stream
+    };
+
+    class TaintAnalysis {
+
+        public:
+            using SourceSet = SparseBitVector<>;
+
+            TaintAnalysis() = default;
+            TaintAnalysis(const TaintAnalysis &) = delete;
+            TaintAnalysis &operator=(const TaintAnalysis &) = delete;
+            ~TaintAnalysis() { clear(); }
+
+            // Number all values of M and propagate sources to a fixed point
+            void run(Module &M);
+
+            // Release all per-run state
+            void clear();
+
+            // Sources flowing into V, nullptr if V is not tracked
+            const SourceSet *sourcesOf(const Value *V) const;
+
+            // Sources a key point condition depends on: an end of input test
+            // (compare against EOF or NULL) depends on the length of the streams
+            // whose content it tests, not on the content itself
+            SourceSet featuresOf(const Value *Condition) const;
+
+            // Length sources of the streams read by an I/O call, nullptr if none
+            const SourceSet *streamsReadBy(const CallInst *CI) const;
+
+            // Sources flowing into the return value of F, and into memory F
+            // reaches through pointers, nullptr if F is not analyzed
+            const SourceSet *returnSourcesOf(const Function *F) const;
+            const SourceSet *memorySourcesOf(const Function *F) const;
+
+            // Sources stored in a global variable, nullptr if GV is not tracked
+            const SourceSet *globalSourcesOf(const GlobalVariable *GV) const;
+
+            const InputSource &source(unsigned ID) const { return Sources[ID]; }
+            unsigned numSources() const { return Sources.size(); }
+
+            // Name of the local or global variable V refers to, "" if unknown
+            static std::string variableName(const Value *V);
+
+        private:
+            // Per function state, all arrays live in Alloc
+            struct FunctionState {
+                const Function *F;
+                unsigned NumValues;             // arguments followed by instructions
+                unsigned ReturnSlot;            // sources flowing into the return value
+                unsigned UnknownMemorySlot;     // memory not attributable to an alloca or global
+                MutableArrayRef<SourceSet> Facts;
+                bool InWorklist;
+            };
+
+            BumpPtrAllocator Alloc;
+
+            // Dense numbering of arguments and instructions, local to their function
+            DenseMap<const Value*, unsigned> Numbering;
+            DenseMap<const Function*, FunctionState*> States;
+
+            // Contents of global variables
+            DenseMap<const GlobalVariable*, unsigned> GlobalNumbering;
+            std::vector<SourceSet> GlobalFacts;
+
+            std::vector<InputSource> Sources;
+            DenseMap<std::pair<const CallInst*, unsigned>, unsigned> SourceIDs;
+            DenseMap<unsigned, unsigned> ContentIDs;            // length source -> content source
+            DenseMap<const CallInst*, SourceSet> ReadStreams;
+
+            std::vector<FunctionState*> Worklist;
+
+            FunctionState *createState(Function &F);
+            void enqueue(FunctionState *S);
+            void enqueueCallers(const FunctionState &S);
+
+            // Iterate one function to a local fixed point
+            void solve(FunctionState &S);
+
+            // Transfer functions, return true if any fact grew
+            bool transfer(FunctionState &S, Instruction &I);
+            bool transferCall(FunctionState &S, CallInst *CI);
+
+            // Facts for the memory a pointer refers to
+            SourceSet &location(FunctionState &S, Value *Ptr);
+            SourceSet &fact(FunctionState &S, const Value *V);
+            bool merge(SourceSet &Into, const Value *V, FunctionState &S);
+
+            // Seed sources for calls to modeled I/O APIs, returns true if CI was one
+            bool seedInputCall(FunctionState &S, CallInst *CI, bool &Changed);
+
+            // Length sources of the stream passed as argument StreamArg of CI
+            SourceSet streamSources(FunctionState &S, CallInst *CI, int StreamArg);
+
+            // Source for Operand of CI (~0u for the return value), created on first use
+            unsigned getSource(const CallInst *Key, unsigned Operand, FeatureKind Kind, const std::string &Name, const CallInst *At);
+            unsigned getContentSource(unsigned Length);
+    };
+
+}
+
+#endif // TAINT_ANALYSIS_H
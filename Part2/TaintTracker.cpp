@@ -0,0 +1,534 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// TaintTracker.cpp
+
+#include "TaintTracker.h"
+#include "IOModels.h"
+#include "TaintAnalysis.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "input-taint-tracker"
+
+STATISTIC(NumTrackedFunctions, "Number of functions instrumented for taint tracking");
+STATISTIC(NumTrackedKeyPoints, "Number of key points recording their input labels");
+STATISTIC(NumTrackedInputCalls, "Number of input calls labeling their data");
+
+char TaintTracker::ID = 0;
+
+namespace {
+
+    // Library functions whose result is the number or length written in their string argument
+    bool readsString(StringRef Name) {
+        return Name == "atoi" || Name == "atol" || Name == "atoll" || Name == "atof"
+            || Name == "strtol" || Name == "strtoll" || Name == "strtoul" || Name == "strtoull"
+            || Name == "strtod" || Name == "strtof" || Name == "strlen";
+    }
+
+    // Name of the variable the stream opened by CI is stored in, as the static analysis names it
+    std::string streamName(CallInst *CI) {
+        for (User *U : CI->users()) {
+            if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+                return TaintAnalysis::variableName(SI->getPointerOperand());
+            }
+        }
+        return "file";
+    }
+
+    // An array of characters, which scanf fills with %s
+    bool isString(const Value *Ptr) {
+        const Value *Object = getUnderlyingObject(Ptr);
+        Type *Ty = nullptr;
+        if (const AllocaInst *AI = dyn_cast<AllocaInst>(Object)) {
+            Ty = AI->getAllocatedType();
+        } else if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(Object)) {
+            Ty = GV->getValueType();
+        }
+        return Ty && Ty->isArrayTy() && Ty->getArrayElementType()->isIntegerTy(8);
+    }
+
+    // Key of a stream in the runtime's table: a FILE* or a file descriptor
+    Value *streamKey(IRBuilder<> &IRB, Value *Stream) {
+        if (Stream->getType()->isPointerTy()) {
+            return IRB.CreatePtrToInt(Stream, IRB.getInt64Ty());
+        }
+        return IRB.CreateSExtOrTrunc(Stream, IRB.getInt64Ty());
+    }
+}
+
+bool TaintTracker::runOnModule(Module &Mod)
+{
+    M = &Mod;
+    LLVMContext &Context = M->getContext();
+    LabelTy = Type::getInt8Ty(Context);
+
+    ArrayType *SlotsTy = ArrayType::get(LabelTy, TT_ARG_SLOTS);
+    ArgLabels = new GlobalVariable(*M, SlotsTy, false, GlobalValue::ExternalLinkage, nullptr, "__tt_arg_labels",
+                                   nullptr, GlobalValue::GeneralDynamicTLSModel);
+    RetLabel = new GlobalVariable(*M, LabelTy, false, GlobalValue::ExternalLinkage, nullptr, "__tt_ret_label",
+                                  nullptr, GlobalValue::GeneralDynamicTLSModel);
+
+    // the number of key points is known after instrumenting, the counters
+    // are replaced by arrays of the right size then
+    SiteLabels = new GlobalVariable(*M, ArrayType::get(LabelTy, 0), false, GlobalValue::PrivateLinkage, nullptr, "tt.site_labels");
+    SiteEvents = new GlobalVariable(*M, ArrayType::get(Type::getInt64Ty(Context), 0), false, GlobalValue::PrivateLinkage, nullptr, "tt.site_events");
+
+    std::vector<Function*> Functions;
+    for (Function &F : *M) {
+        if (!F.isDeclaration()) {
+            Functions.push_back(&F);
+        }
+    }
+    for (Function *F : Functions) {
+        instrumentFunction(*F);
+        ++NumTrackedFunctions;
+    }
+    emitRegistration();
+
+    errs() << "tracking " << Labels.size() << " input labels at " << Branches.size() << " key points\n";
+    return true;
+}
+
+// Labels are handed out in the order inputs are found, the last bit is
+// shared once there are more inputs than bits
+unsigned TaintTracker::getLabel(const std::string &Name)
+{
+    auto Found = LabelBits.find(Name);
+    if (Found != LabelBits.end()) {
+        return Found->second;
+    }
+    if (Labels.size() == TT_MAX_LABELS) {
+        errs() << "Warning: more than " << TT_MAX_LABELS << " inputs, " << Name << " shares the label of " << Labels.back() << "\n";
+        Labels.back() += "|" + Name;
+    } else {
+        Labels.push_back(Name);
+    }
+    return LabelBits[Name] = Labels.size() - 1;
+}
+
+unsigned TaintTracker::stdinLabel()
+{
+    if (StdinLabel < 0) {
+        StdinLabel = getLabel("stdin");
+    }
+    return StdinLabel;
+}
+
+// Labels of arguments come from the slots the caller filled, every other
+// value gets its label right after it is computed; the labels of the
+// conditions of key points are recorded last, unless they are always 0
+void TaintTracker::instrumentFunction(Function &F)
+{
+    Shadows.clear();
+
+    std::vector<Instruction*> Original;
+    ReversePostOrderTraversal<Function*> RPOT(&F);
+    for (BasicBlock *BB : RPOT) {
+        for (Instruction &I : *BB) {
+            Original.push_back(&I);
+        }
+    }
+
+    IRBuilder<> Entry(&*F.getEntryBlock().getFirstInsertionPt());
+    for (Argument &A : F.args()) {
+        if (A.getArgNo() < TT_ARG_SLOTS) {
+            Value *Slot = Entry.CreateConstInBoundsGEP2_32(ArgLabels->getValueType(), ArgLabels, 0, A.getArgNo());
+            Shadows[&A] = Entry.CreateLoad(LabelTy, Slot, "tt.arg");
+        }
+    }
+
+    std::vector<PHINode*> Phis;
+    for (Instruction *I : Original) {
+        if (PHINode *PN = dyn_cast<PHINode>(I)) {
+            Shadows[PN] = PHINode::Create(LabelTy, PN->getNumIncomingValues(), "tt.phi", PN);
+            Phis.push_back(PN);
+        }
+    }
+
+    std::vector<std::pair<Instruction*, Value*>> KeyPoints;
+    for (Instruction *I : Original) {
+        instrumentInstruction(*I, KeyPoints);
+    }
+
+    for (PHINode *PN : Phis) {
+        PHINode *Label = cast<PHINode>(Shadows[PN]);
+        for (unsigned i = 0; i < PN->getNumIncomingValues(); i++) {
+            Label->addIncoming(shadow(PN->getIncomingValue(i)), PN->getIncomingBlock(i));
+        }
+    }
+
+    for (auto &KeyPoint : KeyPoints) {
+        recordBranch(KeyPoint.first, KeyPoint.second);
+    }
+}
+
+void TaintTracker::instrumentInstruction(Instruction &I, std::vector<std::pair<Instruction*, Value*>> &KeyPoints)
+{
+    const DataLayout &DL = M->getDataLayout();
+
+    if (isa<PHINode>(&I) || isa<DbgInfoIntrinsic>(&I)) {
+        return;
+    }
+
+    if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+        IRBuilder<> IRB(LI->getNextNode());
+        Shadows[LI] = loadLabel(IRB, LI->getPointerOperand(), DL.getTypeStoreSize(LI->getType()));
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+        IRBuilder<> IRB(SI);
+        storeLabel(IRB, SI->getPointerOperand(), DL.getTypeStoreSize(SI->getValueOperand()->getType()), shadow(SI->getValueOperand()));
+    } else if (AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
+        // a new frame must not see the labels an earlier one left on the stack
+        IRBuilder<> IRB(AI->getNextNode());
+        Value *Zero = ConstantInt::get(LabelTy, 0);
+        if (Optional<TypeSize> Bits = AI->getAllocationSizeInBits(DL)) {
+            storeLabel(IRB, AI, Bits->getFixedSize() / 8, Zero);
+        } else {
+            Value *Size = IRB.CreateMul(IRB.CreateZExtOrTrunc(AI->getArraySize(), IRB.getInt64Ty()),
+                                        IRB.getInt64(DL.getTypeAllocSize(AI->getAllocatedType())));
+            IRB.CreateCall(runtime("__tt_set_labels", IRB.getVoidTy(), {IRB.getInt8PtrTy(), IRB.getInt64Ty(), LabelTy}),
+                           {IRB.CreatePointerCast(AI, IRB.getInt8PtrTy()), Size, Zero});
+        }
+    } else if (CallInst *CI = dyn_cast<CallInst>(&I)) {
+        instrumentCall(CI);
+    } else if (BranchInst *BI = dyn_cast<BranchInst>(&I)) {
+        if (BI->isConditional()) {
+            KeyPoints.push_back({BI, shadow(BI->getCondition())});
+        }
+    } else if (SwitchInst *SI = dyn_cast<SwitchInst>(&I)) {
+        KeyPoints.push_back({SI, shadow(SI->getCondition())});
+    } else if (IndirectBrInst *IBI = dyn_cast<IndirectBrInst>(&I)) {
+        KeyPoints.push_back({IBI, shadow(IBI->getAddress())});
+    } else if (ReturnInst *RI = dyn_cast<ReturnInst>(&I)) {
+        if (RI->getReturnValue()) {
+            IRBuilder<> IRB(RI);
+            IRB.CreateStore(shadow(RI->getReturnValue()), RetLabel);
+        }
+    } else if (!I.isTerminator() && !I.getType()->isVoidTy()) {
+        // arithmetic, casts, compares, selects, address computations, ...
+        IRBuilder<> IRB(I.getNextNode());
+        SmallVector<Value*, 4> Operands(I.operands());
+        Shadows[&I] = combine(IRB, Operands);
+    }
+}
+
+// Calls to instrumented functions, and through pointers, pass labels in
+// the slots; library calls are modeled, or combine their scalar arguments
+void TaintTracker::instrumentCall(CallInst *CI)
+{
+    if (CI->isInlineAsm()) {
+        return;
+    }
+
+    IRBuilder<> IRB(CI->getNextNode());
+    Type *Int8Ptr = IRB.getInt8PtrTy();
+    Type *Int64 = IRB.getInt64Ty();
+    Type *Void = IRB.getVoidTy();
+
+    if (MemTransferInst *MT = dyn_cast<MemTransferInst>(CI)) {
+        IRB.CreateCall(runtime("__tt_copy_labels", Void, {Int8Ptr, Int8Ptr, Int64}),
+                       {MT->getRawDest(), MT->getRawSource(), IRB.CreateZExtOrTrunc(MT->getLength(), Int64)});
+        return;
+    }
+    if (MemSetInst *MS = dyn_cast<MemSetInst>(CI)) {
+        IRB.CreateCall(runtime("__tt_set_labels", Void, {Int8Ptr, Int64, LabelTy}),
+                       {MS->getRawDest(), IRB.CreateZExtOrTrunc(MS->getLength(), Int64), shadow(MS->getValue())});
+        return;
+    }
+
+    Function *Callee = CI->getCalledFunction();
+    if (Callee && Callee->isIntrinsic()) {
+        if (!CI->getType()->isVoidTy()) {
+            SmallVector<Value*, 4> Arguments(CI->args());
+            Shadows[CI] = combine(IRB, Arguments);
+        }
+        return;
+    }
+
+    if (!Callee || !Callee->isDeclaration()) {
+        IRBuilder<> Before(CI);
+        for (unsigned i = 0; i < CI->arg_size() && i < TT_ARG_SLOTS; i++) {
+            Value *Slot = Before.CreateConstInBoundsGEP2_32(ArgLabels->getValueType(), ArgLabels, 0, i);
+            Before.CreateStore(shadow(CI->getArgOperand(i)), Slot);
+        }
+        Before.CreateStore(ConstantInt::get(LabelTy, 0), RetLabel);
+        if (!CI->getType()->isVoidTy()) {
+            Shadows[CI] = IRB.CreateLoad(LabelTy, RetLabel, "tt.ret");
+        }
+        return;
+    }
+
+    if (instrumentInputCall(CI)) {
+        return;
+    }
+
+    StringRef Name = Callee->getName();
+    if ((Name == "memcpy" || Name == "memmove") && CI->arg_size() == 3) {
+        IRB.CreateCall(runtime("__tt_copy_labels", Void, {Int8Ptr, Int8Ptr, Int64}),
+                       {IRB.CreatePointerCast(CI->getArgOperand(0), Int8Ptr), IRB.CreatePointerCast(CI->getArgOperand(1), Int8Ptr),
+                        IRB.CreateZExtOrTrunc(CI->getArgOperand(2), Int64)});
+    } else if ((Name == "strcpy" || Name == "strcat") && CI->arg_size() == 2) {
+        IRB.CreateCall(runtime(Name == "strcpy" ? "__tt_copy_string" : "__tt_append_string", Void, {Int8Ptr, Int8Ptr}),
+                       {IRB.CreatePointerCast(CI->getArgOperand(0), Int8Ptr), IRB.CreatePointerCast(CI->getArgOperand(1), Int8Ptr)});
+    } else if (readsString(Name) && CI->arg_size() >= 1 && CI->getArgOperand(0)->getType()->isPointerTy()) {
+        Shadows[CI] = IRB.CreateCall(runtime("__tt_string_labels", LabelTy, {Int8Ptr}),
+                                     {IRB.CreatePointerCast(CI->getArgOperand(0), Int8Ptr)});
+    } else if (!CI->getType()->isVoidTy() && !CI->getType()->isPointerTy()) {
+        // math and character functions: the result depends on the scalar arguments
+        SmallVector<Value*, 4> Scalars;
+        for (Value *Arg : CI->args()) {
+            if (!Arg->getType()->isPointerTy()) {
+                Scalars.push_back(Arg);
+            }
+        }
+        Shadows[CI] = combine(IRB, Scalars);
+    }
+}
+
+// Label the data a modeled I/O call reads, see IOModels.h
+bool TaintTracker::instrumentInputCall(CallInst *CI)
+{
+    const IOModel *Model = lookupIOModel(CI->getCalledFunction()->getName());
+    if (!Model) {
+        return false;
+    }
+
+    const DataLayout &DL = M->getDataLayout();
+    IRBuilder<> IRB(CI->getNextNode());
+    Type *Int8Ptr = IRB.getInt8PtrTy();
+    Type *Int64 = IRB.getInt64Ty();
+    Type *Void = IRB.getVoidTy();
+    StringRef Name = CI->getCalledFunction()->getName();
+    Value *Stream = Model->readsStream() ? streamLabel(IRB, CI, Model->Stream) : nullptr;
+
+    switch (Model->Return) {
+        case IORole::NewStream: {
+            Value *Label = ConstantInt::get(LabelTy, 1u << getLabel(streamName(CI)));
+            IRB.CreateCall(runtime("__tt_open", Void, {Int64, LabelTy}), {streamKey(IRB, CI), Label});
+            break;
+        }
+        case IORole::Content:
+        case IORole::Length:
+            if (Stream) {
+                Shadows[CI] = Stream;
+            }
+            break;
+        case IORole::None:
+            break;
+    }
+
+    if (Model->Measures != IOModel::None && (unsigned)Model->Measures < CI->arg_size()) {
+        Shadows[CI] = IRB.CreateCall(runtime("__tt_string_labels", LabelTy, {Int8Ptr}),
+                                     {IRB.CreatePointerCast(CI->getArgOperand(Model->Measures), Int8Ptr)});
+    }
+
+    // content read into a buffer: as many bytes as the call says it read
+    if (Stream && Model->Buffer != IOModel::None && (unsigned)Model->Buffer < CI->arg_size()) {
+        Value *Buffer = IRB.CreatePointerCast(CI->getArgOperand(Model->Buffer), Int8Ptr);
+        FunctionCallee SetLabels = runtime("__tt_set_labels", Void, {Int8Ptr, Int64, LabelTy});
+        if (Name == "fread" && CI->arg_size() == 4) {
+            IRB.CreateCall(SetLabels, {Buffer, IRB.CreateMul(IRB.CreateZExtOrTrunc(CI, Int64), IRB.CreateZExtOrTrunc(CI->getArgOperand(1), Int64)), Stream});
+        } else if (Name == "read" && !CI->getType()->isVoidTy()) {
+            IRB.CreateCall(SetLabels, {Buffer, IRB.CreateSExtOrTrunc(CI, Int64), Stream});
+        } else if (Name == "fgets" || Name == "gets") {
+            IRB.CreateCall(runtime("__tt_set_string_labels", Void, {Int8Ptr, LabelTy}),
+                           {IRB.CreatePointerCast(CI, Int8Ptr), Stream});
+        }
+    }
+
+    // values stored by scanf get the label of their variable
+    if (Model->Values != IOModel::None) {
+        for (unsigned i = Model->Values; i < CI->arg_size(); i++) {
+            Value *Arg = CI->getArgOperand(i);
+            if (!Arg->getType()->isPointerTy()) {
+                continue;
+            }
+            Value *Label = ConstantInt::get(LabelTy, 1u << getLabel(TaintAnalysis::variableName(Arg)));
+            Type *Ty = Arg->getType()->getPointerElementType();
+            const Value *Object = getUnderlyingObject(Arg);
+            if (isString(Arg) || (Ty->isIntegerTy(8) && !isa<AllocaInst>(Object) && !isa<GlobalVariable>(Object))) {
+                // %s into a character array, or into memory of unknown type
+                IRB.CreateCall(runtime("__tt_set_string_labels", Void, {Int8Ptr, LabelTy}), {IRB.CreatePointerCast(Arg, Int8Ptr), Label});
+            } else if (Ty->isSized()) {
+                storeLabel(IRB, Arg, DL.getTypeStoreSize(Ty), Label);
+            }
+        }
+    }
+    ++NumTrackedInputCalls;
+    return true;
+}
+
+Value *TaintTracker::streamLabel(IRBuilder<> &IRB, CallInst *CI, int StreamArg)
+{
+    if (StreamArg == IOModel::Stdin) {
+        return ConstantInt::get(LabelTy, 1u << stdinLabel());
+    }
+    if (StreamArg < 0 || (unsigned)StreamArg >= CI->arg_size()) {
+        return nullptr;
+    }
+    Value *Stream = CI->getArgOperand(StreamArg);
+    if (LoadInst *LI = dyn_cast<LoadInst>(Stream)) {
+        GlobalVariable *GV = dyn_cast<GlobalVariable>(LI->getPointerOperand());
+        if (GV && GV->getName() == "stdin") {
+            return ConstantInt::get(LabelTy, 1u << stdinLabel());
+        }
+    }
+    stdinLabel();                       // a stream passed around may still be stdin
+    return IRB.CreateCall(runtime("__tt_stream_labels", LabelTy, {IRB.getInt64Ty()}), {streamKey(IRB, Stream)});
+}
+
+Value *TaintTracker::shadow(Value *V)
+{
+    auto It = Shadows.find(V);
+    return It != Shadows.end() ? It->second : ConstantInt::get(LabelTy, 0);
+}
+
+Value *TaintTracker::combine(IRBuilder<> &IRB, ArrayRef<Value*> Values)
+{
+    Value *Label = nullptr;
+    for (Value *V : Values) {
+        Value *S = shadow(V);
+        if (Constant *C = dyn_cast<Constant>(S)) {
+            if (C->isNullValue()) {
+                continue;
+            }
+        }
+        Label = Label ? IRB.CreateOr(Label, S, "tt.label") : S;
+    }
+    return Label ? Label : ConstantInt::get(LabelTy, 0);
+}
+
+// The shadow of 1, 2, 4 or 8 bytes is loaded as one integer and its bytes
+// are or-ed together, other sizes go through the runtime
+Value *TaintTracker::loadLabel(IRBuilder<> &IRB, Value *Ptr, uint64_t Size)
+{
+    if (Size == 1 || Size == 2 || Size == 4 || Size == 8) {
+        Type *IntTy = IRB.getIntNTy(Size * 8);
+        Value *Address = IRB.CreateXor(IRB.CreatePtrToInt(Ptr, IRB.getInt64Ty()), IRB.getInt64(TT_SHADOW_XOR));
+        Value *Bytes = IRB.CreateLoad(IntTy, IRB.CreateIntToPtr(Address, IntTy->getPointerTo()), "tt.shadow");
+        for (uint64_t Shift = Size * 4; Shift >= 8; Shift /= 2) {
+            Bytes = IRB.CreateOr(Bytes, IRB.CreateLShr(Bytes, Shift));
+        }
+        return IRB.CreateTrunc(Bytes, LabelTy, "tt.label");
+    }
+    return IRB.CreateCall(runtime("__tt_load_labels", LabelTy, {IRB.getInt8PtrTy(), IRB.getInt64Ty()}),
+                          {IRB.CreatePointerCast(Ptr, IRB.getInt8PtrTy()), IRB.getInt64(Size)}, "tt.label");
+}
+
+void TaintTracker::storeLabel(IRBuilder<> &IRB, Value *Ptr, uint64_t Size, Value *Label)
+{
+    if (Size == 1 || Size == 2 || Size == 4 || Size == 8) {
+        Type *IntTy = IRB.getIntNTy(Size * 8);
+        Value *Bytes = IRB.CreateMul(IRB.CreateZExt(Label, IntTy), ConstantInt::get(IntTy, 0x0101010101010101ULL));
+        Value *Address = IRB.CreateXor(IRB.CreatePtrToInt(Ptr, IRB.getInt64Ty()), IRB.getInt64(TT_SHADOW_XOR));
+        IRB.CreateStore(Bytes, IRB.CreateIntToPtr(Address, IntTy->getPointerTo()));
+        return;
+    }
+    if (Size > 0) {
+        IRB.CreateCall(runtime("__tt_set_labels", IRB.getVoidTy(), {IRB.getInt8PtrTy(), IRB.getInt64Ty(), LabelTy}),
+                       {IRB.CreatePointerCast(Ptr, IRB.getInt8PtrTy()), IRB.getInt64(Size), Label});
+    }
+}
+
+// labels[id] |= label, events[id] += label != 0, in counters of the module
+// so the hot path has no call and no branch; without a label the key
+// point gets no id
+void TaintTracker::recordBranch(Instruction *KeyPoint, Value *Label)
+{
+    if (Constant *C = dyn_cast<Constant>(Label)) {
+        if (C->isNullValue()) {
+            return;
+        }
+    }
+
+    BranchSite Site = {"", 0, 0};
+    if (const DebugLoc &Loc = KeyPoint->getDebugLoc()) {
+        Site.File = sys::path::filename(Loc->getFilename()).str();
+        Site.Line = Loc.getLine();
+        Site.Column = Loc.getCol();
+    }
+    unsigned ID = Branches.size();
+    Branches.push_back(Site);
+
+    IRBuilder<> IRB(KeyPoint);
+    Value *Labels = IRB.CreateConstInBoundsGEP2_64(SiteLabels->getValueType(), SiteLabels, 0, ID);
+    IRB.CreateStore(IRB.CreateOr(IRB.CreateLoad(LabelTy, Labels), Label), Labels);
+    Value *Events = IRB.CreateConstInBoundsGEP2_64(SiteEvents->getValueType(), SiteEvents, 0, ID);
+    Value *Event = IRB.CreateZExt(IRB.CreateIsNotNull(Label), IRB.getInt64Ty());
+    IRB.CreateStore(IRB.CreateAdd(IRB.CreateLoad(IRB.getInt64Ty(), Events), Event), Events);
+    ++NumTrackedKeyPoints;
+}
+
+// tt.register() calls __tt_register(labels, #labels, stdin label, sites,
+// site labels, site events, #sites) before main, sites are {file, line,
+// column} structs
+void TaintTracker::emitRegistration()
+{
+    LLVMContext &Context = M->getContext();
+    Type *Int8Ptr = Type::getInt8PtrTy(Context);
+    Type *Int32 = Type::getInt32Ty(Context);
+    StructType *SiteTy = StructType::get(Int8Ptr, Int32, Int32);
+
+    Function *Register = Function::Create(FunctionType::get(Type::getVoidTy(Context), false), GlobalValue::InternalLinkage, "tt.register", *M);
+    IRBuilder<> IRB(BasicBlock::Create(Context, "entry", Register));
+
+    std::vector<Constant*> Names;
+    for (const std::string &Label : Labels) {
+        Names.push_back(IRB.CreateGlobalStringPtr(Label, "tt.label_name"));
+    }
+    ArrayType *NamesTy = ArrayType::get(Int8Ptr, Names.size());
+    GlobalVariable *NameTable = new GlobalVariable(*M, NamesTy, true, GlobalValue::PrivateLinkage, ConstantArray::get(NamesTy, Names), "tt.labels");
+
+    std::vector<Constant*> Sites;
+    for (const BranchSite &Site : Branches) {
+        Sites.push_back(ConstantStruct::get(SiteTy, {IRB.CreateGlobalStringPtr(Site.File, "tt.file"),
+                                                     ConstantInt::get(Int32, Site.Line), ConstantInt::get(Int32, Site.Column)}));
+    }
+    ArrayType *SitesTy = ArrayType::get(SiteTy, Sites.size());
+    GlobalVariable *SiteTable = new GlobalVariable(*M, SitesTy, true, GlobalValue::PrivateLinkage, ConstantArray::get(SitesTy, Sites), "tt.sites");
+    GlobalVariable *LabelCounters = resize(SiteLabels, Sites.size());
+    GlobalVariable *EventCounters = resize(SiteEvents, Sites.size());
+
+    IRB.CreateCall(runtime("__tt_register", IRB.getVoidTy(), {Int8Ptr->getPointerTo(), Int32, Int32, Int8Ptr, Int8Ptr, IRB.getInt64Ty()->getPointerTo(), Int32}),
+                   {IRB.CreatePointerCast(NameTable, Int8Ptr->getPointerTo()), IRB.getInt32(Names.size()), IRB.getInt32(StdinLabel),
+                    IRB.CreatePointerCast(SiteTable, Int8Ptr), IRB.CreatePointerCast(LabelCounters, Int8Ptr),
+                    IRB.CreatePointerCast(EventCounters, IRB.getInt64Ty()->getPointerTo()), IRB.getInt32(Sites.size())});
+    IRB.CreateRetVoid();
+    appendToGlobalCtors(*M, Register, 0);
+}
+
+// Zero-initialized array of Size elements taking the place of the empty Counters
+GlobalVariable *TaintTracker::resize(GlobalVariable *Counters, unsigned Size)
+{
+    Type *ElementTy = Counters->getValueType()->getArrayElementType();
+    ArrayType *CountersTy = ArrayType::get(ElementTy, Size);
+    GlobalVariable *Resized = new GlobalVariable(*M, CountersTy, false, GlobalValue::PrivateLinkage,
+                                                 Constant::getNullValue(CountersTy), "");
+    Resized->takeName(Counters);
+    Counters->replaceAllUsesWith(ConstantExpr::getBitCast(Resized, Counters->getType()));
+    Counters->eraseFromParent();
+    return Resized;
+}
+
+FunctionCallee TaintTracker::runtime(StringRef Name, Type *Result, ArrayRef<Type*> Params)
+{
+    return M->getOrInsertFunction(Name, FunctionType::get(Result, Params, false));
+}
+
+static RegisterPass<TaintTracker> X("input-taint-tracker", "Part2: dynamic input taint tracking");
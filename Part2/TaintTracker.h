@@ -0,0 +1,126 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// TaintTracker.h
+
+// Dynamic taint tracking, to check the input features the detector finds
+// statically against what a run of the program actually does. The
+// -input-taint-tracker pass instruments a module so that every byte of
+// memory and every value carries a set of input labels, and the runtime
+// (TaintTrackerRuntime.c) writes, for every conditional branch, switch
+// and computed goto, the labels its condition had at run time. The
+// labels and events of a key point are counted inline in arrays of the
+// module, without atomics, so threads racing on one key point may lose
+// some of its events or labels.
+//
+// A label names an input the way the static report does: "stdin", the
+// variable a file stream was opened into ("fp"), or a variable scanf
+// stored a value in ("n"). Label sets are 8-bit masks, so a union is an
+// or and a program has at most 8 labels; later inputs share the last.
+//
+// Labels of memory live in shadow memory, one byte per byte of the
+// program, at the address of the byte xor TT_SHADOW_XOR. The runtime
+// reserves the shadow of the three regions a Linux x86-64 program uses
+// (low binary and heap, PIE binary and heap, mappings and stacks)
+// without committing it, so the shadow of a load or store is found with
+// one xor. Labels of values are SSA values next to the originals; they
+// are passed to and returned from instrumented functions in thread-local
+// slots, and calls to other functions combine the labels of their
+// scalar arguments (except for the input, copy and string-to-number
+// functions the pass knows).
+//
+// The labels of input come from the models in IOModels.h: content read
+// into a buffer or returned by getc gets the label of its stream, values
+// stored by scanf the label of their variable. Streams get their label
+// where they are opened, the runtime keeps a table from stream to label.
+
+#ifndef TAINT_TRACKER_H
+#define TAINT_TRACKER_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include <string>
+#include <vector>
+
+#define TT_SHADOW_XOR 0x500000000000ULL
+#define TT_MAX_LABELS 8
+#define TT_ARG_SLOTS 16
+
+namespace llvm {
+
+    class TaintTracker : public ModulePass {
+
+        public:
+            static char ID;
+            TaintTracker() : ModulePass(ID) {}
+
+            bool runOnModule(Module &M) override;
+
+        private:
+            Module *M = nullptr;
+            Type *LabelTy = nullptr;            // i8, a set of labels
+            GlobalVariable *ArgLabels = nullptr;
+            GlobalVariable *RetLabel = nullptr;
+            GlobalVariable *SiteLabels = nullptr;     // labels seen at each key point
+            GlobalVariable *SiteEvents = nullptr;     // and how often it had any
+
+            std::vector<std::string> Labels;    // name of each label bit, "a|b" for the shared last one
+            StringMap<unsigned> LabelBits;      // label bit of each input name
+            int StdinLabel = -1;
+
+            // file, line and column of every conditional branch, by branch id
+            struct BranchSite {
+                std::string File;
+                unsigned Line;
+                unsigned Column;
+            };
+            std::vector<BranchSite> Branches;
+
+            // Labels of the values of the function being instrumented
+            DenseMap<Value*, Value*> Shadows;
+
+            // Label bit of an input name, created on first use
+            unsigned getLabel(const std::string &Name);
+            unsigned stdinLabel();
+
+            void instrumentFunction(Function &F);
+            void instrumentInstruction(Instruction &I, std::vector<std::pair<Instruction*, Value*>> &KeyPoints);
+            void instrumentCall(CallInst *CI);
+            bool instrumentInputCall(CallInst *CI);
+
+            // Label of a value, 0 for constants and values not instrumented
+            Value *shadow(Value *V);
+
+            // Union of the labels of the given values, inserted with IRB
+            Value *combine(IRBuilder<> &IRB, ArrayRef<Value*> Values);
+
+            // Labels of the Size bytes at Ptr, and setting them to Label
+            Value *loadLabel(IRBuilder<> &IRB, Value *Ptr, uint64_t Size);
+            void storeLabel(IRBuilder<> &IRB, Value *Ptr, uint64_t Size, Value *Label);
+
+            // Label of the stream a modeled call reads, from its stream argument
+            Value *streamLabel(IRBuilder<> &IRB, CallInst *CI, int StreamArg);
+
+            // Record the label of a key point condition, when it has any
+            void recordBranch(Instruction *KeyPoint, Value *Label);
+
+            // Constructor handing the labels and branch sites to the runtime
+            void emitRegistration();
+            GlobalVariable *resize(GlobalVariable *Counters, unsigned Size);
+
+            FunctionCallee runtime(StringRef Name, Type *Result, ArrayRef<Type*> Params);
+    };
+
+}
+
+#endif // TAINT_TRACKER_H
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#define _GNU_SOURCE                             /* MAP_FIXED_NOREPLACE */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * runtime of the input taint tracker (TaintTracker.h)
+ * link it with the instrumented program:
+ *      opt -enable-new-pm=0 -load Part2/build/libInputFeatureDetector.so -input-taint-tracker example.ll -S -o tracked.ll
+ *      clang tracked.ll Part2/TaintTrackerRuntime.c -o tracked_example
+ *
+ * the labels of byte p of the program are at p ^ TT_SHADOW_XOR; the shadow of the
+ * regions the program can use is reserved (not committed) before main, pages of it
+ * are only backed once a label is written to them
+ *
+ * at exit every key point whose condition had input labels is written to TT_FILE,
+ * "taint_branches.<pid>" without it, one JSON object per line after a first line
+ * with the names of all labels of the program:
+ *      {"labels": ["stdin", "fp", "n"]}
+ *      {"file": "example.c", "line": 12, "column": 9, "labels": ["fp", "n"], "events": 3}
+ * where labels are the inputs that reached the condition in at least one of its events
+ * and events the number of times it was evaluated with any labels
+ */
+
+#define TT_SHADOW_XOR 0x500000000000ULL
+#define TT_STREAMS 256
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+struct tt_site {
+    const char *file;
+    uint32_t line;
+    uint32_t column;
+};
+
+__thread unsigned char __tt_arg_labels[16];
+__thread unsigned char __tt_ret_label;
+
+static const char **label_names;
+static uint32_t label_count;
+static unsigned char stdin_labels;
+static const struct tt_site *sites;
+static uint32_t site_count;
+static const unsigned char *site_labels;
+static const uint64_t *site_events;
+
+/* streams opened by the program, by FILE* or file descriptor */
+static struct {
+    int64_t key;
+    unsigned char labels;
+} streams[TT_STREAMS];
+
+static inline unsigned char *shadow_of(const void *address)
+{
+    return (unsigned char *) ((uintptr_t) address ^ TT_SHADOW_XOR);
+}
+
+/**
+ * reserves the shadow of the low binary and heap (0 - 0x10000000000), of PIE
+ * binaries and their heap (0x500000000000 - 0x600000000000) and of mappings and
+ * stacks (0x700000000000 - 0x800000000000)
+ */
+static void reserve_shadow(void)
+{
+    static const struct {
+        uintptr_t start;
+        size_t size;
+    } regions[] = {
+        {0x500000000000ULL, 0x010000000000ULL},
+        {0x010000000000ULL, 0x0f0000000000ULL},
+        {0x200000000000ULL, 0x100000000000ULL},
+    };
+    unsigned i;
+
+    for (i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+        void *shadow = mmap((void *) regions[i].start, regions[i].size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+        if (shadow != (void *) regions[i].start) {
+            fprintf(stderr, "taint tracker: cannot reserve shadow memory at %#lx\n", (unsigned long) regions[i].start);
+            abort();
+        }
+    }
+}
+
+static void write_label_names(FILE *file, unsigned char labels)
+{
+    const char *separator = "";
+    uint32_t i;
+
+    for (i = 0; i < label_count; i++) {
+        if (labels & (1u << i)) {
+            fprintf(file, "%s\"%s\"", separator, label_names[i]);
+            separator = ", ";
+        }
+    }
+}
+
+/**
+ * writes the labels of every key point input reached, registered with atexit
+ */
+static void write_branches(void)
+{
+    const char *path = getenv("TT_FILE");
+    char default_path[64];
+    FILE *file;
+    uint32_t i;
+
+    if (!path || !*path) {
+        snprintf(default_path, sizeof(default_path), "taint_branches.%d", (int) getpid());
+        path = default_path;
+    }
+    file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "taint tracker: cannot write %s\n", path);
+        return;
+    }
+    fprintf(file, "{\"labels\": [");
+    write_label_names(file, 0xff);
+    fprintf(file, "]}\n");
+    for (i = 0; i < site_count; i++) {
+        if (!site_events[i])
+            continue;
+        fprintf(file, "{\"file\": \"%s\", \"line\": %u, \"column\": %u, \"labels\": [",
+                sites[i].file, sites[i].line, sites[i].column);
+        write_label_names(file, site_labels[i]);
+        fprintf(file, "], \"events\": %llu}\n", (unsigned long long) site_events[i]);
+    }
+    fclose(file);
+}
+
+/**
+ * called by the constructor of the instrumented module, before any of its code
+ * parameters:
+ *      names: name of every label bit
+ *      count: number of label bits
+ *      stdin_label: bit of stdin, -1 if the module does not read it
+ *      key_points: file, line and column of every key point id
+ *      labels: labels seen at every key point, updated by the module
+ *      events: events of every key point with labels, updated by the module
+ *      key_point_count: number of key point ids
+ */
+void __tt_register(const char **names, uint32_t count, int32_t stdin_label, const struct tt_site *key_points,
+                   const unsigned char *labels, const uint64_t *events, uint32_t key_point_count)
+{
+    if (sites) {
+        fprintf(stderr, "taint tracker: only one instrumented module is tracked\n");
+        return;
+    }
+    reserve_shadow();
+    label_names = names;
+    label_count = count;
+    stdin_labels = stdin_label >= 0 ? (unsigned char) (1u << stdin_label) : 0;
+    sites = key_points;
+    site_labels = labels;
+    site_events = events;
+    site_count = key_point_count;
+    atexit(write_branches);
+}
+
+/**
+ * a stream was opened into a variable with the given label
+ * parameters:
+ *      key: the FILE* or file descriptor, 0 or -1 when opening failed
+ *      labels: the label of the variable
+ */
+void __tt_open(int64_t key, unsigned char labels)
+{
+    uint64_t slot;
+    unsigned i;
+
+    if (key == 0 || key == -1)
+        return;
+    slot = ((uint64_t) key * 0x9e3779b97f4a7c15ULL) >> 56;
+    for (i = 0; i < TT_STREAMS; i++, slot = (slot + 1) % TT_STREAMS) {
+        int64_t free_key = 0;
+        if (__atomic_load_n(&streams[slot].key, __ATOMIC_ACQUIRE) == key
+            || __atomic_compare_exchange_n(&streams[slot].key, &free_key, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            streams[slot].labels = labels;
+            return;
+        }
+    }
+}
+
+unsigned char __tt_stream_labels(int64_t key)
+{
+    uint64_t slot;
+    unsigned i;
+
+    if (key == 0 || key == (int64_t) (intptr_t) stdin)
+        return stdin_labels;
+    slot = ((uint64_t) key * 0x9e3779b97f4a7c15ULL) >> 56;
+    for (i = 0; i < TT_STREAMS; i++, slot = (slot + 1) % TT_STREAMS) {
+        int64_t found = __atomic_load_n(&streams[slot].key, __ATOMIC_ACQUIRE);
+        if (found == key)
+            return streams[slot].labels;
+        if (found == 0)
+            break;
+    }
+    return 0;
+}
+
+unsigned char __tt_load_labels(const void *address, uint64_t size)
+{
+    const unsigned char *shadow = shadow_of(address);
+    unsigned char labels = 0;
+    uint64_t i;
+
+    for (i = 0; i < size; i++)
+        labels |= shadow[i];
+    return labels;
+}
+
+void __tt_set_labels(void *address, int64_t size, unsigned char labels)
+{
+    if (size > 0)
+        memset(shadow_of(address), labels, size);
+}
+
+void __tt_copy_labels(void *destination, const void *source, int64_t size)
+{
+    if (size > 0)
+        memmove(shadow_of(destination), shadow_of(source), size);
+}
+
+/**
+ * labels of the characters of a string, up to and with its terminator
+ */
+unsigned char __tt_string_labels(const char *string)
+{
+    return string ? __tt_load_labels(string, strlen(string) + 1) : 0;
+}
+
+void __tt_set_string_labels(char *string, unsigned char labels)
+{
+    if (string)
+        __tt_set_labels(string, strlen(string) + 1, labels);
+}
+
+/**
+ * after strcpy(destination, source)
+ */
+void __tt_copy_string(char *destination, const char *source)
+{
+    __tt_copy_labels(destination, source, strlen(destination) + 1);
+}
+
+/**
+ * after strcat(destination, source), source is the end of destination
+ */
+void __tt_append_string(char *destination, const char *source)
+{
+    size_t appended = strlen(source);
+
+    __tt_copy_labels(destination + strlen(destination) - appended, source, appended + 1);
+}
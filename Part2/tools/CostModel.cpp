@@ -0,0 +1,487 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// CostModel.cpp
+
+// Cost model of a program over its seminal input features. Given a sweep
+// of runs, each with the values of the features InputFeatureDetector
+// reported for the program and the instructions the run took (callgrind,
+// or the calling-context tree of the branch tracer), it fits
+//
+//   instructions = c0 + c1 * t1(features) + c2 * t2(features) + ...
+//
+// where every term t is one of x, x^2, x^3, log2(x + 1), x * log2(x + 1),
+// the hinge max(0, x - k) at a quartile k of the feature's values (so the
+// model can be piecewise linear), or the product x * y of two features
+// (nested loops). Terms are chosen greedily, each time the one that
+// reduces the error most, as long as the Bayesian information criterion
+// improves; errors are relative, so short and long runs count alike.
+//
+//   cost_sweep.sh -o runs.jsonl tests/loop.c inputs/*.txt
+//   cost_model fit -report=output/loop.c_InputFeatures.jsonl -o model.json runs.jsonl
+//   cost_model predict -model=model.json new_inputs.jsonl
+//
+// A run is one JSON object per line, features are named "<kind>:<name>"
+// as in the report (the value of n read by scanf is "scalar_value:n"):
+//   {"input": "a.txt", "features": {"scalar_value:n": 100}, "instructions": 123456}
+// "instructions" is only needed to fit, and is compared with the
+// prediction when predicting.
+
+#include "FeatureReport.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<std::string> Arguments(cl::Positional,
+    cl::desc("fit|predict <runs>"), cl::OneOrMore);
+
+static cl::opt<std::string> ReportPath("report",
+    cl::desc("Input feature report of the program (JSON Lines), to fit"),
+    cl::value_desc("report"), cl::init(""));
+
+static cl::opt<std::string> ModelPath("model",
+    cl::desc("Model to predict with"),
+    cl::value_desc("model"), cl::init(""));
+
+static cl::opt<std::string> OutputPath("o",
+    cl::desc("File to write the fitted model to"),
+    cl::value_desc("model"), cl::init("model.json"));
+
+static cl::opt<unsigned> MaxTerms("max-terms",
+    cl::desc("Largest number of terms besides the constant"),
+    cl::init(6));
+
+namespace {
+
+    enum class TermKind { Linear, Square, Cube, Log, XLogX, Hinge, Product };
+
+    // One term of the model, a function of one or two features
+    struct Term {
+        TermKind Kind;
+        unsigned A = 0;             // index of the feature
+        unsigned B = 0;             // of the second feature of a product
+        double Knot = 0;            // of a hinge
+
+        double value(const std::vector<double> &X) const {
+            double x = X[A];
+            switch (Kind) {
+                case TermKind::Linear:  return x;
+                case TermKind::Square:  return x * x;
+                case TermKind::Cube:    return x * x * x;
+                case TermKind::Log:     return std::log2(std::max(x, 0.0) + 1);
+                case TermKind::XLogX:   return x * std::log2(std::max(x, 0.0) + 1);
+                case TermKind::Hinge:   return std::max(0.0, x - Knot);
+                case TermKind::Product: return x * X[B];
+            }
+            return 0;
+        }
+    };
+
+    struct Run {
+        std::string Input;
+        std::vector<double> Features;       // in the order of the model's features
+        Optional<double> Instructions;
+    };
+
+    const char *const KindNames[] = {"linear", "square", "cube", "log", "xlogx", "hinge", "product"};
+
+    std::string termText(const Term &T, const std::vector<std::string> &Features) {
+        StringRef x = StringRef(Features[T.A]).rsplit(':').second;
+        switch (T.Kind) {
+            case TermKind::Linear:  return x.str();
+            case TermKind::Square:  return x.str() + "^2";
+            case TermKind::Cube:    return x.str() + "^3";
+            case TermKind::Log:     return "log2(" + x.str() + " + 1)";
+            case TermKind::XLogX:   return x.str() + " * log2(" + x.str() + " + 1)";
+            case TermKind::Hinge:   return "max(0, " + x.str() + " - " + formatv("{0}", T.Knot).str() + ")";
+            case TermKind::Product: return x.str() + " * " + StringRef(Features[T.B]).rsplit(':').second.str();
+        }
+        return "";
+    }
+
+    // The fitted model: instructions = Coefficients[0] + sum of Coefficients[i + 1] * Terms[i]
+    struct Model {
+        std::vector<std::string> Features;
+        std::vector<Term> Terms;
+        std::vector<double> Coefficients;
+
+        double predict(const std::vector<double> &X) const {
+            double Y = Coefficients[0];
+            for (size_t i = 0; i < Terms.size(); i++) {
+                Y += Coefficients[i + 1] * Terms[i].value(X);
+            }
+            return Y;
+        }
+    };
+
+}
+
+// Solve the weighted least squares problem for the terms, Coefficients empty if singular
+static std::vector<double> solve(const std::vector<Run> &Runs, const std::vector<Term> &Terms, ArrayRef<size_t> Rows) {
+    size_t K = Terms.size() + 1;
+    auto column = [&](size_t Row, size_t j) { return j == 0 ? 1.0 : Terms[j - 1].value(Runs[Row].Features); };
+
+    // columns are scaled to 1 so that x^3 next to a constant does not ruin the conditioning
+    std::vector<double> Scale(K, 0.0);
+    for (size_t Row : Rows) {
+        for (size_t j = 0; j < K; j++) {
+            Scale[j] = std::max(Scale[j], std::fabs(column(Row, j)));
+        }
+    }
+    std::vector<double> A(K * K, 0.0), B(K, 0.0);
+    for (size_t Row : Rows) {
+        double Y = *Runs[Row].Instructions;
+        double W = 1.0 / std::max(Y * Y, 1.0);             // relative errors
+        std::vector<double> X(K);
+        for (size_t j = 0; j < K; j++) {
+            X[j] = Scale[j] > 0 ? column(Row, j) / Scale[j] : 0.0;
+        }
+        for (size_t i = 0; i < K; i++) {
+            for (size_t j = 0; j < K; j++) {
+                A[i * K + j] += W * X[i] * X[j];
+            }
+            B[i] += W * X[i] * Y;
+        }
+    }
+
+    // Cholesky decomposition A = L L^T, in place
+    for (size_t j = 0; j < K; j++) {
+        double D = A[j * K + j];
+        for (size_t k = 0; k < j; k++) {
+            D -= A[j * K + k] * A[j * K + k];
+        }
+        if (D <= 1e-12 * std::max(1.0, A[j * K + j])) {
+            return {};
+        }
+        A[j * K + j] = std::sqrt(D);
+        for (size_t i = j + 1; i < K; i++) {
+            double S = A[i * K + j];
+            for (size_t k = 0; k < j; k++) {
+                S -= A[i * K + k] * A[j * K + k];
+            }
+            A[i * K + j] = S / A[j * K + j];
+        }
+    }
+    std::vector<double> C(K);
+    for (size_t i = 0; i < K; i++) {
+        double S = B[i];
+        for (size_t k = 0; k < i; k++) {
+            S -= A[i * K + k] * C[k];
+        }
+        C[i] = S / A[i * K + i];
+    }
+    for (size_t i = K; i-- > 0;) {
+        double S = C[i];
+        for (size_t k = i + 1; k < K; k++) {
+            S -= A[k * K + i] * C[k];
+        }
+        C[i] = S / A[i * K + i];
+    }
+    for (size_t j = 0; j < K; j++) {
+        C[j] = Scale[j] > 0 ? C[j] / Scale[j] : 0.0;
+    }
+    return C;
+}
+
+// Sum of the squared relative errors of a model over some runs
+static double relativeError(const std::vector<Run> &Runs, const Model &M, ArrayRef<size_t> Rows) {
+    double Sum = 0;
+    for (size_t Row : Rows) {
+        double Y = *Runs[Row].Instructions;
+        double E = (M.predict(Runs[Row].Features) - Y) / std::max(Y, 1.0);
+        Sum += E * E;
+    }
+    return Sum;
+}
+
+// Read the runs of a sweep, with the values of the given features
+static bool readRuns(StringRef Path, const std::vector<std::string> &Features, std::vector<Run> &Runs,
+                     StringSet<> *Available) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+    if (!Buffer) {
+        errs() << "Error: Could not read runs " << Path << "\n";
+        return false;
+    }
+    SmallVector<StringRef, 16> Lines;
+    (*Buffer)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+    for (size_t LineNumber = 0; LineNumber < Lines.size(); LineNumber++) {
+        Expected<json::Value> Parsed = json::parse(Lines[LineNumber]);
+        if (!Parsed) {
+            consumeError(Parsed.takeError());
+            errs() << "Error: " << Path << ":" << LineNumber + 1 << " is not JSON\n";
+            return false;
+        }
+        const json::Object *Object = Parsed->getAsObject();
+        const json::Object *Values = Object ? Object->getObject("features") : nullptr;
+        if (!Values) {
+            errs() << "Error: " << Path << ":" << LineNumber + 1 << " has no features\n";
+            return false;
+        }
+        Run R;
+        Optional<StringRef> Input = Object->getString("input");
+        R.Input = Input ? Input->str() : "line " + std::to_string(LineNumber + 1);
+        if (Optional<double> Instructions = Object->getNumber("instructions")) {
+            R.Instructions = *Instructions;
+        }
+        if (Available) {                    // fitting: the features every run has a value of
+            StringSet<> Names;
+            for (const auto &Value : *Values) {
+                if (Value.second.getAsNumber()) {
+                    Names.insert(Value.first.str());
+                }
+            }
+            if (Runs.empty()) {
+                *Available = Names;
+            } else {
+                for (auto It = Available->begin(); It != Available->end();) {
+                    auto Next = std::next(It);
+                    if (!Names.count(It->getKey())) {
+                        Available->erase(It);
+                    }
+                    It = Next;
+                }
+            }
+        } else {
+            for (const std::string &Feature : Features) {
+                Optional<double> Value = Values->getNumber(Feature);
+                if (!Value) {
+                    errs() << "Error: " << R.Input << " has no value of " << Feature << "\n";
+                    return false;
+                }
+                R.Features.push_back(*Value);
+            }
+        }
+        Runs.push_back(std::move(R));
+    }
+    return true;
+}
+
+static int fit(StringRef RunsPath) {
+    FeatureReport Report;
+    if (ReportPath.empty() || !Report.readFromFile(ReportPath)) {
+        errs() << "Error: Could not read the feature report " << ReportPath << " (-report)\n";
+        return 1;
+    }
+
+    // Step 1: The features of the report that every run has a value of
+    std::vector<Run> Runs;
+    StringSet<> Available;
+    if (!readRuns(RunsPath, {}, Runs, &Available)) {
+        return 1;
+    }
+    Model M;
+    StringSet<> Seen;
+    for (const KeyPointRecord &Record : Report.records()) {
+        for (const InputFeature &Feature : Record.Features) {
+            std::string Name = (FeatureReport::kindName(Feature.Kind) + ":" + Feature.Name).str();
+            if (Available.count(Name) && Seen.insert(Name).second) {
+                M.Features.push_back(Name);
+            }
+        }
+    }
+    llvm::sort(M.Features);
+    Runs.clear();
+    if (!readRuns(RunsPath, M.Features, Runs, nullptr)) {
+        return 1;
+    }
+    if (llvm::any_of(Runs, [](const Run &R) { return !R.Instructions; })) {
+        errs() << "Error: Every run needs its instructions to fit a model\n";
+        return 1;
+    }
+    if (Runs.size() < 2) {
+        errs() << "Error: At least two runs are needed to fit a model\n";
+        return 1;
+    }
+    if (M.Features.empty()) {
+        errs() << "Warning: No feature of the report has a value in every run, the model is a constant\n";
+    }
+
+    // Step 2: Candidate terms
+    std::vector<Term> Candidates;
+    for (unsigned a = 0; a < M.Features.size(); a++) {
+        for (TermKind Kind : {TermKind::Linear, TermKind::Square, TermKind::Cube, TermKind::Log, TermKind::XLogX}) {
+            Candidates.push_back({Kind, a, 0, 0});
+        }
+        std::vector<double> Values;
+        for (const Run &R : Runs) {
+            Values.push_back(R.Features[a]);
+        }
+        llvm::sort(Values);
+        double Last = NAN;
+        for (unsigned q = 1; q <= 3; q++) {
+            double Knot = Values[q * (Values.size() - 1) / 4];
+            if (Knot > Values.front() && Knot < Values.back() && Knot != Last) {
+                Candidates.push_back({TermKind::Hinge, a, 0, Knot});
+            }
+            Last = Knot;
+        }
+        for (unsigned b = a + 1; b < M.Features.size(); b++) {
+            Candidates.push_back({TermKind::Product, a, b, 0});
+        }
+    }
+
+    // Step 3: Add the term that reduces the error most, as long as the BIC improves
+    std::vector<size_t> All(Runs.size());
+    for (size_t i = 0; i < All.size(); i++) {
+        All[i] = i;
+    }
+    double N = Runs.size();
+    auto bic = [&](double Error, size_t Parameters) { return N * std::log(std::max(Error / N, 1e-300)) + Parameters * std::log(N); };
+    M.Coefficients = solve(Runs, M.Terms, All);
+    double Best = bic(relativeError(Runs, M, All), 1);
+    while (M.Terms.size() < MaxTerms && M.Terms.size() + 2 < Runs.size()) {
+        Model BestModel;
+        double BestScore = Best;
+        for (const Term &Candidate : Candidates) {
+            Model Trial = M;
+            Trial.Terms.push_back(Candidate);
+            Trial.Coefficients = solve(Runs, Trial.Terms, All);
+            if (Trial.Coefficients.empty()) {
+                continue;
+            }
+            double Score = bic(relativeError(Runs, Trial, All), Trial.Terms.size() + 1);
+            if (Score < BestScore - 1e-9) {
+                BestScore = Score;
+                BestModel = std::move(Trial);
+            }
+        }
+        if (BestModel.Coefficients.empty()) {
+            break;
+        }
+        M = std::move(BestModel);
+        Best = BestScore;
+    }
+
+    // Step 4: How good it is: the mean relative error over the runs, and of each run left out of the fit
+    double Fitted = std::sqrt(relativeError(Runs, M, All) / N);
+    double CrossValidated = 0;
+    for (size_t Left = 0; Left < Runs.size(); Left++) {
+        std::vector<size_t> Rows;
+        for (size_t i = 0; i < Runs.size(); i++) {
+            if (i != Left) {
+                Rows.push_back(i);
+            }
+        }
+        Model Trial = M;
+        Trial.Coefficients = solve(Runs, Trial.Terms, Rows);
+        CrossValidated += Trial.Coefficients.empty() ? 1.0 : relativeError(Runs, Trial, {Left});
+    }
+    CrossValidated = std::sqrt(CrossValidated / N);
+
+    json::Array Terms;
+    std::string Formula = formatv("{0}", M.Coefficients[0]).str();
+    for (size_t i = 0; i < M.Terms.size(); i++) {
+        const Term &T = M.Terms[i];
+        json::Array Features{M.Features[T.A]};
+        if (T.Kind == TermKind::Product) {
+            Features.push_back(M.Features[T.B]);
+        }
+        Terms.push_back(json::Object{{"kind", KindNames[(int)T.Kind]}, {"features", std::move(Features)},
+                                     {"knot", T.Knot}, {"coefficient", M.Coefficients[i + 1]},
+                                     {"text", termText(T, M.Features)}});
+        Formula += formatv(" + {0} * {1}", M.Coefficients[i + 1], termText(T, M.Features)).str();
+    }
+    json::Object Output{
+        {"program", Report.records().empty() ? std::string() : Report.records().front().File},
+        {"features", json::Array(M.Features)},
+        {"constant", M.Coefficients[0]},
+        {"terms", std::move(Terms)},
+        {"runs", (int64_t)Runs.size()},
+        {"relative_error", Fitted},
+        {"cross_validated_error", CrossValidated}};
+
+    std::error_code EC;
+    raw_fd_ostream OS(OutputPath, EC, sys::fs::OF_Text);
+    if (EC) {
+        errs() << "Error: Could not write model " << OutputPath << "\n";
+        return 1;
+    }
+    OS << json::Value(std::move(Output)) << "\n";
+    outs() << "instructions = " << Formula << "\n"
+           << format("relative error %.2f%%, left-one-out %.2f%%, %zu runs\n", 100 * Fitted, 100 * CrossValidated, Runs.size());
+    return 0;
+}
+
+static int predict(StringRef RunsPath) {
+    auto Buffer = MemoryBuffer::getFile(ModelPath);
+    Expected<json::Value> Parsed = Buffer ? json::parse((*Buffer)->getBuffer())
+                                          : Expected<json::Value>(errorCodeToError(Buffer.getError()));
+    const json::Object *Object = Parsed ? Parsed->getAsObject() : nullptr;
+    const json::Array *Features = Object ? Object->getArray("features") : nullptr;
+    const json::Array *Terms = Object ? Object->getArray("terms") : nullptr;
+    Optional<double> Constant = Object ? Object->getNumber("constant") : None;
+    if (!Parsed) {
+        consumeError(Parsed.takeError());
+    }
+    if (!Features || !Terms || !Constant) {
+        errs() << "Error: Could not read model " << ModelPath << " (-model)\n";
+        return 1;
+    }
+
+    Model M;
+    StringMap<unsigned> Index;
+    for (const json::Value &Feature : *Features) {
+        Index[Feature.getAsString().getValueOr("")] = M.Features.size();
+        M.Features.push_back(Feature.getAsString().getValueOr("").str());
+    }
+    M.Coefficients.push_back(*Constant);
+    for (const json::Value &Entry : *Terms) {
+        const json::Object *T = Entry.getAsObject();
+        Optional<StringRef> Kind = T ? T->getString("kind") : None;
+        const json::Array *TermFeatures = T ? T->getArray("features") : nullptr;
+        const char *const *Name = Kind ? llvm::find(KindNames, *Kind) : std::end(KindNames);
+        if (Name == std::end(KindNames) || !TermFeatures || TermFeatures->empty() || !T->getNumber("coefficient")) {
+            errs() << "Error: Could not read model " << ModelPath << " (-model)\n";
+            return 1;
+        }
+        Term Parsed{(TermKind)(Name - std::begin(KindNames)), 0, 0, T->getNumber("knot").getValueOr(0)};
+        Parsed.A = Index.lookup((*TermFeatures)[0].getAsString().getValueOr(""));
+        if (TermFeatures->size() > 1) {
+            Parsed.B = Index.lookup((*TermFeatures)[1].getAsString().getValueOr(""));
+        }
+        M.Terms.push_back(Parsed);
+        M.Coefficients.push_back(*T->getNumber("coefficient"));
+    }
+
+    std::vector<Run> Runs;
+    if (!readRuns(RunsPath, M.Features, Runs, nullptr)) {
+        return 1;
+    }
+    for (const Run &R : Runs) {
+        double Predicted = std::max(0.0, M.predict(R.Features));
+        outs() << R.Input << ": " << format("%.0f", Predicted) << " instructions";
+        if (R.Instructions) {
+            outs() << format(", measured %.0f (%+.2f%%)", *R.Instructions, 100 * (Predicted - *R.Instructions) / std::max(*R.Instructions, 1.0));
+        }
+        outs() << "\n";
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "cost model over seminal input features\n");
+    if (Arguments.size() != 2 || (Arguments[0] != "fit" && Arguments[0] != "predict")) {
+        errs() << "Error: Usage: cost_model fit -report=<report> [-o <model>] <runs>, or cost_model predict -model=<model> <runs>\n";
+        return 1;
+    }
+    return Arguments[0] == "fit" ? fit(Arguments[1]) : predict(Arguments[1]);
+}
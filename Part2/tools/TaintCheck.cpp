@@ -0,0 +1,209 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// TaintCheck.cpp
+
+// Checks the input features InputFeatureDetector found statically
+// against the labels the taint tracker (TaintTracker.h) saw reach the
+// key points of a run. For every source line with a conditional branch,
+// switch or computed goto it prints the inputs both agree on, the ones
+// only the run saw (missed by the static analysis) and the ones only the
+// report has (not observed in the runs, or over-approximated).
+//
+//   taint_check -report=output/ex22.c_InputFeatures.jsonl taint_branches.1234 [more runs...]
+//
+// Features are compared by the input they name: file_size:fp and
+// file_content:fp are "fp", stdin_length and stdin_content "stdin",
+// scalar_value:n is "n" if n is a label of the run (a variable scanf
+// stored to). A label "a|b" that inputs share when there are more of
+// them than label bits agrees with a feature of any of its inputs. The
+// tracker follows data flow only, so inputs reaching a branch through
+// control dependence alone show up as not observed.
+// The exit status is 2 when a run saw inputs the report missed.
+
+#include "FeatureReport.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+using namespace llvm;
+
+static cl::list<std::string> RunPaths(cl::Positional,
+    cl::desc("<taint branches of a run>..."), cl::OneOrMore);
+
+static cl::opt<std::string> ReportPath("report",
+    cl::desc("Input feature report of the program (JSON Lines)"),
+    cl::value_desc("report"), cl::init(""));
+
+// Inputs reaching a source line, by file and line
+typedef std::map<std::pair<std::string, unsigned>, std::set<std::string>> LineInputs;
+
+static bool readRun(StringRef Path, LineInputs &Dynamic, StringSet<> &Labels) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+    if (!Buffer) {
+        errs() << "Error: Could not read taint branches " << Path << "\n";
+        return false;
+    }
+    SmallVector<StringRef, 16> Lines;
+    (*Buffer)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+    for (size_t LineNumber = 0; LineNumber < Lines.size(); LineNumber++) {
+        Expected<json::Value> Parsed = json::parse(Lines[LineNumber]);
+        if (!Parsed) {
+            consumeError(Parsed.takeError());
+            errs() << "Error: " << Path << ":" << LineNumber + 1 << " is not JSON\n";
+            return false;
+        }
+        const json::Object *Object = Parsed->getAsObject();
+        const json::Array *Names = Object ? Object->getArray("labels") : nullptr;
+        if (!Names) {
+            errs() << "Error: " << Path << ":" << LineNumber + 1 << " has no labels\n";
+            return false;
+        }
+        Optional<StringRef> File = Object->getString("file");
+        Optional<int64_t> Line = Object->getInteger("line");
+        for (const json::Value &Name : *Names) {
+            Optional<StringRef> Label = Name.getAsString();
+            if (!Label) {
+                continue;
+            }
+            if (!File) {                        // the first line: every label of the program
+                SmallVector<StringRef, 4> Inputs;
+                Label->split(Inputs, '|', -1, /*KeepEmpty=*/false);
+                Labels.insert(Inputs.begin(), Inputs.end());
+            } else if (Line) {
+                Dynamic[{File->str(), (unsigned)*Line}].insert(Label->str());
+            }
+        }
+    }
+    return true;
+}
+
+// The input a static feature names, "" if it is none the tracker labels
+static std::string inputOf(const InputFeature &Feature, const StringSet<> &Labels) {
+    switch (Feature.Kind) {
+        case FeatureKind::FileSize:
+        case FeatureKind::FileContent:
+            return Feature.Name;
+        case FeatureKind::StdinLength:
+        case FeatureKind::StdinContent:
+            return "stdin";
+        case FeatureKind::ScalarValue:
+            return Labels.count(Feature.Name) ? Feature.Name : "";
+        default:
+            return "";
+    }
+}
+
+static bool isBranch(KeyPointKind Kind) {
+    return Kind == KeyPointKind::Branch || Kind == KeyPointKind::IfElse
+        || Kind == KeyPointKind::Switch || Kind == KeyPointKind::IndirectBranch;
+}
+
+static void printInputs(StringRef Title, const std::set<std::string> &Inputs) {
+    if (Inputs.empty()) {
+        return;
+    }
+    outs() << "  " << Title << ":";
+    for (const std::string &Input : Inputs) {
+        outs() << " " << Input;
+    }
+    outs() << "\n";
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "static input features against dynamic taint labels\n");
+    FeatureReport Report;
+    if (ReportPath.empty() || !Report.readFromFile(ReportPath)) {
+        errs() << "Error: Could not read the feature report " << ReportPath << " (-report)\n";
+        return 1;
+    }
+
+    LineInputs Dynamic;
+    StringSet<> Labels;
+    for (const std::string &Path : RunPaths) {
+        if (!readRun(Path, Dynamic, Labels)) {
+            return 1;
+        }
+    }
+
+    LineInputs Static;
+    for (const KeyPointRecord &Record : Report.records()) {
+        if (!isBranch(Record.Kind)) {
+            continue;
+        }
+        for (const InputFeature &Feature : Record.Features) {
+            std::string Input = inputOf(Feature, Labels);
+            if (!Input.empty()) {
+                Static[{Record.File, Record.Line}].insert(Input);
+            }
+        }
+    }
+
+    // A label "a|b" is the last bit the tracker shares once a program has
+    // more inputs than bits: it stands for the inputs of it the report has,
+    // and is only missed as a whole if the report has none of them
+    for (auto &Entry : Dynamic) {
+        std::set<std::string> Resolved;
+        const std::set<std::string> &Found = Static[Entry.first];
+        for (const std::string &Label : Entry.second) {
+            SmallVector<StringRef, 4> Inputs;
+            StringRef(Label).split(Inputs, '|', -1, /*KeepEmpty=*/false);
+            bool Reported = false;
+            for (StringRef Input : Inputs) {
+                if (Found.count(Input.str())) {
+                    Resolved.insert(Input.str());
+                    Reported = true;
+                }
+            }
+            if (!Reported) {
+                Resolved.insert(Label);
+            }
+        }
+        Entry.second = Resolved;
+    }
+
+    LineInputs All = Static;
+    for (const auto &Entry : Dynamic) {
+        All[Entry.first].insert(Entry.second.begin(), Entry.second.end());
+    }
+
+    unsigned Confirmed = 0, Missed = 0, Unobserved = 0, Agreeing = 0;
+    for (const auto &Entry : All) {
+        const std::set<std::string> &Seen = Dynamic[Entry.first];
+        const std::set<std::string> &Found = Static[Entry.first];
+        std::set<std::string> Both, RunOnly, ReportOnly;
+        for (const std::string &Input : Entry.second) {
+            if (Seen.count(Input) && Found.count(Input)) {
+                Both.insert(Input);
+            } else if (Seen.count(Input)) {
+                RunOnly.insert(Input);
+            } else {
+                ReportOnly.insert(Input);
+            }
+        }
+        Confirmed += Both.size();
+        Missed += RunOnly.size();
+        Unobserved += ReportOnly.size();
+        Agreeing += RunOnly.empty() && ReportOnly.empty();
+
+        outs() << Entry.first.first << ":" << Entry.first.second << "\n";
+        printInputs("confirmed", Both);
+        printInputs("missed by the report", RunOnly);
+        printInputs("not observed", ReportOnly);
+    }
+    outs() << All.size() << " lines, " << Agreeing << " agreeing: " << Confirmed << " inputs confirmed, "
+           << Missed << " missed by the report, " << Unobserved << " not observed\n";
+    return Missed ? 2 : 0;
+}
@@ -0,0 +1,161 @@
+#!/bin/bash
+
+# Benchmarks the branch tracer and the input feature detector over the programs in tests/
+#
+# For every program it measures
+#   native_ms      run time of the uninstrumented program
+#   traced_ms      run time of the program instrumented by BranchTracer
+#   overhead       traced_ms / native_ms
+#   trace_bytes    size of the trace the instrumented program printed
+#   trace_events   number of lines in that trace
+#   instrument_ms  time of the -branch-pointer-tracer pass (opt)
+#   analysis_ms    time of the -input-pointer-tracer pass (opt, without the analysis cache)
+# times are the median of several runs, and the report holds one JSON object per program
+#
+# programs read their input from tests/inputs/<name>.txt and take the arguments
+# in tests/inputs/<name>.args, if those files exist
+#
+# usage: ./benchmark.sh [-r runs] [-o report] [-p "tracer options"] [-b baseline -t percent -n ms] [C files...]
+#   -r  runs per measurement (default 5)
+#   -o  report file (default output/benchmark.jsonl)
+#   -p  extra options for the tracer, e.g. "-coalesce-loops"
+#   -b  compare the report against a baseline report, exit 1 on a regression
+#   -t  a metric regressed if it grew by more than this many percent (default 10)
+#   -n  and, for times, by more than this many milliseconds (default 10)
+
+RUNS=5
+REPORT="output/benchmark.jsonl"
+TRACER_OPTIONS=""
+BASELINE=""
+THRESHOLD=10
+NOISE_MS=10
+TIMEOUT=60
+
+while getopts "r:o:p:b:t:n:" opt; do
+    case $opt in
+        r) RUNS="$OPTARG" ;;
+        o) REPORT="$OPTARG" ;;
+        p) TRACER_OPTIONS="$OPTARG" ;;
+        b) BASELINE="$OPTARG" ;;
+        t) THRESHOLD="$OPTARG" ;;
+        n) NOISE_MS="$OPTARG" ;;
+        *) sed -n '/^# usage/,/^$/p' "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+PROGRAMS=("$@")
+if [ ${#PROGRAMS[@]} -eq 0 ]; then
+    PROGRAMS=(tests/*.c)
+fi
+
+BENCH=bin/bench
+mkdir -p "$BENCH/work" "$BENCH/output" output    # the passes run in bin/bench/work and write to ../output
+
+# Step 1: Compile the passes
+echo -e "**** Compiling BranchTracer.cpp, BranchTracerRuntime.c and InputFeatureDetector.cpp ..."
+clang++ -shared -o bin/BranchTracer.so Part1/BranchTracer.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
+${CC:-clang} -O2 -fPIC -c Part1/BranchTracerRuntime.c -o bin/BranchTracerRuntime.o || exit 1
+clang++ -shared -o bin/InputFeatureDetector.so Part2/InputFeatureDetector.cpp Part2/FeatureReport.cpp Part2/TaintAnalysis.cpp Part2/IOModels.cpp Part2/LoopTripCount.cpp Part2/AnalysisCache.cpp Part2/FeatureExtractor.cpp Part2/TaintTracker.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
+
+# prints the median wall time of RUNS runs of a command, in milliseconds
+time_median() {
+    local times=()
+    for ((i = 0; i < RUNS; i++)); do
+        local start=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        local end=$(date +%s%N)
+        times+=($((end - start)))
+    done
+    printf "%s\n" "${times[@]}" | sort -n | awk '{ t[NR] = $1 } END { printf "%.3f", t[int((NR + 1) / 2)] / 1000000 }'
+}
+
+# runs a benchmark program with its canned input and arguments
+run_program() {
+    timeout "$TIMEOUT" "$1" "${ARGS[@]}" < "$INPUT"
+}
+
+# compiles LLVM IR to an executable the same way for the native and the traced program
+build_executable() {
+    llc -O0 -relocation-model=pic -filetype=obj "$1" -o "$2.o" && ${CC:-clang} "$2.o" "${@:3}" -o "$2" -lm -pthread
+}
+
+: > "$REPORT"
+printf "\n%-14s %12s %12s %9s %12s %12s %14s %12s\n" program native_ms traced_ms overhead trace_bytes trace_events instrument_ms analysis_ms
+
+for C_FILE_PATH in "${PROGRAMS[@]}"; do
+    filename=$(basename "$C_FILE_PATH")
+    file="${filename%.*}"
+    INPUT="tests/inputs/${file}.txt"
+    [ -f "$INPUT" ] || INPUT=/dev/null
+    ARGS=()
+    [ -f "tests/inputs/${file}.args" ] && read -r -a ARGS < "tests/inputs/${file}.args"
+
+    # Step 2: Generate LLVM IR and instrument it
+    if ! clang -O0 -g -S -emit-llvm "$C_FILE_PATH" -o "$BENCH/${file}.ll" 2> /dev/null; then
+        echo "Error: could not compile $C_FILE_PATH, skipping it" >&2
+        continue
+    fi
+    instrument_ms=$(cd "$BENCH/work" && time_median opt -enable-new-pm=0 -load ../../BranchTracer.so -branch-pointer-tracer $TRACER_OPTIONS -S "../${file}.ll" -o "../traced_${file}.ll")
+    analysis_ms=$(cd "$BENCH/work" && time_median opt -enable-new-pm=0 -load ../../InputFeatureDetector.so -input-pointer-tracer -ifd-no-cache -disable-output "../${file}.ll")
+
+    # Step 3: Build and time both programs
+    if ! build_executable "$BENCH/${file}.ll" "$BENCH/${file}" || ! build_executable "$BENCH/traced_${file}.ll" "$BENCH/traced_${file}" bin/BranchTracerRuntime.o; then
+        echo "Error: could not build $C_FILE_PATH, skipping it" >&2
+        continue
+    fi
+    native_ms=$(time_median run_program "$BENCH/${file}")
+    traced_ms=$(time_median run_program "$BENCH/traced_${file}")
+
+    # Step 4: Measure the trace, the lines the instrumentation added to the program's output
+    run_program "$BENCH/traced_${file}" 2> /dev/null | grep -E '^(br_[0-9]+|\*func_)' > "$BENCH/${file}.trace"
+    trace_bytes=$(wc -c < "$BENCH/${file}.trace")
+    trace_events=$(wc -l < "$BENCH/${file}.trace")
+    overhead=$(awk -v n="$native_ms" -v t="$traced_ms" 'BEGIN { printf "%.3f", (n > 0 ? t / n : 0) }')
+
+    printf "%-14s %12s %12s %9s %12s %12s %14s %12s\n" "$file" "$native_ms" "$traced_ms" "$overhead" "$trace_bytes" "$trace_events" "$instrument_ms" "$analysis_ms"
+    printf '{"analysis_ms":%s,"instrument_ms":%s,"name":"%s","native_ms":%s,"overhead":%s,"trace_bytes":%s,"trace_events":%s,"traced_ms":%s}\n' \
+        "$analysis_ms" "$instrument_ms" "$file" "$native_ms" "$overhead" "$trace_bytes" "$trace_events" "$traced_ms" >> "$REPORT"
+done
+
+echo -e "\n**** Report written to $REPORT"
+
+if [ -z "$BASELINE" ]; then
+    exit 0
+fi
+
+# Step 5: Compare against the baseline, the run time of the native program is not ours to regress
+echo -e "**** Comparing against $BASELINE (threshold ${THRESHOLD}%, ${NOISE_MS} ms)"
+awk -v threshold="$THRESHOLD" -v noise="$NOISE_MS" '
+function field(line, key) {
+    if (!match(line, "\"" key "\":[^,}]*"))
+        return ""
+    value = substr(line, RSTART + length(key) + 3, RLENGTH - length(key) - 3)
+    gsub(/"/, "", value)
+    return value
+}
+BEGIN { split("traced_ms overhead trace_bytes trace_events instrument_ms analysis_ms", metrics, " ") }
+FNR == NR { baseline[field($0, "name")] = $0; next }
+{
+    name = field($0, "name")
+    if (!(name in baseline))
+        next
+    for (m = 1; m in metrics; m++) {
+        key = metrics[m]
+        before = field(baseline[name], key) + 0
+        after = field($0, key) + 0
+        if (after <= before * (1 + threshold / 100))
+            continue
+        if (key ~ /_ms$/ && after - before <= noise)
+            continue
+        printf "regression: %s %s %s -> %s\n", name, key, before, after
+        regressed = 1
+    }
+}
+END { exit regressed }
+' "$BASELINE" "$REPORT"
+status=$?
+if [ $status -eq 0 ]; then
+    echo "**** No regressions"
+fi
+exit $status
@@ -26,12 +26,12 @@ opt -enable-new-pm=0 -load ../bin/BranchTracer.so -branch-pointer-tracer < "../b
 
 cd ../
 
-# Step 4: Make the transformed file executable
-chmod +x "bin/transformed_${file}.ll"
+# Step 4: Link the transformed file with the tracer runtime
+clang -O0 "bin/transformed_${file}.ll" Part1/BranchTracerRuntime.c -pthread -o "bin/traced_${file}"
 
-# Step 5: Execute the transformed file
-echo -e "\n**** Running the transformed file: ./bin/transformed_${file}.ll"
-"./bin/transformed_${file}.ll"
+# Step 5: Execute the traced program, the trace is decoded with the branch dictionary
+echo -e "\n**** Running the traced program: ./bin/traced_${file}"
+"./bin/traced_${file}" | ./decode_trace.sh -d "output/${filename}_BranchDictionary.txt"
 
 # Step 6: Compile the original C file
 echo -e "\n\b**** compiling original C file to /bin/${file}"
@@ -0,0 +1,99 @@
+#!/bin/bash
+
+# Runs a program on a sweep of inputs and records, for each input, the values of its
+# seminal input features and the instructions it executed, as the runs Part2/tools/cost_model
+# fits a cost model to
+#
+# the instructions are counted by callgrind (-c callgrind, the default), or estimated by
+# the calling-context tree of the branch tracer (-c cct) where valgrind is not available
+# the feature values of an input come from <input>.features, a JSON object such as
+# {"scalar_value:n": 100}, or else from the feature extractor the detector generates for
+# the program, and its length is "stdin_length:stdin"
+# each input is given to the program on stdin, with the arguments in <input without extension>.args
+#
+# usage: ./cost_sweep.sh [-c callgrind|cct] [-o runs] <C file> <input files...>
+#   -c  how the instructions are counted (default callgrind)
+#   -o  runs file (default output/<file>_runs.jsonl)
+#
+# then: cost_model fit -report=output/<file>.c_InputFeatures.jsonl -o model.json <runs>
+
+COUNTER=callgrind
+RUNS_FILE=""
+
+while getopts "c:o:" opt; do
+    case $opt in
+        c) COUNTER="$OPTARG" ;;
+        o) RUNS_FILE="$OPTARG" ;;
+        *) sed -n '/^# usage/,/^$/p' "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 2 ] || { [ "$COUNTER" != callgrind ] && [ "$COUNTER" != cct ]; }; then
+    sed -n '/^# usage/,/^$/p' "$0"
+    exit 1
+fi
+
+C_FILE_PATH="$1"
+shift
+filename=$(basename "$C_FILE_PATH")
+file="${filename%.*}"
+RUNS_FILE="${RUNS_FILE:-output/${file}_runs.jsonl}"
+SWEEP=bin/sweep
+mkdir -p "$SWEEP/work" "$SWEEP/output" output    # the passes run in bin/sweep/work and write their dictionary and cache to ../output
+
+# Step 1: Generate LLVM IR, and the feature report the model is fitted over
+echo -e "**** Analyzing ${C_FILE_PATH} ..."
+clang -O0 -g -S -emit-llvm "$C_FILE_PATH" -o "$SWEEP/${file}.ll" || exit 1
+clang++ -shared -o bin/InputFeatureDetector.so Part2/InputFeatureDetector.cpp Part2/FeatureReport.cpp Part2/TaintAnalysis.cpp Part2/IOModels.cpp Part2/LoopTripCount.cpp Part2/AnalysisCache.cpp Part2/FeatureExtractor.cpp Part2/TaintTracker.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
+(cd "$SWEEP/work" && opt -enable-new-pm=0 -load ../../InputFeatureDetector.so -input-pointer-tracer -ifd-output="../../../output/${filename}_InputFeatures.jsonl" -ifd-extractor="../features_${file}.ll" -disable-output "../${file}.ll") > /dev/null
+clang -O0 "$SWEEP/features_${file}.ll" -lm -o "$SWEEP/features_${file}" 2> /dev/null || echo "Warning: could not build the feature extractor, only <input>.features files are used" >&2
+
+# Step 2: Build the program to measure
+if [ "$COUNTER" = cct ]; then
+    clang++ -shared -o bin/BranchTracer.so Part1/BranchTracer.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
+    (cd "$SWEEP/work" && opt -enable-new-pm=0 -load ../../BranchTracer.so -branch-pointer-tracer -calling-context -coalesce-loops -S "../${file}.ll" -o "../measured_${file}.ll") > /dev/null 2>&1 || exit 1
+    clang -O0 "$SWEEP/measured_${file}.ll" Part1/BranchTracerRuntime.c -pthread -lm -o "$SWEEP/${file}" || exit 1
+else
+    clang -O0 "$C_FILE_PATH" -lm -o "$SWEEP/${file}" || exit 1
+fi
+
+# prints the instructions of one run of the program on an input
+count_instructions() {
+    local input="$1" args=()
+    [ -f "${input%.*}.args" ] && read -r -a args < "${input%.*}.args"
+    if [ "$COUNTER" = cct ]; then
+        BT_CCT_FILE="$SWEEP/run.cct" "$SWEEP/${file}" "${args[@]}" < "$input" > /dev/null 2>&1
+        awk '/^# thread/ { total += $(NF - 1) } END { print total + 0 }' "$SWEEP/run.cct"
+    else
+        valgrind --tool=callgrind --callgrind-out-file="$SWEEP/run.callgrind" "$SWEEP/${file}" "${args[@]}" < "$input" > /dev/null 2>&1
+        awk '/^(summary|totals):/ { print $2; exit }' "$SWEEP/run.callgrind"
+    fi
+}
+
+# Step 3: One run per input
+echo -e "**** Running ${file} on $# inputs, counting instructions with ${COUNTER} ..."
+: > "$RUNS_FILE"
+for input in "$@"; do
+    instructions=$(count_instructions "$input")
+    extra=""
+    if [ -f "${input}.features" ]; then
+        extra=$(tr -d '\n' < "${input}.features")
+    elif [ -x "$SWEEP/features_${file}" ]; then
+        args=()
+        [ -f "${input%.*}.args" ] && read -r -a args < "${input%.*}.args"
+        extra=$(timeout 10 "$SWEEP/features_${file}" "${args[@]}" < "$input" 2> /dev/null | tail -n 1)
+    fi
+    extra=$(printf '%s' "$extra" | sed -e 's/^[[:space:]]*{//' -e 's/}[[:space:]]*$//')
+    features="\"stdin_length:stdin\":$(wc -c < "$input")"
+    if [[ "$extra" == *'"stdin_length:stdin"'* ]]; then
+        features="$extra"
+    elif [ -n "${extra//[[:space:]]/}" ]; then
+        features="${features},${extra}"
+    fi
+    printf '{"input":"%s","features":{%s},"instructions":%s}\n' "$input" "$features" "${instructions:-0}" >> "$RUNS_FILE"
+    printf "%-40s %14s\n" "$input" "${instructions:-0}"
+done
+
+echo -e "\n**** Runs written to $RUNS_FILE, fit them with"
+echo "build/feature-tools/cost_model fit -report=output/${filename}_InputFeatures.jsonl -o output/${file}_model.json $RUNS_FILE"
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Decodes a branch-pointer trace
+# the trace holds branch ids only ("br_4"), with a branch dictionary every id is
+# resolved to the branch and target lines it stands for ("br_4: 6, 7")
+# lines recorded with -coalesce-loops ("br_4 x1000") are expanded back into the
+# per-iteration trace (1000 "br_4" lines)
+# chunked traces (written with BT_TRACE_FILE) are printed as text by trace_dump first,
+# built from Part1/tools (set TRACE_DUMP if it is not in build/tools)
+# usage: ./decode_trace.sh [-d dictionary] [trace_file]    (reads stdin without a file)
+
+DICTIONARY=""
+while getopts "d:" opt; do
+    case $opt in
+        d) DICTIONARY="$OPTARG" ;;
+        *) sed -n '/^# usage/p' "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -gt 0 ] && [ "$(head -c 4 "$1")" = "BTRC" ]; then
+    "${TRACE_DUMP:-build/tools/trace_dump}" "$1" | "$0" ${DICTIONARY:+-d "$DICTIONARY"}
+    exit
+fi
+
+awk -v dictionary="$DICTIONARY" '
+BEGIN {
+    # dictionary lines are "br_<id>: <file>, <branch line>, <target line>"
+    while (dictionary != "" && (getline entry < dictionary) > 0) {
+        split(entry, parts, ": ")
+        text[parts[1]] = substr(entry, length(parts[1]) + 3)
+        sub(/^[^,]*, /, "", text[parts[1]])
+    }
+}
+/^br_[0-9]+( x[0-9]+)?$/ {
+    count = NF == 2 ? substr($2, 2) : 1
+    line = ($1 in text) ? $1 ": " text[$1] : $1
+    for (i = 0; i < count; i++)
+        print line
+    next
+}
+{ print }
+' "$@"
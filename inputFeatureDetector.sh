@@ -10,6 +10,7 @@ C_FILE_PATH="$1"
 filename=$(basename "$C_FILE_PATH")     # Extracts "example.c"
 file="${filename%.*}"
 mkdir -p bin   # Creates bin folder if it doesn't exist
+mkdir -p output   # Creates output folder for the dictionary and feature report
 cd build
 
 # Step 1: Generate LLVM IR from the C file
@@ -18,7 +19,7 @@ clang -g -S -emit-llvm "../$C_FILE_PATH" -o "../bin/${file}.ll"
 
 # Step 2: Compile InputFeatureDetector.cpp to a shared object
 echo -e "Compiling InputFeatureDetector.cpp"
-clang++ -shared -o ../bin/InputFeatureDetector.so ../Part2/InputFeatureDetector.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC
+clang++ -shared -o ../bin/InputFeatureDetector.so ../Part2/InputFeatureDetector.cpp ../Part2/FeatureReport.cpp ../Part2/TaintAnalysis.cpp ../Part2/IOModels.cpp ../Part2/LoopTripCount.cpp ../Part2/AnalysisCache.cpp ../Part2/FeatureExtractor.cpp ../Part2/TaintTracker.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
 
 # Step 3: Transform LLVM IR using InputFeatureDetector.so
 echo -e "\nTransforming ${C_FILE_PATH} to /bin/${file}.ll"
@@ -0,0 +1,110 @@
+#!/bin/bash
+
+# Measures how the branch tracer and the input feature detector scale with program size
+#
+# tests/generator/ProgramGenerator.cpp writes synthetic C programs with a given number
+# of functions; for each size this script records the pass time (median of several runs)
+# and the peak resident memory of opt for both passes, as one JSON object per size
+# the "slope" columns are the log-log slope against the previous size: about 1 for
+# linear passes, about 2 for quadratic ones
+#
+# usage: ./scaling.sh [-r runs] [-o report] [-s "sizes"] [-g "generator options"]
+#   -r  runs per measurement (default 3)
+#   -o  report file (default output/scaling.jsonl)
+#   -s  numbers of functions to generate (default "10 50 200 1000 2000", about 500 to 100000 lines)
+#   -g  extra generator options, e.g. "-branches 8 -loops 4 -seed 7"
+
+RUNS=3
+REPORT="output/scaling.jsonl"
+SIZES="10 50 200 1000 2000"
+GENERATOR_OPTIONS=""
+
+while getopts "r:o:s:g:" opt; do
+    case $opt in
+        r) RUNS="$OPTARG" ;;
+        o) REPORT="$OPTARG" ;;
+        s) SIZES="$OPTARG" ;;
+        g) GENERATOR_OPTIONS="$OPTARG" ;;
+        *) sed -n '/^# usage/,/^$/p' "$0"; exit 1 ;;
+    esac
+done
+
+BENCH=bin/scaling
+mkdir -p "$BENCH/work" "$BENCH/output" output    # the passes run in bin/scaling/work and write to ../output
+
+# Step 1: Compile the generator and the passes
+echo -e "**** Compiling ProgramGenerator.cpp, BranchTracer.cpp and InputFeatureDetector.cpp ..."
+clang++ -O2 -o bin/ProgramGenerator tests/generator/ProgramGenerator.cpp || exit 1
+clang++ -shared -o bin/BranchTracer.so Part1/BranchTracer.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
+clang++ -shared -o bin/InputFeatureDetector.so Part2/InputFeatureDetector.cpp Part2/FeatureReport.cpp Part2/TaintAnalysis.cpp Part2/IOModels.cpp Part2/LoopTripCount.cpp Part2/AnalysisCache.cpp Part2/FeatureExtractor.cpp Part2/TaintTracker.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
+
+# prints the median wall time of RUNS runs of a command, in milliseconds
+time_median() {
+    local times=()
+    for ((i = 0; i < RUNS; i++)); do
+        local start=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        local end=$(date +%s%N)
+        times+=($((end - start)))
+    done
+    printf "%s\n" "${times[@]}" | sort -n | awk '{ t[NR] = $1 } END { printf "%.3f", t[int((NR + 1) / 2)] / 1000000 }'
+}
+
+# prints the peak resident memory of a command in KiB, polling VmHWM while it runs
+peak_memory() {
+    "$@" > /dev/null 2>&1 &
+    local pid=$! peak=0 hwm
+    while kill -0 $pid 2> /dev/null; do
+        hwm=$(awk '/^VmHWM/ { print $2 }' /proc/$pid/status 2> /dev/null)
+        [ -n "$hwm" ] && peak=$hwm
+        sleep 0.01
+    done
+    wait $pid
+    echo $peak
+}
+
+# log-log slope between two measurements
+slope() {
+    awk -v n0="$1" -v n1="$2" -v t0="$3" -v t1="$4" 'BEGIN { if (n0 > 0 && t0 > 0 && n1 != n0) printf "%.2f", log(t1 / t0) / log(n1 / n0); else printf "-" }'
+}
+
+# commands, not functions, so that the pid peak_memory polls is the one of opt
+TRACER=(opt -enable-new-pm=0 -load ../../BranchTracer.so -branch-pointer-tracer -o /dev/null)
+DETECTOR=(opt -enable-new-pm=0 -load ../../InputFeatureDetector.so -input-pointer-tracer -ifd-no-cache -disable-output)
+
+: > "$REPORT"
+printf "\n%10s %8s %12s %10s %8s %13s %11s %8s\n" functions lines tracer_ms tracer_kb slope detector_ms detector_kb slope
+
+previous_lines=0
+previous_tracer=0
+previous_detector=0
+for functions in $SIZES; do
+    # Step 2: Generate the program and its LLVM IR
+    file="generated_${functions}"
+    bin/ProgramGenerator -functions "$functions" $GENERATOR_OPTIONS > "$BENCH/${file}.c" || exit 1
+    if ! clang -O0 -g -S -emit-llvm "$BENCH/${file}.c" -o "$BENCH/${file}.ll" 2> /dev/null; then
+        echo "Error: could not compile $BENCH/${file}.c, skipping it" >&2
+        continue
+    fi
+    lines=$(wc -l < "$BENCH/${file}.c")
+
+    # Step 3: Time both passes and measure their memory
+    cd "$BENCH/work"
+    tracer_ms=$(time_median "${TRACER[@]}" "../${file}.ll")
+    tracer_kb=$(peak_memory "${TRACER[@]}" "../${file}.ll")
+    detector_ms=$(time_median "${DETECTOR[@]}" "../${file}.ll")
+    detector_kb=$(peak_memory "${DETECTOR[@]}" "../${file}.ll")
+    cd ../../..
+
+    tracer_slope=$(slope "$previous_lines" "$lines" "$previous_tracer" "$tracer_ms")
+    detector_slope=$(slope "$previous_lines" "$lines" "$previous_detector" "$detector_ms")
+    previous_lines=$lines
+    previous_tracer=$tracer_ms
+    previous_detector=$detector_ms
+
+    printf "%10s %8s %12s %10s %8s %13s %11s %8s\n" "$functions" "$lines" "$tracer_ms" "$tracer_kb" "$tracer_slope" "$detector_ms" "$detector_kb" "$detector_slope"
+    printf '{"detector_kb":%s,"detector_ms":%s,"functions":%s,"lines":%s,"tracer_kb":%s,"tracer_ms":%s}\n' \
+        "$detector_kb" "$detector_ms" "$functions" "$lines" "$tracer_kb" "$tracer_ms" >> "$REPORT"
+done
+
+echo -e "\n**** Report written to $REPORT"
@@ -0,0 +1,118 @@
+#!/bin/bash
+
+# Checks that the control-flow skeleton of every program in tests/ prints the same trace as the
+# full program, and how much faster it runs
+#
+# the skeleton is the program instrumented by BranchTracer with -skeleton: output and the
+# computations no branch or indirect call depends on are removed after the instrumentation
+#
+# for every program it prints
+#   traced_ms      run time of the program instrumented by BranchTracer
+#   skeleton_ms    run time of its instrumented skeleton
+#   speedup        traced_ms / skeleton_ms
+#   trace_events   number of lines in the trace
+#   trace          "same" if both traces are identical, "DIFFERENT" otherwise
+# times are the median of several runs
+#
+# programs read their input from tests/inputs/<name>.txt and take the arguments
+# in tests/inputs/<name>.args, if those files exist
+#
+# usage: ./skeleton.sh [-r runs] [-p "tracer options"] [C files...]
+#   -r  runs per measurement (default 5)
+#   -p  extra options for the tracer, e.g. "-coalesce-loops"
+# exits with status 1 if any trace differs
+
+RUNS=5
+TRACER_OPTIONS=""
+TIMEOUT=60
+
+while getopts "r:p:" opt; do
+    case $opt in
+        r) RUNS="$OPTARG" ;;
+        p) TRACER_OPTIONS="$OPTARG" ;;
+        *) sed -n '/^# usage/,/^$/p' "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+PROGRAMS=("$@")
+if [ ${#PROGRAMS[@]} -eq 0 ]; then
+    PROGRAMS=(tests/*.c)
+fi
+
+SKELETON=bin/skeleton
+mkdir -p "$SKELETON/work" "$SKELETON/output"    # the pass runs in bin/skeleton/work and writes its dictionary to ../output
+
+# Step 1: Compile the pass and its runtime
+echo -e "**** Compiling BranchTracer.cpp and BranchTracerRuntime.c ..."
+clang++ -shared -o bin/BranchTracer.so Part1/BranchTracer.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
+${CC:-clang} -O2 -fPIC -c Part1/BranchTracerRuntime.c -o bin/BranchTracerRuntime.o || exit 1
+
+# prints the median wall time of RUNS runs of a command, in milliseconds
+time_median() {
+    local times=()
+    for ((i = 0; i < RUNS; i++)); do
+        local start=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        local end=$(date +%s%N)
+        times+=($((end - start)))
+    done
+    printf "%s\n" "${times[@]}" | sort -n | awk '{ t[NR] = $1 } END { printf "%.3f", t[int((NR + 1) / 2)] / 1000000 }'
+}
+
+# runs a program with its canned input and arguments
+run_program() {
+    timeout "$TIMEOUT" "$1" "${ARGS[@]}" < "$INPUT"
+}
+
+# instruments LLVM IR with the given tracer options and builds it
+build_traced() {
+    (cd "$SKELETON/work" && opt -enable-new-pm=0 -load ../../BranchTracer.so -branch-pointer-tracer $TRACER_OPTIONS $3 -S "../${file}.ll" -o "../$2.ll") > /dev/null 2>&1 &&
+        llc -O0 -relocation-model=pic -filetype=obj "$SKELETON/$2.ll" -o "$SKELETON/$2.o" &&
+        ${CC:-clang} "$SKELETON/$2.o" bin/BranchTracerRuntime.o -o "$SKELETON/$2" -lm -pthread
+}
+
+failed=0
+printf "\n%-14s %12s %12s %9s %12s %10s\n" program traced_ms skeleton_ms speedup trace_events trace
+
+for C_FILE_PATH in "${PROGRAMS[@]}"; do
+    filename=$(basename "$C_FILE_PATH")
+    file="${filename%.*}"
+    INPUT="tests/inputs/${file}.txt"
+    [ -f "$INPUT" ] || INPUT=/dev/null
+    ARGS=()
+    [ -f "tests/inputs/${file}.args" ] && read -r -a ARGS < "tests/inputs/${file}.args"
+
+    # Step 2: Build the traced program and its traced skeleton
+    if ! clang -O0 -g -S -emit-llvm "$C_FILE_PATH" -o "$SKELETON/${file}.ll" 2> /dev/null; then
+        echo "Error: could not compile $C_FILE_PATH, skipping it" >&2
+        continue
+    fi
+    if ! build_traced "$file" "traced_${file}" "" || ! build_traced "$file" "skeleton_${file}" -skeleton; then
+        echo "Error: could not build $C_FILE_PATH, skipping it" >&2
+        continue
+    fi
+
+    # Step 3: Compare the traces, the lines the instrumentation added to the output
+    run_program "$SKELETON/traced_${file}" 2> /dev/null | grep -E '^(br_[0-9]+|\*func_)' > "$SKELETON/${file}.trace"
+    run_program "$SKELETON/skeleton_${file}" 2> /dev/null | grep -E '^(br_[0-9]+|\*func_)' > "$SKELETON/${file}.skeleton.trace"
+    trace=same
+    if ! cmp -s "$SKELETON/${file}.trace" "$SKELETON/${file}.skeleton.trace"; then
+        trace=DIFFERENT
+        failed=1
+    fi
+    trace_events=$(wc -l < "$SKELETON/${file}.trace")
+
+    # Step 4: Time both
+    traced_ms=$(time_median run_program "$SKELETON/traced_${file}")
+    skeleton_ms=$(time_median run_program "$SKELETON/skeleton_${file}")
+    speedup=$(awk -v t="$traced_ms" -v s="$skeleton_ms" 'BEGIN { printf "%.3f", (s > 0 ? t / s : 0) }')
+
+    printf "%-14s %12s %12s %9s %12s %10s\n" "$file" "$traced_ms" "$skeleton_ms" "$speedup" "$trace_events" "$trace"
+done
+
+if [ $failed -ne 0 ]; then
+    echo -e "\n**** Some skeletons printed a different trace, compare the .trace files in $SKELETON"
+    exit 1
+fi
+echo -e "\n**** Every skeleton printed the trace of its program"
@@ -10,6 +10,7 @@ C_FILE_PATH="$1"
 filename=$(basename "$C_FILE_PATH")     # Extracts "example.c"
 file="${filename%.*}"
 mkdir -p bin   # Creates bin folder if it doesn't exist
+mkdir -p output   # Creates output folder for the dictionary and feature report
 cd build
 
 # Step 1: Generate LLVM IR from the C file
@@ -18,8 +19,8 @@ clang -O0 -g -S -emit-llvm "../$C_FILE_PATH" -o "../bin/${file}.ll"
 
 # Step 2: Compile BranchTracer.cpp and  InputFeatureDetector.cpp to a shared object
 echo -e "**** Compiling BranchTracer.cpp and InputFeatureDetector.cpp ..."
-clang++ -shared -o ../bin/BranchTracer.so ../Part1/BranchTracer.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC
-clang++ -shared -o ../bin/InputFeatureDetector.so ../Part2/InputFeatureDetector.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC
+clang++ -shared -o ../bin/BranchTracer.so ../Part1/BranchTracer.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
+clang++ -shared -o ../bin/InputFeatureDetector.so ../Part2/InputFeatureDetector.cpp ../Part2/FeatureReport.cpp ../Part2/TaintAnalysis.cpp ../Part2/IOModels.cpp ../Part2/LoopTripCount.cpp ../Part2/AnalysisCache.cpp ../Part2/FeatureExtractor.cpp ../Part2/TaintTracker.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
 
 # Step 3: Transform LLVM IR using BranchTracer.so
 echo -e "\n**** Transforming ${C_FILE_PATH} to /bin/${file}.ll ..."
@@ -27,12 +28,12 @@ opt -enable-new-pm=0 -load ../bin/BranchTracer.so -branch-pointer-tracer < "../b
 
 cd ../
 
-# Step 4: Make the transformed file executable
-chmod +x "bin/transformed_${file}.ll"
+# Step 4: Link the transformed file with the tracer runtime
+clang -O0 "bin/transformed_${file}.ll" Part1/BranchTracerRuntime.c -pthread -o "bin/traced_${file}"
 
-# Step 5: Execute the transformed file
-echo -e "\n**** Running the transformed file: ./bin/transformed_${file}.ll"
-"./bin/transformed_${file}.ll"
+# Step 5: Execute the traced program, the trace is decoded with the branch dictionary
+echo -e "\n**** Running the traced program: ./bin/traced_${file}"
+"./bin/traced_${file}" | ./decode_trace.sh -d "output/${filename}_BranchDictionary.txt"
 
 # Step 6: Compile the original C file
 echo -e "\n\b**** compiling original C file to /bin/${file}"
@@ -0,0 +1,90 @@
+#!/bin/bash
+
+# Checks the seminal input features InputFeatureDetector finds statically against the inputs
+# that reach each branch when the programs in tests/ run, tracked by the taint tracker
+#
+# every program is analyzed (output/<file>.c_InputFeatures.jsonl), instrumented with
+# -input-taint-tracker and run on its canned input; Part2/tools/taint_check then compares
+# the report with the labels of the run, line by line:
+#   confirmed              inputs both found
+#   missed by the report   inputs the run saw reach the branch, absent from the report
+#   not observed           inputs of the report no run saw, over-approximated or reaching
+#                          the branch through control dependence only
+# and the run time of the tracked program over the original one
+#
+# programs read their input from tests/inputs/<name>.txt and take the arguments
+# in tests/inputs/<name>.args, if those files exist
+#
+# usage: ./taint_check.sh [C files...]
+# exits with status 1 if the report missed an input of any program
+
+TIMEOUT=60
+
+PROGRAMS=("$@")
+if [ ${#PROGRAMS[@]} -eq 0 ]; then
+    PROGRAMS=(tests/*.c)
+fi
+
+TAINT=bin/taint
+mkdir -p "$TAINT/work" "$TAINT/output" output     # the passes run in bin/taint/work and write their cache to ../output
+
+# Step 1: Compile the passes, the runtime and taint_check
+echo -e "**** Compiling the input feature detector, TaintTrackerRuntime.c and taint_check ..."
+clang++ -shared -o bin/InputFeatureDetector.so Part2/InputFeatureDetector.cpp Part2/FeatureReport.cpp Part2/TaintAnalysis.cpp Part2/IOModels.cpp Part2/LoopTripCount.cpp Part2/AnalysisCache.cpp Part2/FeatureExtractor.cpp Part2/TaintTracker.cpp $(llvm-config --cxxflags --ldflags --libs) -fPIC || exit 1
+${CC:-clang} -O2 -fPIC -c Part2/TaintTrackerRuntime.c -o bin/TaintTrackerRuntime.o || exit 1
+(cmake -S Part2/tools -B build/feature-tools && cmake --build build/feature-tools --target taint_check) > /dev/null || exit 1
+
+# prints the wall time of a command, in milliseconds
+time_ms() {
+    local start=$(date +%s%N)
+    "$@" > /dev/null 2>&1
+    local end=$(date +%s%N)
+    awk -v t=$((end - start)) 'BEGIN { printf "%.3f", t / 1000000 }'
+}
+
+# runs a program with its canned input and arguments
+run_program() {
+    timeout "$TIMEOUT" "$1" "${ARGS[@]}" < "$INPUT"
+}
+
+failed=0
+for C_FILE_PATH in "${PROGRAMS[@]}"; do
+    filename=$(basename "$C_FILE_PATH")
+    file="${filename%.*}"
+    INPUT="tests/inputs/${file}.txt"
+    [ -f "$INPUT" ] || INPUT=/dev/null
+    ARGS=()
+    [ -f "tests/inputs/${file}.args" ] && read -r -a ARGS < "tests/inputs/${file}.args"
+
+    # Step 2: Analyze the program, and build it untouched and tracked
+    if ! clang -O0 -g -S -emit-llvm "$C_FILE_PATH" -o "$TAINT/${file}.ll" 2> /dev/null; then
+        echo "Error: could not compile $C_FILE_PATH, skipping it" >&2
+        continue
+    fi
+    REPORT="output/${filename}_InputFeatures.jsonl"
+    if ! (cd "$TAINT/work" && opt -enable-new-pm=0 -load ../../InputFeatureDetector.so -input-pointer-tracer -ifd-output="../../../$REPORT" -disable-output "../${file}.ll" &&
+            opt -enable-new-pm=0 -load ../../InputFeatureDetector.so -input-taint-tracker -S "../${file}.ll" -o "../tracked_${file}.ll") > /dev/null 2>&1 ||
+        ! ${CC:-clang} -O0 "$TAINT/tracked_${file}.ll" bin/TaintTrackerRuntime.o -lm -o "$TAINT/tracked_${file}" 2> /dev/null ||
+        ! ${CC:-clang} -O0 "$TAINT/${file}.ll" -lm -o "$TAINT/${file}" 2> /dev/null; then
+        echo "Error: could not build $C_FILE_PATH, skipping it" >&2
+        continue
+    fi
+
+    # Step 3: Run both and compare the labels of the tracked run with the report
+    rm -f "$TAINT/${file}.taint"
+    native_ms=$(time_ms run_program "$TAINT/${file}")
+    tracked_ms=$(TT_FILE="$TAINT/${file}.taint" time_ms run_program "$TAINT/tracked_${file}")
+    if [ ! -f "$TAINT/${file}.taint" ]; then
+        echo "Error: tracked ${file} did not exit normally, skipping it" >&2
+        continue
+    fi
+    echo -e "\n**** ${file}: ${tracked_ms} ms tracked, ${native_ms} ms native"
+    build/feature-tools/taint_check -report="$REPORT" "$TAINT/${file}.taint"
+    [ $? -eq 2 ] && failed=1
+done
+
+if [ $failed -ne 0 ]; then
+    echo -e "\n**** The report missed inputs some runs saw reach a branch, see above"
+    exit 1
+fi
+echo -e "\n**** Every input a run saw reach a branch is in the report"
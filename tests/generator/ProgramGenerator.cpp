@@ -0,0 +1,202 @@
+/*
+ * Copyright 2024 Willie D. Harris, Jr.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+/**
+ * ProgramGenerator
+ * writes a synthetic C program to stdout, to stress-test the passes on large modules
+ * the same options and seed always give the same program
+ *
+ * every function reads input (scanf or fread), branches on it, runs loops whose
+ * bounds depend on it, makes an indirect call through a VType-like struct of
+ * function pointers (as in tests/driver.c) and calls one lower-numbered function,
+ * so the call graph is acyclic and every generated program terminates
+ *
+ * usage: ProgramGenerator [-functions N] [-branches N] [-loops N] [-types N] [-inputs N] [-seed N]
+ */
+
+namespace
+{
+    struct Options
+    {
+        unsigned functions = 20;    // number of generated functions besides main
+        unsigned branches = 4;      // if statements per function
+        unsigned loops = 2;         // loops per function
+        unsigned types = 4;         // implementations of the VType interface
+        unsigned inputs = 1;        // scanf/fread calls per function
+        unsigned seed = 1;
+    };
+
+    std::mt19937 rng;
+
+    // uniform in [0, n), the same on every platform unlike std::uniform_int_distribution
+    unsigned pick(unsigned n)
+    {
+        return rng() % n;
+    }
+
+    const char *variable()
+    {
+        return pick(2) ? "x" : "y";
+    }
+
+    void printTypes(const Options &options)
+    {
+        printf("typedef struct VTypeStruct {\n"
+               "    int val;\n"
+               "    int (*score)( struct VTypeStruct const *v );\n"
+               "    void (*print)( struct VTypeStruct const *v );\n"
+               "} VType;\n\n");
+
+        for (unsigned t = 0; t < options.types; t++)
+        {
+            unsigned pivot = pick(100);
+            printf("int score_%u( VType const *v )\n{\n", t);
+            printf("    if ( v->val > %u ) {\n        return v->val - %u;\n    }\n", pivot, pivot);
+            printf("    return %u - v->val;\n}\n\n", pivot);
+            printf("void print_%u( VType const *v )\n{\n", t);
+            printf("    printf( \"type %u: %%d\\n\", v->val );\n}\n\n", t);
+        }
+
+        printf("int (*const scores[])( VType const *v ) = {");
+        for (unsigned t = 0; t < options.types; t++)
+            printf("%s score_%u", t ? "," : "", t);
+        printf(" };\n");
+        printf("void (*const prints[])( VType const *v ) = {");
+        for (unsigned t = 0; t < options.types; t++)
+            printf("%s print_%u", t ? "," : "", t);
+        printf(" };\n\n");
+
+        printf("VType makeValue( unsigned kind, int val )\n{\n"
+               "    VType v;\n"
+               "    v.val = val;\n"
+               "    v.score = scores[ kind %% %u ];\n"
+               "    v.print = prints[ kind %% %u ];\n"
+               "    return v;\n}\n\n", options.types, options.types);
+    }
+
+    void printInput()
+    {
+        if (pick(2))
+        {
+            printf("    if ( scanf( \"%%d\", &x ) != 1 ) {\n        x = a + %u;\n    }\n", pick(50));
+        }
+        else
+        {
+            printf("    if ( fread( buf, 1, sizeof buf, stdin ) > 0 ) {\n        y = y + buf[ 0 ];\n    }\n");
+        }
+    }
+
+    void printBranch()
+    {
+        const char *ops[] = { ">", "<", "==", "!=", ">=", "<=" };
+        const char *condition = variable();
+        printf("    if ( %s %s %u ) {\n", condition, ops[pick(6)], pick(200));
+        printf("        y = ( y * %u + x ) & 65535;\n", 1 + pick(9));
+        if (pick(3) == 0)
+            printf("        if ( ( x & %u ) == 0 ) {\n            x = x + 1;\n        }\n", 1 + pick(7));
+        printf("    } else {\n");
+        printf("        x = ( x + %u ) & 65535;\n", pick(100));
+        printf("    }\n");
+    }
+
+    void printLoop()
+    {
+        if (pick(2))
+        {
+            printf("    for ( i = 0; i < ( %s & %u ); i++ ) {\n", variable(), 7 + pick(9));
+            printf("        y = y ^ ( i * %u );\n", 1 + pick(13));
+            printf("        if ( ( i & 3 ) == %u ) {\n            y = y + 1;\n        }\n", pick(4));
+            printf("    }\n");
+        }
+        else
+        {
+            printf("    while ( y > %u ) {\n", 1000 + pick(1000));
+            printf("        y = y / %u;\n", 2 + pick(3));
+            printf("    }\n");
+        }
+    }
+
+    void printFunction(const Options &options, unsigned k)
+    {
+        printf("int f_%u( int a, int b )\n{\n", k);
+        printf("    int x = a;\n    int y = b;\n    int i;\n    unsigned char buf[ 4 ];\n\n");
+
+        for (unsigned i = 0; i < options.inputs; i++)
+            printInput();
+
+        // branches and loops in random order
+        unsigned branches = options.branches, loops = options.loops;
+        while (branches + loops > 0)
+        {
+            if (pick(branches + loops) < branches)
+            {
+                printBranch();
+                branches--;
+            }
+            else
+            {
+                printLoop();
+                loops--;
+            }
+        }
+
+        printf("    {\n        VType v = makeValue( ( unsigned ) y, x );\n        y = y + v.score( &v );\n    }\n");
+        if (k > 0)
+            printf("    y = y + f_%u( x, y & 255 );\n", pick(k));
+        printf("    return y & 65535;\n}\n\n");
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            unsigned value = strtoul(argv[i + 1], nullptr, 10);
+            if (!strcmp(argv[i], "-functions"))     options.functions = value;
+            else if (!strcmp(argv[i], "-branches")) options.branches = value;
+            else if (!strcmp(argv[i], "-loops"))    options.loops = value;
+            else if (!strcmp(argv[i], "-types"))    options.types = value;
+            else if (!strcmp(argv[i], "-inputs"))   options.inputs = value;
+            else if (!strcmp(argv[i], "-seed"))     options.seed = value;
+            else return false;
+        }
+        return argc % 2 == 1 && options.types > 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "usage: %s [-functions N] [-branches N] [-loops N] [-types N(>0)] [-inputs N] [-seed N]\n", argv[0]);
+        return 1;
+    }
+    rng.seed(options.seed);
+
+    printf("/* generated by ProgramGenerator -functions %u -branches %u -loops %u -types %u -inputs %u -seed %u */\n",
+           options.functions, options.branches, options.loops, options.types, options.inputs, options.seed);
+    printf("#include <stdio.h>\n\n");
+
+    printTypes(options);
+    for (unsigned k = 0; k < options.functions; k++)
+        printFunction(options, k);
+
+    printf("int main()\n{\n    int total = 0;\n");
+    for (unsigned k = 0; k < options.functions; k++)
+        printf("    total = ( total + f_%u( %u, total ) ) & 65535;\n", k, pick(100));
+    printf("    {\n        VType v = makeValue( 0, total );\n        v.print( &v );\n    }\n");
+    printf("    return 0;\n}\n");
+    return 0;
+}
@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+/* n is read by a function defined before main, through a pointer argument */
+void readN(int *p)
+{
+    scanf("%d", p);
+}
+
+int main()
+{
+    int n, i, sum = 0;
+    readN(&n);
+    for (i = 0; i < n; i++)
+        sum += i;
+    printf("%d\n", sum);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+/* the same as readptr.c, with readN defined after main */
+void readN(int *p);
+
+int main()
+{
+    int n, i, sum = 0;
+    readN(&n);
+    for (i = 0; i < n; i++)
+        sum += i;
+    printf("%d\n", sum);
+    return 0;
+}
+
+void readN(int *p)
+{
+    scanf("%d", p);
+}